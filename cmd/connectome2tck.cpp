@@ -107,6 +107,31 @@ void usage ()
 
 
 
+// Read and extract only those streamlines within the selection; all others
+//   are accounted for in the output files without being read
+template <class StreamlineType, class AssignmentType>
+void extract_selection (Tractography::Reader<float>& reader,
+                        const WriterExtraction& writer,
+                        const std::vector<uint64_t>& selection,
+                        const std::vector<AssignmentType>& assignments,
+                        const uint64_t count,
+                        ProgressBar& progress)
+{
+  StreamlineType tck;
+  uint64_t next = 0;
+  for (auto i : selection) {
+    writer.skip (i - next);
+    reader.load (i, tck);
+    tck.set_nodes (assignments[i]);
+    writer (tck);
+    next = i + 1;
+    ++progress;
+  }
+  writer.skip (count - next);
+}
+
+
+
 void run ()
 {
 
@@ -197,6 +222,30 @@ void run ()
   opt = get_options ("files");
   const int file_format = opt.size() ? opt[0][0] : 0;
 
+  // If only a subset of nodes is of interest, determine which streamlines
+  //   could possibly contribute to the output, and read only those directly
+  //   from the track file rather than reading through the entire file
+  std::vector<uint64_t> selection;
+  if (manual_node_list) {
+    std::vector<bool> in_list (max_node_index+1, false);
+    for (auto n : nodes)
+      in_list[n] = true;
+    for (size_t i = 0; i != count; ++i) {
+      // Streamlines with no node assignments are passed to the writer as-is
+      bool selected = assignments_pairs.empty() && assignments_lists[i].empty();
+      if (assignments_pairs.size()) {
+        selected = in_list[assignments_pairs[i].first] || in_list[assignments_pairs[i].second];
+      } else {
+        for (auto n : assignments_lists[i])
+          selected = selected || in_list[n];
+      }
+      if (selected)
+        selection.push_back (i);
+    }
+    reader.index();
+    INFO (str(selection.size()) + " of " + str(count) + " streamlines are assigned to nodes of interest");
+  }
+
   opt = get_options ("exemplars");
   if (opt.size()) {
 
@@ -229,13 +278,23 @@ void run ()
 
     {
       std::mutex mutex;
-      ProgressBar progress ("generating exemplars for connectome", count);
+      ProgressBar progress ("generating exemplars for connectome", manual_node_list ? selection.size() : count);
+      // Read either the next streamline in the file, or the next one in the selection:
+      size_t next = 0;
+      auto read = [&] (Tractography::Streamline<float>& out) {
+        if (!manual_node_list)
+          return reader (out);
+        if (next == selection.size())
+          return false;
+        reader.load (selection[next++], out);
+        return true;
+      };
       if (assignments_pairs.size()) {
-        auto loader = [&] (Tractography::Connectome::Streamline_nodepair& out) { if (!reader (out)) return false; out.set_nodes (assignments_pairs[out.index]); return true; };
+        auto loader = [&] (Tractography::Connectome::Streamline_nodepair& out) { if (!read (out)) return false; out.set_nodes (assignments_pairs[out.index]); return true; };
         auto worker = [&] (const Tractography::Connectome::Streamline_nodepair& in) { generator (in); std::lock_guard<std::mutex> lock (mutex); ++progress; return true; };
         Thread::run_queue (loader, Thread::batch (Tractography::Connectome::Streamline_nodepair()), Thread::multi (worker));
       } else {
-        auto loader = [&] (Tractography::Connectome::Streamline_nodelist& out) { if (!reader (out)) return false; out.set_nodes (assignments_lists[out.index]); return true; };
+        auto loader = [&] (Tractography::Connectome::Streamline_nodelist& out) { if (!read (out)) return false; out.set_nodes (assignments_lists[out.index]); return true; };
         auto worker = [&] (const Tractography::Connectome::Streamline_nodelist& in) { generator (in); std::lock_guard<std::mutex> lock (mutex); ++progress; return true; };
         Thread::run_queue (loader, Thread::batch (Tractography::Connectome::Streamline_nodelist()), Thread::multi (worker));
       }
@@ -318,8 +377,16 @@ void run ()
         break;
     }
 
-    ProgressBar progress ("Extracting tracks from connectome", count);
-    if (assignments_pairs.size()) {
+    ProgressBar progress ("Extracting tracks from connectome", manual_node_list ? selection.size() : count);
+    if (manual_node_list) {
+      // Streamlines outside the selection cannot be written to any output
+      //   file; these are never read, but still need to be accounted for in
+      //   the total count of the output files
+      if (assignments_pairs.size())
+        extract_selection<Streamline_nodepair> (reader, writer, selection, assignments_pairs, count, progress);
+      else
+        extract_selection<Streamline_nodelist> (reader, writer, selection, assignments_lists, count, progress);
+    } else if (assignments_pairs.size()) {
       Tractography::Connectome::Streamline_nodepair tck;
       while (reader (tck)) {
         tck.set_nodes (assignments_pairs[tck.index]);
@@ -334,6 +401,7 @@ void run ()
         ++progress;
       }
     }
+    writer.finalise();
 
   }
 
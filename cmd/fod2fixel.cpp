@@ -123,6 +123,7 @@ class Segmented_FOD_receiver
     size_t num_outputs() const;
 
     bool operator() (const FOD_lobes&);
+    bool operator() (const std::vector<FOD_lobes>&);
 
 
 
@@ -205,6 +206,15 @@ bool Segmented_FOD_receiver::operator() (const FOD_lobes& in)
   return true;
 }
 
+bool Segmented_FOD_receiver::operator() (const std::vector<FOD_lobes>& in)
+{
+  for (const auto& i : in) {
+    if (!(*this) (i))
+      return false;
+  }
+  return true;
+}
+
 
 
 
@@ -238,6 +248,6 @@ void run ()
   Segmenter fmls (dirs, Math::SH::LforN (H.size(3)));
   load_fmls_thresholds (fmls);
 
-  Thread::run_queue (writer, Thread::batch (SH_coefs()), Thread::multi (fmls), Thread::batch (FOD_lobes()), receiver);
+  Thread::run_queue (writer, std::vector<SH_coefs>(), Thread::multi (fmls), std::vector<FOD_lobes>(), receiver);
 }
 
@@ -174,8 +174,19 @@ inline void copy_permute (Header& header_in, Header& header_out, const std::vect
     auto out = Header::create (output_filename, header_out).get_image<T>();
     DWI::export_grad_commandline (out);
 
-    auto perm = Adapter::make <Adapter::PermuteAxes> (in, axes); 
-    threaded_copy_with_progress (perm, out, 0, std::numeric_limits<size_t>::max(), 2);
+    bool identity = ( axes.size() == in.ndim() );
+    for (size_t n = 0; n < axes.size(); ++n)
+      identity = identity && ( axes[n] == int(n) );
+
+    if (identity) {
+      // no need to go through the adapter: copying image to image allows
+      // the data to be converted one row at a time
+      threaded_copy_with_progress (in, out, 0, std::numeric_limits<size_t>::max(), 2);
+    }
+    else {
+      auto perm = Adapter::make <Adapter::PermuteAxes> (in, axes); 
+      threaded_copy_with_progress (perm, out, 0, std::numeric_limits<size_t>::max(), 2);
+    }
 
   } else {
 
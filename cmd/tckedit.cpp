@@ -68,6 +68,11 @@ void usage ()
 
   + Option ("ends_only", "only test the ends of each streamline against the provided include/exclude ROIs")
 
+  + Option ("indices", "only consider the streamlines at the (zero-based) indices listed in the text file provided, "
+                       "in the order listed; indices refer to the position of each streamline across all input files. "
+                       "These streamlines are read directly from the input file(s), without reading through all preceding data.")
+    + Argument ("file").type_file_in()
+
   // TODO Input weights with multiple input files currently not supported
   + OptionGroup ("Options for handling streamline weights")
   + Tractography::TrackWeightsInOption
@@ -164,18 +169,39 @@ void run ()
   const size_t number = get_option_value ("number", size_t(0));
   const size_t skip   = get_option_value ("skip",   size_t(0));
 
-  Loader loader (input_file_list);
+  std::vector<uint64_t> indices;
+  auto opt = get_options ("indices");
+  if (opt.size()) {
+    const auto data = load_vector<uint64_t> (opt[0][0]);
+    indices.assign (data.data(), data.data() + data.size());
+    if (indices.empty())
+      throw Exception ("no streamline indices found in file \"" + str(opt[0][0]) + "\"");
+  }
+
+  Loader loader (input_file_list, indices);
   Worker worker (properties, inverse, ends_only);
   // This needs to be run AFTER creation of the Worker class
   // (worker needs to be able to set max & min number of points based on step size in input file,
   //  receiver needs "output_step_size" field to have been updated before file creation)
   Receiver receiver (output_path, properties, number, skip);
 
-  Thread::run_queue (
-      loader, 
-      Thread::batch (Streamline<>()),
-      Thread::multi (worker), 
-      Thread::batch (Streamline<>()),
-      receiver);
+  // -number, -skip & -indices refer to the order of streamlines in the
+  //   input, so only read input files from multiple threads if none is used
+  if (number || skip || indices.size()) {
+    Thread::run_queue (
+        loader,
+        Thread::batch (Streamline<>()),
+        Thread::multi (worker),
+        Thread::batch (Streamline<>()),
+        receiver);
+  } else {
+    Thread::run_queue (
+        Thread::multi (loader),
+        Thread::batch (Streamline<>()),
+        Thread::multi (worker),
+        Thread::batch (Streamline<>()),
+        receiver);
+  }
+  receiver.finalise();
 
 }
@@ -21,6 +21,7 @@
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/roi.h"
 
+#include "dwi/tractography/tracking/checkpoint.h"
 #include "dwi/tractography/tracking/exec.h"
 #include "dwi/tractography/tracking/method.h"
 #include "dwi/tractography/tracking/tractography.h"
@@ -134,9 +135,14 @@ void usage ()
   + DWI::Tractography::ACT::ACTOption
 
   + DWI::Tractography::Seeding::SeedOption
+
+  + DWI::Tractography::Tracking::CheckpointOption
   
   + DWI::GradImportOptions();
 
+  // the output files of the original run are re-opened when resuming
+  App::check_overwrite_files_func = DWI::Tractography::Tracking::Checkpoint::check_overwrite;
+
 }
 
 
@@ -148,6 +154,8 @@ void run ()
   using namespace DWI::Tractography::Tracking;
   using namespace DWI::Tractography::Algorithms;
 
+  Checkpoint::prepare_resume();
+
   Properties properties;
 
   int algorithm = 2; // default = ifod2
@@ -176,6 +184,8 @@ void run ()
 
   }
 
+  Tracking::load_shard_properties (properties);
+
   switch (algorithm) {
     case 0:
       Exec<FACT>       ::run (argument[0], argument[1], properties);
@@ -333,6 +333,7 @@ void run ()
   
   MR::DWI::Tractography::Writer<float> writer (argument[2], ftfileprops);
   pgrid.exportTracks(writer);
+  writer.finalise();
   
   
   // Save fiso, tod and eext
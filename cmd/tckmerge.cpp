@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+
+#include <algorithm>
+#include <fstream>
+
+#include "command.h"
+#include "progressbar.h"
+#include "raw.h"
+#include "file/ofstream.h"
+#include "dwi/tractography/file_base.h"
+#include "dwi/tractography/properties.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+
+  DESCRIPTION
+  + "merge the track files generated by multiple tckgen processes using the -shard option into a single track file"
+
+  + "The track data of each shard are copied directly into the output file, "
+    "without parsing individual streamlines, in order of shard index (irrespective "
+    "of the order in which the files are provided), so that the output is "
+    "independent of the order in which the shards were generated. All shards "
+    "must be present, and must use the same datatype. The streamline counts "
+    "and the requested numbers of streamlines are summed across shards in the "
+    "header of the output file.";
+
+  ARGUMENTS
+  + Argument ("shards", "the track files generated by each shard.").type_tracks_in().allow_multiple()
+  + Argument ("output", "the merged output track file.").type_tracks_out();
+
+  OPTIONS
+  + Option ("weights_in", "a text file containing the streamline weights of a shard; "
+                          "if used, this option must be provided once for each input track file, "
+                          "in the same order.").allow_multiple()
+    + Argument ("path").type_file_in()
+
+  + Option ("weights_out", "output the merged streamline weights to a text file "
+                           "(requires the -weights_in option).")
+    + Argument ("path").type_file_out();
+}
+
+
+
+// keys in the track file header that are expected to differ between shards
+const std::vector<std::string> shard_keys = { "shard", "count", "total_count", "max_num_tracks", "max_num_attempts", "timestamp", "rng_seed" };
+
+
+
+class Shard : public __ReaderBase__
+{
+  public:
+    Shard (const std::string& path) :
+        path (path)
+    {
+      if (!Path::has_suffix (path, ".tck"))
+        throw Exception ("input file \"" + path + "\" is not in the .tck format");
+      const File::Entry entry = read_header (path, "tracks", properties);
+      data_file = entry.name;
+      data_start = entry.start;
+
+      const auto it = properties.find ("shard");
+      if (it == properties.end())
+        throw Exception ("track file \"" + path + "\" was not generated using the tckgen -shard option");
+      const auto spec = split (it->second, "/");
+      if (spec.size() != 2)
+        throw Exception ("malformed shard specification in track file \"" + path + "\"");
+      index = to<size_t> (spec[0]);
+      num_shards = to<size_t> (spec[1]);
+
+      count = to<uint64_t> (properties["count"]);
+      total_count = properties["total_count"].size() ? to<uint64_t> (properties["total_count"]) : count;
+
+      // the data must be terminated by the end-of-data barrier
+      const size_t point_size = 3 * dtype.bytes();
+      std::ifstream in (data_file.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+      const int64_t file_size = in.tellg();
+      if (file_size < data_start + int64_t (point_size))
+        throw Exception ("track file \"" + path + "\" is incomplete");
+      data_size = file_size - data_start - point_size;
+      char barrier[24];
+      in.seekg (data_start + data_size);
+      in.read (barrier, point_size);
+      const bool is_barrier = dtype.bytes() == 4 ?
+          std::isinf (Raw::fetch<float32> (barrier, 0, !dtype.is_little_endian())) :
+          std::isinf (Raw::fetch<float64> (barrier, 0, !dtype.is_little_endian()));
+      if (!in.good() || !is_barrier)
+        throw Exception ("track file \"" + path + "\" is incomplete");
+    }
+
+    const std::string path;
+    Properties properties;
+    std::string data_file;
+    int64_t data_start, data_size;
+    size_t index, num_shards;
+    uint64_t count, total_count;
+
+    const DataType& datatype () const { return dtype; }
+};
+
+
+
+template <typename ValueType>
+class MergedWriter : public __WriterBase__<ValueType>
+{
+  public:
+    using __WriterBase__<ValueType>::count;
+    using __WriterBase__<ValueType>::total_count;
+    using __WriterBase__<ValueType>::name;
+    using __WriterBase__<ValueType>::open_success;
+
+    MergedWriter (const std::string& path, const Properties& properties) :
+        __WriterBase__<ValueType> (path)
+    {
+      if (!Path::has_suffix (name, ".tck"))
+        throw Exception ("merged output track file must use the .tck suffix");
+      out.open (name, std::ios::out | std::ios::binary | std::ios::trunc);
+      this->create (out, properties, "tracks");
+      this->verify_stream (out);
+      open_success = true;
+    }
+
+    //! write the end-of-data barrier, once all shards have been appended
+    void finish ()
+    {
+      const ValueType barrier[3] = { ValueType(Inf), ValueType(Inf), ValueType(Inf) };
+      out.write (reinterpret_cast<const char*> (barrier), sizeof (barrier));
+      this->verify_stream (out);
+      out.close();
+    }
+
+    void append (const Shard& shard)
+    {
+      std::ifstream in (shard.data_file.c_str(), std::ios::in | std::ios::binary);
+      in.seekg (shard.data_start);
+      std::vector<char> buffer (16777216);
+      for (int64_t remaining = shard.data_size; remaining > 0; ) {
+        const size_t size = std::min<int64_t> (remaining, buffer.size());
+        in.read (buffer.data(), size);
+        if (!in.good())
+          throw Exception ("error reading track file \"" + shard.path + "\": " + strerror (errno));
+        out.write (buffer.data(), size);
+        this->verify_stream (out);
+        remaining -= size;
+      }
+      count += shard.count;
+      total_count += shard.total_count;
+    }
+
+  protected:
+    File::OFStream out;
+};
+
+
+
+template <typename ValueType>
+void merge (const std::vector<std::unique_ptr<Shard>>& shards, const Properties& properties)
+{
+  MergedWriter<ValueType> writer (argument.back(), properties);
+  ProgressBar progress ("merging track files", shards.size());
+  for (const auto& shard : shards) {
+    writer.append (*shard);
+    ++progress;
+  }
+  writer.finish();
+}
+
+
+
+void merge_weights (const std::vector<std::unique_ptr<Shard>>& shards, const std::vector<std::string>& weights_in, const std::string& weights_out)
+{
+  File::OFStream out (weights_out);
+  for (const auto& shard : shards) {
+    const std::string& path (weights_in[shard->index - 1]);
+    std::ifstream in (path.c_str());
+    if (!in)
+      throw Exception ("error opening streamline weights file \"" + path + "\": " + strerror (errno));
+    uint64_t count = 0;
+    std::string value;
+    while (in >> value) {
+      out << value << "\n";
+      ++count;
+    }
+    if (count != shard->count)
+      throw Exception ("number of entries in streamline weights file \"" + path + "\" (" + str(count) + ") "
+          "does not match number of streamlines in track file \"" + shard->path + "\" (" + str(shard->count) + ")");
+  }
+  if (!out.good())
+    throw Exception ("error writing streamline weights file \"" + weights_out + "\": " + strerror (errno));
+}
+
+
+
+void run ()
+{
+  const size_t num_inputs = argument.size() - 1;
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  for (size_t i = 0; i != num_inputs; ++i)
+    shards.push_back (std::unique_ptr<Shard> (new Shard (argument[i])));
+
+  // weights files are provided in the order of the input files; map them to shard index
+  std::vector<std::string> weights_in;
+  auto opt = get_options ("weights_in");
+  if (opt.size()) {
+    if (opt.size() != num_inputs)
+      throw Exception ("number of -weights_in options (" + str(opt.size()) + ") does not match number of input track files (" + str(num_inputs) + ")");
+    weights_in.resize (num_inputs);
+    for (size_t i = 0; i != num_inputs; ++i) {
+      if (shards[i]->index >= 1 && shards[i]->index <= num_inputs)
+        weights_in[shards[i]->index - 1] = std::string (opt[i][0]);
+    }
+  }
+  auto weights_out = get_options ("weights_out");
+  if (weights_out.size() && weights_in.empty())
+    throw Exception ("-weights_out option requires the -weights_in option");
+
+  std::sort (shards.begin(), shards.end(), [] (const std::unique_ptr<Shard>& a, const std::unique_ptr<Shard>& b) { return a->index < b->index; });
+
+  const size_t num_shards = shards[0]->num_shards;
+  if (num_shards != num_inputs)
+    throw Exception ("number of input track files (" + str(num_inputs) + ") does not match number of shards (" + str(num_shards) + ")");
+  for (size_t i = 0; i != num_inputs; ++i) {
+    if (shards[i]->num_shards != num_shards)
+      throw Exception ("track file \"" + shards[i]->path + "\" is from a different set of shards (" + shards[i]->properties["shard"] + ")");
+    if (shards[i]->index != i+1)
+      throw Exception ("shard " + str(i+1) + "/" + str(num_shards) + " is " + (shards[i]->index < i+1 ? "duplicated" : "missing"));
+    if (shards[i]->datatype() != shards[0]->datatype())
+      throw Exception ("track files \"" + shards[0]->path + "\" and \"" + shards[i]->path + "\" use different datatypes");
+  }
+
+  // sanity check that the shards were generated using the same parameters
+  for (size_t i = 1; i != num_inputs; ++i) {
+    for (const auto& entry : shards[0]->properties) {
+      if (std::find (shard_keys.begin(), shard_keys.end(), entry.first) != shard_keys.end())
+        continue;
+      const auto it = shards[i]->properties.find (entry.first);
+      if (it == shards[i]->properties.end() || it->second != entry.second)
+        WARN ("header entry \"" + entry.first + "\" differs between shards 1 and " + str(i+1));
+    }
+  }
+
+  // header of the first shard is used as the basis for the output header
+  Properties& properties (shards[0]->properties);
+  properties.erase ("shard");
+  // each shard is generated using its own seed, none of which applies to the merged output
+  properties.erase ("rng_seed");
+  uint64_t max_num_tracks = 0, max_num_attempts = 0;
+  for (auto& shard : shards) {
+    max_num_tracks += to<uint64_t> (shard->properties["max_num_tracks"]);
+    if (shard->properties["max_num_attempts"].size())
+      max_num_attempts += to<uint64_t> (shard->properties["max_num_attempts"]);
+  }
+  properties["max_num_tracks"] = str (max_num_tracks);
+  if (max_num_attempts)
+    properties["max_num_attempts"] = str (max_num_attempts);
+
+  // data are copied verbatim, so must already use the native byte order
+  const DataType dtype = shards[0]->datatype();
+  if (dtype.is_little_endian() != DataType::from<float>().is_little_endian())
+    throw Exception ("merging of track files is only supported for files using the native byte order");
+  if (dtype.bytes() == 4)
+    merge<float> (shards, properties);
+  else
+    merge<double> (shards, properties);
+
+  if (weights_out.size())
+    merge_weights (shards, weights_in, weights_out[0][0]);
+}
+
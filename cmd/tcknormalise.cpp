@@ -106,6 +106,8 @@ class Writer
       return true;
     }
 
+    void finalise () { writer.finalise(); }
+
   protected:
     ProgressBar progress;
     Tractography::Properties properties;
@@ -131,5 +133,6 @@ void run ()
       Thread::multi (warper), 
       Thread::batch (TrackType(), 1024), 
       writer);
+  writer.finalise();
 }
 
@@ -111,6 +111,7 @@ void run ()
     ++count;
     progress.update (progress_message);
   }
+  writer.finalise();
   progress.set_text (progress_message());
 
 }
@@ -21,6 +21,7 @@
 #include "dwi/tractography/file.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/scalar_file.h"
+#include "dwi/tractography/mapping/loader.h"
 #include "dwi/tractography/mapping/mapper.h"
 #include "file/ofstream.h"
 #include "file/path.h"
@@ -390,7 +391,8 @@ void run ()
     DWI::Tractography::Mapping::TrackMapperBase mapper (H);
     mapper.set_use_precise_mapping (precise);
     tdi.reset (new TDI (H, num_tracks));
-    Thread::run_queue (tdi_reader,
+    DWI::Tractography::Mapping::ParallelTrackLoader loader (tdi_reader, num_tracks, "");
+    Thread::run_queue (Thread::multi (loader),
                        Thread::batch (DWI::Tractography::Streamline<value_type>()),
                        Thread::multi (mapper),
                        Thread::batch (DWI::Tractography::Mapping::SetVoxel()),
@@ -410,7 +412,8 @@ void run ()
     }
   } else {
     Receiver_Statistic receiver (num_tracks);
-    Thread::run_queue (reader,
+    DWI::Tractography::Mapping::ParallelTrackLoader loader (reader, num_tracks, "");
+    Thread::run_queue (Thread::multi (loader),
                        Thread::batch (DWI::Tractography::Streamline<value_type>()),
                        Thread::multi (sampler),
                        Thread::batch (std::pair<size_t, value_type>()),
@@ -76,6 +76,10 @@ void usage ()
   + Option ("out_selection", "output a text file containing the binary selection of streamlines")
     + Argument ("path").type_file_out()
 
+  + Option ("incremental", "update the gradient of each streamline incrementally between iterations, based on the fixels from which "
+                           "streamlines were removed, rather than recalculating it in full; this greatly reduces the time required "
+                           "to filter large tractograms, at the expense of additional memory (approximately 8 bytes per streamline-fixel visitation)")
+
   + SIFTTermOption;
 
 }
@@ -125,6 +129,7 @@ void run ()
     opt = get_options ("csv");
     if (opt.size())
       sifter.set_csv_path (opt[0][0]);
+    sifter.set_incremental (get_options ("incremental").size());
     opt = get_options ("output_at_counts");
     if (opt.size()) {
       std::vector<int> counts = parse_ints (opt[0][0]);
@@ -100,6 +100,12 @@ const OptionGroup SIFT2AlgorithmOption = OptionGroup ("Options for controlling t
 
   + Option ("min_cf_decrease", "minimum decrease in the cost function (as a fraction of the initial value) that must occur each iteration for the algorithm to continue "
                                "(default: " + str(SIFT2_MIN_CF_DECREASE_DEFAULT, 2) + ")")
+    + Argument ("frac").type_float (0.0, 1.0)
+
+  + Option ("subset_frac", "first estimate the weighting coefficients using only a random subset of this fraction of the streamlines; "
+                           "the coefficients of the remaining streamlines are then initialised from the mean coefficients of the fixels "
+                           "they traverse, before optimising all streamlines. This can reduce the number of iterations required "
+                           "for large tractograms.")
     + Argument ("frac").type_float (0.0, 1.0);
 
 
@@ -130,9 +136,19 @@ void usage ()
   + SIFT::SIFTModelOption
   + SIFT::SIFTOutputOption
 
+  + Option ("in_coeffs", "text file containing the initial weighting coefficient for each streamline "
+                         "(as provided by the -out_coeffs option), rather than initialising all coefficients to zero; "
+                         "this can reduce the number of iterations required when re-running SIFT2 with similar data or parameters "
+                         "(cannot be combined with the -subset_frac option)")
+    + Argument ("path").type_file_in()
+
   + Option ("out_coeffs", "output text file containing the weighting coefficient for each streamline")
     + Argument ("path").type_file_out()
 
+  + Option ("out_of_core", "store the fixel contributions of each streamline in a temporary file rather than in RAM, "
+                           "for tractograms that are too large to be processed in memory; "
+                           "the file is created in the directory set by the TmpFileDir configuration file entry (default: /tmp)")
+
   + SIFT2RegularisationOption
   + SIFT2AlgorithmOption;
 
@@ -148,8 +164,11 @@ void run ()
     throw Exception ("Options -min_factor and -min_coeff are mutually exclusive");
   if (get_options("max_factor").size() && get_options("max_coeff").size())
     throw Exception ("Options -max_factor and -max_coeff are mutually exclusive");
+  // the subset estimate would overwrite the initial coefficients of all other streamlines
+  if (get_options("in_coeffs").size() && get_options("subset_frac").size())
+    throw Exception ("Options -in_coeffs and -subset_frac are mutually exclusive");
 
-  if (Path::has_suffix (argument[2], ".tck"))
+  if (Path::has_suffix (argument[2], { ".tck", ".tckq" }))
     throw Exception ("Output of tcksift2 command should be a text file, not a tracks file");
 
   auto in_dwi = Image<float>::open (argument[1]);
@@ -166,6 +185,8 @@ void run ()
   tckfactor.perform_FOD_segmentation (in_dwi);
   tckfactor.scale_FDs_by_GM();
 
+  if (get_options ("out_of_core").size())
+    tckfactor.set_out_of_core();
   tckfactor.map_streamlines (argument[0]);
 
   tckfactor.store_orig_TDs();
@@ -208,6 +229,13 @@ void run ()
   opt = get_options ("min_cf_decrease");
   if (opt.size())
     tckfactor.set_min_cf_decrease (float(opt[0][0]));
+  opt = get_options ("subset_frac");
+  if (opt.size())
+    tckfactor.set_subset_fraction (float(opt[0][0]));
+
+  opt = get_options ("in_coeffs");
+  if (opt.size())
+    tckfactor.load_coefficients (opt[0][0]);
 
   tckfactor.estimate_factors();
 
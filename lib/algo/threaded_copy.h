@@ -31,6 +31,107 @@ namespace MR
         }
     };
 
+
+
+    // copy whole rows along the innermost axis in one go, using the block
+    // get_values() / set_values() methods of the Image class. For images
+    // using indirect IO, this converts each row from / to its on-disk
+    // representation in a single call, rather than once per voxel:
+    template <class InputImageType, class OutputImageType>
+      struct __copy_row_func {
+        typedef typename InputImageType::value_type in_type;
+        typedef typename OutputImageType::value_type out_type;
+
+        __copy_row_func (const std::vector<size_t>& outer_axes, const std::vector<size_t>& inner_axes, 
+            const InputImageType& source, const OutputImageType& destination) :
+          outer_axes (outer_axes),
+          row_axis (inner_axes[0]),
+          other_axes (inner_axes.begin()+1, inner_axes.end()),
+          loop (Loop (other_axes)),
+          in (source),
+          out (destination) { }
+
+        void operator() (const Iterator& pos) {
+          assign_pos_of (pos, outer_axes).to (in, out);
+          if (other_axes.empty()) {
+            copy_row();
+            return;
+          }
+          for (auto i = loop (in, out); i; ++i)
+            copy_row();
+        }
+
+        const std::vector<size_t>& outer_axes;
+        const size_t row_axis;
+        const std::vector<size_t> other_axes;
+        const decltype (Loop (other_axes)) loop;
+        InputImageType in;
+        OutputImageType out;
+        std::vector<in_type> in_row;
+        std::vector<out_type> out_row;
+
+        FORCE_INLINE void copy_row () {
+          const size_t n = in.size (row_axis);
+          in.index (row_axis) = 0;
+          out.index (row_axis) = 0;
+          in_row.resize (n);
+          in.get_values (row_axis, in_row.data(), n);
+          write_row (n);
+        }
+
+        template <typename T = out_type>
+          FORCE_INLINE typename std::enable_if<std::is_same<T,in_type>::value>::type write_row (size_t n) {
+            out.set_values (row_axis, in_row.data(), n);
+          }
+
+        template <typename T = out_type>
+          FORCE_INLINE typename std::enable_if<!std::is_same<T,in_type>::value>::type write_row (size_t n) {
+            out_row.resize (n);
+            for (size_t k = 0; k < n; ++k)
+              out_row[k] = in_row[k];
+            out.set_values (row_axis, out_row.data(), n);
+          }
+      };
+
+
+
+    // true if ImageType provides the get_values() / set_values() block
+    // access methods (bit-packed images are excluded, since these can't be
+    // held in a plain array):
+    template <class ImageType>
+      struct __has_block_access {
+        template <class T> 
+          static auto test (int) -> decltype (
+              std::declval<const T&>().get_values (size_t(0), (typename T::value_type*) nullptr, size_t(0)),
+              std::declval<T&>().set_values (size_t(0), (const typename T::value_type*) nullptr, size_t(0)),
+              std::true_type());
+        template <class T> 
+          static std::false_type test (...);
+        static const bool value = decltype (test<ImageType> (0))::value && !std::is_same<typename ImageType::value_type, bool>::value;
+      };
+
+
+
+    // use row-wise copy if both images support block access, otherwise
+    // fall back to voxel-wise copy:
+    template <class LoopType, class InputImageType, class OutputImageType>
+      FORCE_INLINE typename std::enable_if<!(__has_block_access<InputImageType>::value && __has_block_access<OutputImageType>::value), void>::type 
+      __threaded_copy (LoopType&& loop, InputImageType& source, OutputImageType& destination) 
+      {
+        loop.run (__copy_func(), source, destination);
+      }
+
+    template <class LoopType, class InputImageType, class OutputImageType>
+      FORCE_INLINE typename std::enable_if<__has_block_access<InputImageType>::value && __has_block_access<OutputImageType>::value, void>::type 
+      __threaded_copy (LoopType&& loop, InputImageType& source, OutputImageType& destination) 
+      {
+        if (loop.inner_axes.empty()) {
+          loop.run (__copy_func(), source, destination);
+          return;
+        }
+        loop.run_outer (__copy_row_func<InputImageType,OutputImageType> (loop.outer_loop.axes, loop.inner_axes, source, destination));
+      }
+
   }
 
   //! \endcond
@@ -45,8 +146,7 @@ namespace MR
         const std::vector<size_t>& axes,
         size_t num_axes_in_thread = 1) 
     {
-      ThreadedLoop (source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (source, axes, num_axes_in_thread), source, destination);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -57,8 +157,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(),
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread), source, destination);
     }
 
 
@@ -72,8 +171,7 @@ namespace MR
         const std::vector<size_t>& axes,
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (message, source, axes, num_axes_in_thread), source, destination);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -85,8 +183,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(), 
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread), source, destination);
     }
 
 
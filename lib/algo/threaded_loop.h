@@ -58,14 +58,19 @@ namespace MR
    * been set to the z and volume axes (i.e. axes 2 & 3). Each thread will do
    * the following:
    *
-   * 1. lock the loop mutex, obtain a new set of z & volume coordinates, then
-   *    release the mutex so other threads can obtain their own unique set of
-   *    coordinates to process;
-   * 2. set the position of all `ImageType` classes to be processed according
-   *    to these coordinates;
-   * 3. iterate over the x & y axes, invoking the user-supplied functor each
-   *    time;
-   * 4. repeat from step 1 until all the data have been processed.
+   * 1. lock the loop mutex, obtain a new batch of z & volume coordinates,
+   *    then release the mutex so other threads can obtain their own unique
+   *    set of coordinates to process;
+   * 2. for each set of coordinates in the batch, set the position of all
+   *    `ImageType` classes to be processed according to these coordinates,
+   *    and iterate over the x & y axes, invoking the user-supplied functor
+   *    each time;
+   * 3. repeat from step 1 until all the data have been processed.
+   *
+   * The size of each batch is proportional to the number of positions still
+   * to be processed, so that batches are large (minimising contention for
+   * the mutex) at the start of the loop, and small towards the end (allowing
+   * threads that were given less work to pick up the slack).
    *
    *
    * \section threaded_loop_constructor Instantiating a ThreadedLoop() object
@@ -321,28 +326,50 @@ namespace MR
 
             std::mutex mutex;
 
+            size_t num_positions = 1;
+            for (auto axis : outer_loop.axes)
+              num_positions *= iterator.size (axis);
+
+            // positions are handed out in batches, to reduce contention on
+            // the mutex when the work per position is small. The batch size
+            // is proportional to the number of positions remaining
+            // (guided scheduling), so that batches become smaller towards
+            // the end of the loop, allowing the threads to even out any
+            // imbalance in the work per position:
             struct Shared {
               Iterator& iterator;
               decltype (outer_loop (iterator)) loop;
               std::mutex& mutex;
-              FORCE_INLINE bool next (Iterator& pos) {
+              size_t remaining;
+              const size_t divisor;
+              FORCE_INLINE size_t next (std::vector<ssize_t>& batch) {
                 std::lock_guard<std::mutex> lock (mutex);
-                if (loop) {
-                  assign_pos_of (iterator, loop.axes).to (pos);
-                  ++loop;
-                  return true;
-                }
-                else return false;
+                const size_t batch_size = std::max (remaining / divisor, size_t(1));
+                batch.clear();
+                size_t n = 0;
+                for (; n < batch_size && loop; ++n, ++loop)
+                  for (auto axis : loop.axes)
+                    batch.push_back (iterator.index (axis));
+                remaining -= std::min (remaining, n);
+                return n;
               }
-            } shared = { iterator, outer_loop (iterator), mutex };
+            } shared = { iterator, outer_loop (iterator), mutex, num_positions, 4 * Thread::number_of_threads() };
 
             struct {
               Shared& shared;
               typename std::remove_reference<Functor>::type func;
               void execute () {
                 Iterator pos = shared.iterator;
-                while (shared.next (pos))
-                  func (pos);
+                std::vector<ssize_t> batch;
+                const auto& axes (shared.loop.axes);
+                while (size_t n = shared.next (batch)) {
+                  auto index = batch.cbegin();
+                  for (size_t i = 0; i < n; ++i) {
+                    for (auto axis : axes)
+                      pos.index (axis) = *index++;
+                    func (pos);
+                  }
+                }
               }
             } loop_thread = { shared, functor };
 
@@ -996,10 +996,10 @@ namespace MR
           throw Exception ("required input file \"" + str(i) + "\" not found");
         if (i.arg->type == ArgFileOut || i.arg->type == TracksOut)
           check_overwrite (std::string(i));
-        if (i.arg->type == TracksIn && !Path::has_suffix (str(i), ".tck"))
+        if (i.arg->type == TracksIn && !Path::has_suffix (str(i), { ".tck", ".tckq" }))
           throw Exception ("input file " + str(i) + " is not a valid track file");
-        if (i.arg->type == TracksOut && !Path::has_suffix (str(i), ".tck"))
-          throw Exception ("output track file (" + str(i) + ") must use the .tck suffix");
+        if (i.arg->type == TracksOut && !Path::has_suffix (str(i), { ".tck", ".tckq" }))
+          throw Exception ("output track file (" + str(i) + ") must use the .tck or .tckq suffix");
       }
       for (const auto& i : option) {
         for (size_t j = 0; j != i.opt->size(); ++j) {
@@ -1009,10 +1009,10 @@ namespace MR
             throw Exception ("input file \"" + str(name) + "\" not found (required for option \"-" + std::string(i.opt->id) + "\")");
           if (arg.type == ArgFileOut || arg.type == TracksOut)
             check_overwrite (name);
-          if (arg.type == TracksIn && !Path::has_suffix (str(name), ".tck"))
+          if (arg.type == TracksIn && !Path::has_suffix (str(name), { ".tck", ".tckq" }))
             throw Exception ("input file " + str(name) + " is not a valid track file");
-          if (arg.type == TracksOut && !Path::has_suffix (str(name), ".tck"))
-            throw Exception ("output track file (" + str(name) + ") must use the .tck suffix");
+          if (arg.type == TracksOut && !Path::has_suffix (str(name), { ".tck", ".tckq" }))
+            throw Exception ("output track file (" + str(name) + ") must use the .tck or .tckq suffix");
         }
       }
 
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include <atomic>
+#include <zlib.h>
+
+#include "progressbar.h"
+#include "thread.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/gz_blocks.h"
+
+// size of the gzip member header: fixed header (10 bytes), XLEN (2 bytes),
+// and our extra subfield (4 + 8 bytes):
+#define GZBLOCK_HEADER_SIZE 24
+// size of the gzip member trailer (CRC32 & ISIZE):
+#define GZBLOCK_TRAILER_SIZE 8
+
+namespace MR
+{
+  namespace File
+  {
+
+    namespace
+    {
+
+      inline uint32_t get_uint32 (const uint8_t* p)
+      {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+      }
+
+      inline void put_uint32 (uint32_t v, uint8_t* p)
+      {
+        p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+      }
+
+
+
+      std::vector<uint8_t> compress_block (const uint8_t* data, size_t size)
+      {
+        z_stream strm;
+        memset (&strm, 0, sizeof (strm));
+        if (deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+          throw Exception ("error initialising zlib compression");
+
+        std::vector<uint8_t> out (GZBLOCK_HEADER_SIZE + deflateBound (&strm, size) + GZBLOCK_TRAILER_SIZE);
+        strm.next_in = const_cast<Bytef*> (data);
+        strm.avail_in = size;
+        strm.next_out = out.data() + GZBLOCK_HEADER_SIZE;
+        strm.avail_out = out.size() - GZBLOCK_HEADER_SIZE - GZBLOCK_TRAILER_SIZE;
+        const int status = deflate (&strm, Z_FINISH);
+        const size_t compressed_size = strm.total_out;
+        deflateEnd (&strm);
+        if (status != Z_STREAM_END)
+          throw Exception ("error compressing data: " + std::string (strm.msg ? strm.msg : "unknown zlib error"));
+
+        const size_t member_size = GZBLOCK_HEADER_SIZE + compressed_size + GZBLOCK_TRAILER_SIZE;
+        uint8_t* h = out.data();
+        h[0] = 0x1F; h[1] = 0x8B;     // gzip magic number
+        h[2] = 8;                     // deflate
+        h[3] = 4;                     // FLG: FEXTRA
+        put_uint32 (0, h+4);          // MTIME
+        h[8] = 0;                     // XFL
+        h[9] = 255;                   // OS: unknown
+        h[10] = 12; h[11] = 0;        // XLEN
+        h[12] = 'M'; h[13] = 'R';     // subfield ID
+        h[14] = 8; h[15] = 0;         // subfield length
+        put_uint32 (member_size, h+16);
+        put_uint32 (size, h+20);
+
+        uint8_t* t = out.data() + GZBLOCK_HEADER_SIZE + compressed_size;
+        put_uint32 (crc32 (crc32 (0L, Z_NULL, 0), data, size), t);
+        put_uint32 (size, t+4);
+
+        out.resize (member_size);
+        return out;
+      }
+
+
+
+      // run functor in parallel if multi-threading is enabled:
+      template <class Functor>
+        inline void run_blocks (Functor& functor, const std::string& name)
+        {
+          if (Thread::number_of_threads() == 0)
+            functor.execute();
+          else
+            Thread::run (Thread::multi (functor), name).wait();
+        }
+
+    }
+
+
+
+
+
+    //CONF option: GZBlockSize
+    //CONF default: 1048576
+    //CONF The amount of data (in bytes) held in each independently
+    //CONF compressed block when writing compressed images (e.g.
+    //CONF .nii.gz, .mif.gz). Larger blocks compress slightly better,
+    //CONF smaller blocks allow finer-grained parallelism and random
+    //CONF access.
+
+    size_t GZBlocks::block_size ()
+    {
+      static const size_t size = File::Config::get_int ("GZBlockSize", 1048576);
+      if (size < 1024 || size > (1U<<30))
+        throw Exception ("invalid value for config file entry \"GZBlockSize\"");
+      return size;
+    }
+
+
+
+
+    GZBlocks::GZBlocks (const std::string& filename) :
+      filename (filename)
+    {
+      mmap.reset (new MMap (Entry (filename)));
+      const uint8_t* const data = mmap->address();
+      const int64_t file_size = mmap->size();
+
+      int64_t offset = 0, start = 0;
+      while (offset < file_size) {
+        const uint8_t* h = data + offset;
+        if (file_size - offset < GZBLOCK_HEADER_SIZE + GZBLOCK_TRAILER_SIZE ||
+            h[0] != 0x1F || h[1] != 0x8B || h[2] != 8 || h[3] != 4 ||
+            h[10] != 12 || h[11] != 0 || h[12] != 'M' || h[13] != 'R' || h[14] != 8 || h[15] != 0) {
+          // not written as independently compressed blocks:
+          index.clear();
+          break;
+        }
+        Block block;
+        block.offset = offset;
+        block.compressed_size = get_uint32 (h+16);
+        block.start = start;
+        block.size = get_uint32 (h+20);
+        if (block.compressed_size < GZBLOCK_HEADER_SIZE + GZBLOCK_TRAILER_SIZE || offset + block.compressed_size > file_size)
+          throw Exception ("invalid block size in compressed file \"" + filename + "\" - file may be corrupt");
+        index.push_back (block);
+        offset += block.compressed_size;
+        start += block.size;
+      }
+
+      if (index.empty()) {
+        mmap.reset();
+        return;
+      }
+      DEBUG ("compressed file \"" + filename + "\" contains " + str(index.size()) + " independently compressed blocks");
+    }
+
+
+
+
+
+    void GZBlocks::read_block (size_t n, uint8_t* dest) const
+    {
+      assert (n < index.size());
+      const Block& block (index[n]);
+
+      z_stream strm;
+      memset (&strm, 0, sizeof (strm));
+      if (inflateInit2 (&strm, -15) != Z_OK)
+        throw Exception ("error initialising zlib decompression");
+      strm.next_in = const_cast<Bytef*> (mmap->address() + block.offset + GZBLOCK_HEADER_SIZE);
+      strm.avail_in = block.compressed_size - GZBLOCK_HEADER_SIZE - GZBLOCK_TRAILER_SIZE;
+      strm.next_out = dest;
+      strm.avail_out = block.size;
+      const int status = inflate (&strm, Z_FINISH);
+      const size_t size = strm.total_out;
+      inflateEnd (&strm);
+
+      const uint8_t* t = mmap->address() + block.offset + block.compressed_size - GZBLOCK_TRAILER_SIZE;
+      if (status != Z_STREAM_END || size != size_t (block.size) || get_uint32 (t+4) != uint32_t (block.size) ||
+          get_uint32 (t) != crc32 (crc32 (0L, Z_NULL, 0), dest, block.size))
+        throw Exception ("error decompressing block " + str(n) + " of file \"" + filename + "\" - file may be corrupt");
+    }
+
+
+
+
+
+    void GZBlocks::read (uint8_t* dest, int64_t start, int64_t size, const std::string& progress_message) const
+    {
+      assert (valid());
+      if (index.back().start + index.back().size < start + size)
+        throw Exception ("compressed file \"" + filename + "\" is smaller than expected");
+
+      // find blocks that overlap the requested range:
+      size_t first = 0;
+      while (index[first].start + index[first].size <= start)
+        ++first;
+      size_t last = first;
+      while (last < index.size() && index[last].start < start + size)
+        ++last;
+
+      ProgressBar progress (progress_message, last - first);
+      std::mutex mutex;
+      std::atomic<size_t> next (first);
+
+      struct Decompressor {
+        const GZBlocks& gz;
+        uint8_t* dest;
+        const int64_t start, size;
+        const size_t last;
+        std::atomic<size_t>& next;
+        ProgressBar& progress;
+        std::mutex& mutex;
+
+        void execute () {
+          std::vector<uint8_t> buffer;
+          size_t n;
+          while ((n = next++) < last) {
+            const Block& block (gz.index[n]);
+            if (block.start >= start && block.start + block.size <= start + size) {
+              gz.read_block (n, dest + (block.start - start));
+            }
+            else {
+              // block only partially overlaps requested range:
+              buffer.resize (block.size);
+              gz.read_block (n, buffer.data());
+              const int64_t from = std::max (block.start, start);
+              const int64_t to = std::min (block.start + block.size, start + size);
+              memcpy (dest + (from - start), buffer.data() + (from - block.start), to - from);
+            }
+            std::lock_guard<std::mutex> lock (mutex);
+            ++progress;
+          }
+        }
+      } decompressor = { *this, dest, start, size, last, next, progress, mutex };
+
+      run_blocks (decompressor, "gzip decompression");
+    }
+
+
+
+
+
+    void GZBlocks::write (const std::string& filename,
+        const uint8_t* lead_in, size_t lead_in_size,
+        const uint8_t* data, size_t data_size,
+        const std::string& progress_message)
+    {
+      const size_t bsize = block_size();
+
+      std::vector<std::pair<const uint8_t*,size_t>> jobs;
+      if (lead_in_size)
+        jobs.push_back ({ lead_in, lead_in_size });
+      for (size_t offset = 0; offset < data_size; offset += bsize)
+        jobs.push_back ({ data + offset, std::min (bsize, data_size - offset) });
+
+      ProgressBar progress (progress_message, jobs.size());
+      File::OFStream out (filename, std::ios::out | std::ios::binary);
+
+      // compress in batches, so that compressed blocks can be written out in
+      // order without holding the whole compressed file in RAM:
+      const size_t batch_size = 4 * std::max (Thread::number_of_threads(), size_t(1));
+      std::vector<std::vector<uint8_t>> compressed (batch_size);
+
+      struct Compressor {
+        const std::vector<std::pair<const uint8_t*,size_t>>& jobs;
+        std::vector<std::vector<uint8_t>>& compressed;
+        const size_t first, last;
+        std::atomic<size_t>& next;
+
+        void execute () {
+          size_t n;
+          while ((n = next++) < last)
+            compressed[n-first] = compress_block (jobs[n].first, jobs[n].second);
+        }
+      };
+
+      for (size_t first = 0; first < jobs.size(); first += batch_size) {
+        const size_t last = std::min (first + batch_size, jobs.size());
+        std::atomic<size_t> next (first);
+        Compressor compressor = { jobs, compressed, first, last, next };
+        run_blocks (compressor, "gzip compression");
+
+        for (size_t n = 0; n < last-first; ++n) {
+          out.write (reinterpret_cast<const char*> (compressed[n].data()), compressed[n].size());
+          if (!out.good())
+            throw Exception ("error writing to file \"" + filename + "\": " + strerror (errno));
+          ++progress;
+        }
+      }
+    }
+
+  }
+}
+
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#ifndef __file_gz_blocks_h__
+#define __file_gz_blocks_h__
+
+#include <vector>
+
+#include "memory.h"
+#include "types.h"
+#include "file/mmap.h"
+
+namespace MR
+{
+  namespace File
+  {
+
+    //! read & write gzip files as a series of independently compressed blocks
+    /*! Each block is stored as a complete gzip member, so the file remains a
+     * valid gzip stream that can be decompressed by any standard tool (and by
+     * the File::GZ class). The header of each member includes an extra field
+     * (subfield ID "MR") recording the compressed size of the member and the
+     * size of the data it holds, so that the block boundaries can be located
+     * without decompressing anything. This allows both compression and
+     * decompression to be distributed over multiple threads.
+     *
+     * Files that were not written in this way (e.g. by other software) will
+     * report valid() as false, and should be read using File::GZ. */
+    class GZBlocks
+    {
+      public:
+        class Block {
+          public:
+            //! offset & size of the gzip member in the compressed file
+            int64_t offset, compressed_size;
+            //! offset & size of the data held, in the uncompressed stream
+            int64_t start, size;
+        };
+
+        //! open \a filename and read its block index
+        GZBlocks (const std::string& filename);
+
+        //! true if the file was written as independently compressed blocks
+        bool valid () const { return index.size(); }
+
+        const std::vector<Block>& blocks () const { return index; }
+
+        //! decompress \a size bytes starting at \a start in the uncompressed stream into \a dest
+        /*! blocks are decompressed concurrently using Thread::number_of_threads() threads. */
+        void read (uint8_t* dest, int64_t start, int64_t size, const std::string& progress_message) const;
+
+        //! decompress a single block into \a dest, which must be large enough to hold Block::size bytes
+        void read_block (size_t n, uint8_t* dest) const;
+
+        //! write \a lead_in followed by \a data to \a filename as independently compressed blocks
+        /*! the lead-in (typically the image header) is stored as its own
+         * block, so that the data start on a block boundary. Blocks are
+         * compressed concurrently using Thread::number_of_threads() threads,
+         * and written out in order. */
+        static void write (const std::string& filename,
+            const uint8_t* lead_in, size_t lead_in_size,
+            const uint8_t* data, size_t data_size,
+            const std::string& progress_message);
+
+        //! the amount of (uncompressed) data held in each block when writing
+        static size_t block_size ();
+
+      protected:
+        std::string filename;
+        std::unique_ptr<MMap> mmap;
+        std::vector<Block> index;
+    };
+
+  }
+}
+
+#endif
+
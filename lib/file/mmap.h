@@ -20,6 +20,7 @@
 #include <cassert>
 #include <stdint.h>
 
+#include "memory.h"
 #include "types.h"
 #include "file/entry.h"
 
@@ -51,6 +52,11 @@ namespace MR
          * By default, the whole file is mapped. If \a mapped_size is
          * non-zero, then only the region of size \a mapped_size starting from
          * the byte offset specified in \a entry will be mapped. 
+         *
+         * If the MMapAsyncIO configuration option is set, a background
+         * thread will read ahead the contents of read-only mappings (if
+         * \a preload is set), and periodically initiate write-out of
+         * modified pages for all read-write mappings (see MMap::Async).
          */
         MMap (const Entry& entry, bool readwrite = false, bool preload = true, int64_t mapped_size = -1);
         ~MMap () noexcept (false);
@@ -81,19 +87,20 @@ namespace MR
         }
 
       protected:
+        class Async;
+
         int       fd;
         uint8_t*  addr;        /**< The address in memory where the file has been mapped. */
         uint8_t*  first;       /**< The address in memory to the start of the region of interest. */
         int64_t   msize;       /**< The size of the file. */
         time_t    mtime;       /**< The modification time of the file at the last check. */
         bool      readwrite;
+        std::unique_ptr<Async> async;
 
         void map ();
 
       private:
-        MMap (const MMap& mmap) : Entry (mmap), fd (0), addr (NULL), first (NULL), msize (0), mtime (0), readwrite (false) {
-          assert (0);
-        }
+        MMap (const MMap& mmap) = delete;
     };
 
 
@@ -28,6 +28,7 @@ namespace MR
     Pipe          pipe_handler;
     MRtrix        mrtrix_handler;
     MRtrix_GZ     mrtrix_gz_handler;
+    MRtrix_chunked mrtrix_chunked_handler;
     MRI           mri_handler;
     NIfTI         nifti_handler;
     NIfTI_GZ      nifti_gz_handler;
@@ -47,6 +48,7 @@ namespace MR
       &dicom_handler,
       &mrtrix_handler,
       &mrtrix_gz_handler,
+      &mrtrix_chunked_handler,
       &nifti_handler,
       &nifti_gz_handler,
       &analyse_handler,
@@ -64,6 +66,7 @@ namespace MR
       ".mih",
       ".mif",
       ".mif.gz",
+      ".mifc",
       ".img",
       ".nii",
       ".nii.gz",
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include "header.h"
+#include "image_io/chunked.h"
+#include "formats/list.h"
+#include "formats/mrtrix_utils.h"
+#include "file/utils.h"
+#include "file/path.h"
+#include "file/key_value.h"
+
+namespace MR
+{
+  namespace Formats
+  {
+
+    // extension is:
+    // mifc: MRtrix Image File, Chunked
+
+    namespace
+    {
+      std::string get_and_erase (Header& H, const std::string& key)
+      {
+        auto it = H.keyval().find (key);
+        if (it == H.keyval().end())
+          throw Exception ("missing \"" + key + "\" specification for chunked MRtrix image \"" + H.name() + "\"");
+        const std::string value = it->second;
+        H.keyval().erase (it);
+        return value;
+      }
+
+      // the full file header, padded with zeros up to the start of the data:
+      std::string file_header (const Header& H, size_t chunk_size)
+      {
+        std::stringstream header;
+        header << "mrtrix chunked image\n";
+        write_mrtrix_header (H, header);
+        header << "chunk_size: " << chunk_size << "\nchunk_compression: deflate\n";
+
+        int64_t offset = header.tellp() + int64_t(24);
+        offset += ((8 - (offset % 8)) % 8);
+        header << "file: . " << offset << "\nEND\n";
+        while (header.tellp() < offset)
+          header << '\0';
+        return header.str();
+      }
+    }
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_chunked::read (Header& H) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifc"))
+        return std::unique_ptr<ImageIO::Base>();
+
+      File::KeyValue kv (H.name(), "mrtrix chunked image");
+
+      read_mrtrix_header (H, kv);
+
+      const size_t chunk_size = to<size_t> (get_and_erase (H, "chunk_size"));
+      if (chunk_size < 8 || chunk_size % 8)
+        throw Exception ("invalid chunk size specified for chunked MRtrix image \"" + H.name() + "\"");
+      const std::string compression = get_and_erase (H, "chunk_compression");
+      if (compression != "deflate")
+        throw Exception ("unsupported chunk compression \"" + compression + "\" for chunked MRtrix image \"" + H.name() + "\"");
+
+      std::string fname;
+      size_t offset;
+      get_mrtrix_file_path (H, "file", fname, offset);
+      if (fname != H.name())
+        throw Exception ("chunked MRtrix format images must have image data within the same file as the header");
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Chunked (H, file_header (H, chunk_size), chunk_size));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return io_handler;
+    }
+
+
+
+
+
+    bool MRtrix_chunked::check (Header& H, size_t num_axes) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifc"))
+        return false;
+
+      H.ndim() = num_axes;
+      for (size_t i = 0; i < H.ndim(); i++)
+        if (H.size (i) < 1)
+          H.size(i) = 1;
+
+      return true;
+    }
+
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_chunked::create (Header& H) const
+    {
+      const size_t chunk_size = ImageIO::Chunked::default_chunk_size (H.datatype());
+      const std::string header = file_header (H, chunk_size);
+
+      File::create (H.name());
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Chunked (H, header, chunk_size));
+      io_handler->files.push_back (File::Entry (H.name(), header.size()));
+
+      return io_handler;
+    }
+
+  }
+}
+
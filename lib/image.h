@@ -94,6 +94,33 @@ namespace MR
           else buffer->set_value (data_offset, val);
         }
 
+        //! read \a n consecutive values along \a axis, starting at the current position
+        /*! the values are converted from the on-disk datatype in a single
+         * call, avoiding the per-voxel function call overhead of value()
+         * for images using indirect IO. The current position is left
+         * unchanged. */
+        FORCE_INLINE void get_values (size_t axis, ValueType* values, size_t n) const {
+          assert (index (axis) + ssize_t(n) <= size (axis));
+          if (data_pointer) {
+            for (size_t k = 0; k < n; ++k) 
+              values[k] = Raw::fetch_native<ValueType> (data_pointer, data_offset + k*stride (axis));
+          }
+          else 
+            buffer->get_values (data_offset, stride (axis), n, values);
+        }
+
+        //! write \a n consecutive values along \a axis, starting at the current position
+        /*! \sa get_values() */
+        FORCE_INLINE void set_values (size_t axis, const ValueType* values, size_t n) {
+          assert (index (axis) + ssize_t(n) <= size (axis));
+          if (data_pointer) {
+            for (size_t k = 0; k < n; ++k) 
+              Raw::store_native<ValueType> (values[k], data_pointer, data_offset + k*stride (axis));
+          }
+          else 
+            buffer->set_values (data_offset, stride (axis), n, values);
+        }
+
         //! get set/set a row of values at the current index position along the specified axis
         FORCE_INLINE Eigen::Map<Eigen::Matrix<value_type, Eigen::Dynamic, 1 >, Eigen::Unaligned, Eigen::InnerStride<> > row (size_t axis)
         {
@@ -230,17 +257,50 @@ namespace MR
         Buffer& operator= (const Buffer&) = delete;
         Buffer& operator= (Buffer&&) = default;
         Buffer (const Buffer& b) : 
-          Header (b), fetch_func (b.fetch_func), store_func (b.store_func) { }
+          Header (b), functions (b.functions), direct_segment (nullptr) { }
+        ~Buffer () {
+          if (direct_segment && io)
+            io->release_segment (0);
+        }
 
 
         FORCE_INLINE ValueType get_value (size_t offset) const {
           ssize_t nseg = offset / io->segment_size();
-          return fetch_func (io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
+          const ValueType val = functions.fetch (io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
+          io->release_segment (nseg);
+          return val;
         }
 
         FORCE_INLINE void set_value (size_t offset, ValueType val) const {
           ssize_t nseg = offset / io->segment_size();
-          store_func (val, io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
+          functions.store (val, io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
+          io->release_segment (nseg);
+        }
+
+        //! read \a n values at offsets \a offset, \a offset + \a stride, ... into \a values
+        FORCE_INLINE void get_values (size_t offset, ssize_t stride, size_t n, ValueType* values) const {
+          while (n) {
+            size_t nseg, pos, count;
+            split_run (offset, stride, n, nseg, pos, count);
+            functions.fetch_block (values, io->segment (nseg), pos, count, stride, intensity_offset(), intensity_scale());
+            io->release_segment (nseg);
+            values += count;
+            offset += count * stride;
+            n -= count;
+          }
+        }
+
+        //! write \a n values from \a values to offsets \a offset, \a offset + \a stride, ...
+        FORCE_INLINE void set_values (size_t offset, ssize_t stride, size_t n, const ValueType* values) const {
+          while (n) {
+            size_t nseg, pos, count;
+            split_run (offset, stride, n, nseg, pos, count);
+            functions.store_block (values, io->segment (nseg), pos, count, stride, intensity_offset(), intensity_scale());
+            io->release_segment (nseg);
+            values += count;
+            offset += count * stride;
+            n -= count;
+          }
         }
 
         std::unique_ptr<uint8_t[]> data_buffer;
@@ -249,11 +309,29 @@ namespace MR
         FORCE_INLINE ImageIO::Base* get_io () const { return io.get(); }
 
       protected:
-        std::function<ValueType(const void*,size_t,default_type,default_type)> fetch_func;
-        std::function<void(ValueType,void*,size_t,default_type,default_type)> store_func;
+        FetchStoreFunctions<ValueType> functions;
+        // address of the single segment used for direct IO: this is pinned
+        // (see ImageIO::Base::segment()) the first time it is requested,
+        // and remains pinned for the lifetime of the buffer
+        uint8_t* direct_segment;
 
         void set_fetch_store_functions () {
-          __set_fetch_store_functions (fetch_func, store_func, datatype());
+          __set_fetch_store_functions (functions, datatype());
+        }
+
+        // find the segment holding \a offset, and how many of the \a n
+        // values in the run can be accessed within that segment:
+        FORCE_INLINE void split_run (size_t offset, ssize_t stride, size_t n, size_t& nseg, size_t& pos, size_t& count) const {
+          const size_t segsize = io->segment_size();
+          nseg = offset / segsize;
+          pos = offset - nseg*segsize;
+          if (stride > 0) 
+            count = (segsize - 1 - pos) / stride + 1;
+          else if (stride < 0) 
+            count = pos / (-stride) + 1;
+          else 
+            count = n;
+          count = std::min (count, n);
         }
     };
 
@@ -298,6 +376,15 @@ namespace MR
         FORCE_INLINE value_type value () const { return Raw::fetch_native<ValueType> (data, offset); } 
         FORCE_INLINE auto value () -> decltype (Helper::value (*this)) { return { *this }; }
         FORCE_INLINE void set_value (ValueType val) { Raw::store_native<ValueType> (val, data, offset); }
+
+        FORCE_INLINE void get_values (size_t axis, ValueType* values, size_t n) const {
+          for (size_t k = 0; k < n; ++k) 
+            values[k] = Raw::fetch_native<ValueType> (data, offset + k*stride (axis));
+        }
+        FORCE_INLINE void set_values (size_t axis, const ValueType* values, size_t n) {
+          for (size_t k = 0; k < n; ++k) 
+            Raw::store_native<ValueType> (values[k], data, offset + k*stride (axis));
+        }
       };
 
   }
@@ -311,7 +398,8 @@ namespace MR
 
   template <typename ValueType>
     Image<ValueType>::Buffer::Buffer (Header& H, bool read_write_if_existing) :
-      Header (H) {
+      Header (H),
+      direct_segment (nullptr) {
         assert (H.valid() && "IO handler must be set when creating an Image"); 
         assert ((H.is_file_backed() ? is_data_type<ValueType>::value : true) && "class types cannot be stored on file using the Image class");
 
@@ -334,13 +422,14 @@ namespace MR
         return data_buffer.get();
 
       assert (io && "data pointer will only be set for valid Images");
-      if (!io->is_file_backed()) // this is a scratch image
-        return io->segment(0);
-
-      // check wether we can still do direct IO
-      // if so, return address where mapped
-      if (io->nsegments() == 1 && datatype() == DataType::from<ValueType>() && intensity_offset() == 0.0 && intensity_scale() == 1.0)
-        return io->segment(0);
+      // scratch images can always be accessed directly; otherwise, check
+      // whether we can still do direct IO, and if so, return address where mapped
+      if (!io->is_file_backed() ||
+          (io->nsegments() == 1 && datatype() == DataType::from<ValueType>() && intensity_offset() == 0.0 && intensity_scale() == 1.0)) {
+        if (!direct_segment)
+          direct_segment = io->segment(0);
+        return direct_segment;
+      }
 
       // can't do direct IO
       return nullptr;
@@ -413,7 +502,7 @@ namespace MR
       if (!buffer.unique())
         throw Exception ("FIXME: don't invoke 'with_direct_io()' on images if other copies exist!");
 
-      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 );
+      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 ) || ( buffer->get_io()->nsegments() > 1 );
       if (with_strides.size()) {
         auto new_strides = Stride::get_actual (Stride::get_nearest_match (*this, with_strides), *this);
         preload |= ( new_strides != Stride::get (*this) );
@@ -433,9 +522,12 @@ namespace MR
 
       if (buffer->get_io()->is_image_new()) {
         // no need to preload if data is zero anyway:
-        memset (buffer->data_buffer.get(), 0, buffer_size);
+        Thread::zero_fill (buffer->data_buffer.get(), buffer_size);
       }
       else {
+        // the preloaded data will be shared read-only between threads:
+        if (!buffer->get_io()->is_image_readwrite())
+          Thread::interleave_memory (buffer->data_buffer.get(), buffer_size);
         auto src (*this);
         TmpImage<ValueType> dest = { *buffer, buffer->data_buffer.get(), std::vector<ssize_t> (ndim(), 0), with_strides, Stride::offset (with_strides, *this) };
         threaded_copy_with_progress_message ("preloading data for \"" + name() + "\"", src, dest); 
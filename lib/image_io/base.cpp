@@ -52,9 +52,98 @@ namespace MR
       unload (header);
       DEBUG ("image \"" + header.name() + "\" unloaded");
       addresses.clear();
+      segment_state.reset();
+      segment_mutex.reset();
+      segment_cache.reset();
+      segment_readers.reset();
     }
 
 
+
+    void Base::load_segments_on_demand (size_t max_segments)
+    {
+      segment_state.reset (new std::atomic<uint8_t> [addresses.size()]);
+      segment_mutex.reset (new std::mutex [addresses.size()]);
+      for (size_t n = 0; n < addresses.size(); ++n)
+        segment_state[n] = SEGMENT_NOT_LOADED;
+
+      if (max_segments && max_segments < addresses.size()) {
+        segment_cache.reset (new SegmentCache);
+        segment_cache->capacity = max_segments;
+        segment_cache->loaded = 0;
+        segment_cache->hand = 0;
+        segment_readers.reset (new std::atomic<uint32_t> [addresses.size()]);
+        for (size_t n = 0; n < addresses.size(); ++n)
+          segment_readers[n] = 0;
+      }
+    }
+
+
+
+    void Base::load_segment (size_t)
+    {
+      assert (0 && "load_segment() invoked on image handler that does not support on-demand loading");
+    }
+
+
+
+    void Base::fetch_segment (size_t n) const
+    {
+      // segment() is logically const: populating a segment on first access
+      // does not alter the image contents as seen by the caller
+      Base& self (const_cast<Base&> (*this));
+
+      // segment is loaded, but had been marked as a candidate for release:
+      uint8_t state = SEGMENT_IDLE;
+      if (segment_state[n].compare_exchange_strong (state, SEGMENT_IN_USE))
+        return;
+
+      std::lock_guard<std::mutex> lock (segment_mutex[n]);
+      if (segment_state[n].load (std::memory_order_relaxed) != SEGMENT_NOT_LOADED)
+        return;
+
+      if (segment_cache)
+        self.evict_segments (n);
+
+      self.load_segment (n);
+      segment_state[n].store (SEGMENT_IN_USE, std::memory_order_release);
+    }
+
+
+
+    void Base::evict_segments (size_t current)
+    {
+      std::lock_guard<std::mutex> lock (segment_cache->mutex);
+      auto& cache (*segment_cache);
+      // visit each segment at most once per call, so that a segment is
+      // never both marked idle and released in the same sweep; if all
+      // segments are busy, the limit is exceeded until the next call:
+      for (size_t attempts = addresses.size(); cache.loaded >= cache.capacity && attempts; --attempts) {
+        cache.hand = (cache.hand + 1) % addresses.size();
+        const size_t n = cache.hand;
+        if (n == current)
+          continue;
+        // first pass: remove reference (second chance):
+        uint8_t state = SEGMENT_IN_USE;
+        if (segment_state[n].compare_exchange_strong (state, SEGMENT_IDLE))
+          continue;
+        // second pass: release if not referenced since, and not pinned:
+        if (state != SEGMENT_IDLE || !segment_mutex[n].try_lock())
+          continue;
+        std::lock_guard<std::mutex> segment_lock (segment_mutex[n], std::adopt_lock);
+        if (!segment_state[n].compare_exchange_strong (state, SEGMENT_NOT_LOADED, std::memory_order_seq_cst))
+          continue;
+        // a reader that pins the segment after this check will see it
+        // as not loaded, and wait on segment_mutex[n] to reload it:
+        if (segment_readers[n].load (std::memory_order_seq_cst)) {
+          segment_state[n].store (SEGMENT_IN_USE, std::memory_order_release);
+          continue;
+        }
+        addresses[n].reset();
+        --cache.loaded;
+      }
+      ++cache.loaded;
+    }
   }
 }
 
@@ -17,6 +17,8 @@
 #define __image_io_base_h__
 
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include <stdint.h>
 #include <unistd.h>
 #include <cassert>
@@ -72,10 +74,25 @@ namespace MR
             writable = readwrite;
         }
 
+        //! get the address of segment \a n, loading it if necessary
+        /*! For images whose segments may be released to limit memory usage
+         * (see load_segments_on_demand()), this also pins the segment in
+         * RAM: every call to segment() must then be matched by a call to
+         * release_segment() once the caller no longer needs the address. */
         uint8_t* segment (size_t n) const {
           assert (n < addresses.size());
+          if (segment_readers)
+            segment_readers[n].fetch_add (1, std::memory_order_seq_cst);
+          if (segment_state && segment_state[n].load (segment_readers ? std::memory_order_seq_cst : std::memory_order_acquire) != SEGMENT_IN_USE)
+            fetch_segment (n);
           return addresses[n].get();
         }
+        //! unpin segment \a n, as previously obtained using segment()
+        void release_segment (size_t n) const {
+          assert (n < addresses.size());
+          if (segment_readers)
+            segment_readers[n].fetch_sub (1, std::memory_order_release);
+        }
         size_t nsegments () const {
           return addresses.size();
         }
@@ -104,11 +121,51 @@ namespace MR
         std::vector<std::unique_ptr<uint8_t[]>> addresses;
         bool is_new, writable;
 
+        // only allocated by handlers that populate their segments on first
+        // access (see load_segments_on_demand()):
+        enum : uint8_t { SEGMENT_NOT_LOADED, SEGMENT_IN_USE, SEGMENT_IDLE };
+        std::unique_ptr<std::atomic<uint8_t>[]> segment_state;
+        std::unique_ptr<std::mutex[]> segment_mutex;
+
+        class SegmentCache {
+          public:
+            std::mutex mutex;
+            size_t capacity, loaded, hand;
+        };
+        std::unique_ptr<SegmentCache> segment_cache;
+        // number of callers currently holding the address of each segment;
+        // only allocated if segments may be released:
+        std::unique_ptr<std::atomic<uint32_t>[]> segment_readers;
+
         void check () const {
           assert (addresses.size());
         }
         virtual void load (const Header& header, size_t buffer_size) = 0;
         virtual void unload (const Header& header) = 0;
+
+        //! defer loading of the segments until they are first accessed
+        /*! This should be invoked from load() once \c addresses has been
+         * sized to the number of segments (but not allocated): the handler's
+         * load_segment() method will then be invoked for each segment the
+         * first time it is accessed via segment(), possibly concurrently for
+         * different segments.
+         *
+         * If \a max_segments is non-zero, no more than that number of
+         * segments will be held in RAM at any one time: once this limit is
+         * reached, segments that have not been accessed recently are released
+         * (using the CLOCK approximation to LRU replacement), and will be
+         * loaded again if subsequently required. This is only appropriate
+         * for read-only images. Segments are pinned by segment() until
+         * the matching release_segment(), and are never released while
+         * pinned. */
+        void load_segments_on_demand (size_t max_segments = 0);
+
+        //! allocate and populate \c addresses[n]
+        virtual void load_segment (size_t n);
+
+      private:
+        void fetch_segment (size_t n) const;
+        void evict_segments (size_t current);
     };
 
   }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include <atomic>
+#include <zlib.h>
+
+#include "header.h"
+#include "progressbar.h"
+#include "thread.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "image_io/chunked.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    namespace
+    {
+
+      inline uint64_t get_uint64 (const uint8_t* p)
+      {
+        uint64_t v = 0;
+        for (int n = 7; n >= 0; --n)
+          v = (v << 8) | p[n];
+        return v;
+      }
+
+      inline void put_uint64 (uint64_t v, uint8_t* p)
+      {
+        for (int n = 0; n < 8; ++n, v >>= 8)
+          p[n] = v;
+      }
+
+      // process items [first, last) concurrently, handing them out one at a
+      // time to each thread:
+      template <class Functor>
+        void run_chunks (Functor&& func, size_t first, size_t last, const std::string& name)
+        {
+          std::atomic<size_t> next (first);
+          struct Processor {
+            Functor& func;
+            std::atomic<size_t>& next;
+            const size_t last;
+            void execute () {
+              size_t n;
+              while ((n = next++) < last)
+                func (n);
+            }
+          } processor = { func, next, last };
+
+          if (Thread::number_of_threads() == 0)
+            processor.execute();
+          else
+            Thread::run (Thread::multi (processor), name).wait();
+        }
+
+    }
+
+
+
+
+    //CONF option: MIFChunkSize
+    //CONF default: 1048576
+    //CONF The amount of (uncompressed) data in bytes held in each
+    //CONF independently compressed chunk when writing images in the
+    //CONF chunked MRtrix format (.mifc).
+
+    size_t Chunked::default_chunk_size (const DataType& datatype)
+    {
+      static const size_t size = File::Config::get_int ("MIFChunkSize", 1048576);
+      if (size < 1024)
+        throw Exception ("invalid value for config file entry \"MIFChunkSize\"");
+      // chunks must hold a whole number of bytes, even for bitwise data:
+      return std::max (size_t(8), ((8 * size / datatype.bits()) / 8) * 8);
+    }
+
+
+
+
+    //CONF option: MIFChunkCacheSize
+    //CONF default: 1024
+    //CONF The maximum amount of RAM (in MB) to use for holding
+    //CONF decompressed chunks when reading images in the chunked MRtrix
+    //CONF format (.mifc); chunks that have not been accessed recently
+    //CONF are discarded once this limit is reached. Set to zero to allow
+    //CONF all chunks to be held in RAM.
+
+    void Chunked::load (const Header& header, size_t)
+    {
+      if (files.size() != 1)
+        throw Exception ("chunked image \"" + header.name() + "\" must be stored in a single file");
+
+      const int64_t num_voxels = segsize;
+      total_bytes = (header.datatype().bits() * num_voxels + 7) / 8;
+      bytes_per_chunk = (header.datatype().bits() * chunk_size + 7) / 8;
+      const size_t num_chunks = (num_voxels + chunk_size - 1) / chunk_size;
+      segsize = chunk_size;
+      addresses.resize (num_chunks);
+
+      if (is_new) {
+        for (size_t n = 0; n < num_chunks; ++n)
+          addresses[n].reset (new uint8_t [bytes_per_chunk] ());
+        return;
+      }
+
+      mmap.reset (new File::MMap (files[0]));
+      table = mmap->address();
+      if (mmap->size() < int64_t (8 * (num_chunks+1)) || int64_t (get_uint64 (table + 8*num_chunks)) > mmap->size())
+        throw Exception ("chunked image \"" + header.name() + "\" is smaller than expected - file may be corrupt");
+      for (size_t n = 0; n < num_chunks; ++n)
+        if (get_uint64 (table + 8*n) < 8 * (num_chunks+1) || get_uint64 (table + 8*n) > get_uint64 (table + 8*(n+1)))
+          throw Exception ("invalid chunk table in image \"" + header.name() + "\" - file may be corrupt");
+
+      if (writable) {
+        // all chunks will need to be written back anyway:
+        ProgressBar progress ("uncompressing image \"" + header.name() + "\"", num_chunks);
+        std::mutex mutex;
+        run_chunks ([&](size_t n) {
+            addresses[n].reset (new uint8_t [bytes_per_chunk]);
+            decompress_chunk (n, addresses[n].get());
+            std::lock_guard<std::mutex> lock (mutex);
+            ++progress;
+          }, 0, num_chunks, "chunk decompression");
+        mmap.reset();
+        return;
+      }
+
+      static const size_t cache_size = File::Config::get_int ("MIFChunkCacheSize", 1024);
+      const size_t max_chunks = cache_size ? std::max (size_t(1), (cache_size << 20) / bytes_per_chunk) : 0;
+      DEBUG ("chunked image \"" + header.name() + "\" holds " + str(num_chunks) + " chunks of " + str(chunk_size) + " voxels"
+          + ( max_chunks && max_chunks < num_chunks ? " (at most " + str(max_chunks) + " held in RAM)" : std::string() ));
+      load_segments_on_demand (max_chunks);
+    }
+
+
+
+
+    void Chunked::load_segment (size_t n)
+    {
+      addresses[n].reset (new uint8_t [bytes_per_chunk]);
+      decompress_chunk (n, addresses[n].get());
+    }
+
+
+
+
+    void Chunked::decompress_chunk (size_t n, uint8_t* dest) const
+    {
+      assert (mmap);
+      const uint64_t from = get_uint64 (table + 8*n);
+      const uint64_t to = get_uint64 (table + 8*(n+1));
+      uLongf size = chunk_bytes (n);
+      if (uncompress (dest, &size, table + from, to - from) != Z_OK || int64_t (size) != chunk_bytes (n))
+        throw Exception ("error decompressing chunk " + str(n) + " of image \"" + mmap->name() + "\" - file may be corrupt");
+    }
+
+
+
+
+    void Chunked::unload (const Header& header)
+    {
+      mmap.reset();
+      if (!writable || addresses.empty())
+        return;
+
+      const size_t num_chunks = addresses.size();
+      ProgressBar progress ("compressing image \"" + header.name() + "\"", num_chunks);
+
+      File::OFStream out (files[0].name, std::ios::out | std::ios::binary);
+      out.write (file_header.c_str(), file_header.size());
+
+      // space for the chunk table, filled in once all chunks are written:
+      std::vector<uint8_t> offsets (8 * (num_chunks+1), 0);
+      out.write (reinterpret_cast<const char*> (offsets.data()), offsets.size());
+
+      // compress in batches, so that chunks can be written out in order
+      // without holding the whole compressed image in RAM:
+      const size_t batch_size = 4 * std::max (Thread::number_of_threads(), size_t(1));
+      std::vector<std::vector<uint8_t>> compressed (batch_size);
+      uint64_t offset = offsets.size();
+
+      for (size_t first = 0; first < num_chunks; first += batch_size) {
+        const size_t last = std::min (first + batch_size, num_chunks);
+        run_chunks ([&](size_t n) {
+            auto& buffer (compressed[n-first]);
+            uLongf size = compressBound (chunk_bytes (n));
+            buffer.resize (size);
+            if (compress (buffer.data(), &size, addresses[n].get(), chunk_bytes (n)) != Z_OK)
+              throw Exception ("error compressing chunk " + str(n) + " of image \"" + header.name() + "\"");
+            buffer.resize (size);
+          }, first, last, "chunk compression");
+
+        for (size_t n = first; n < last; ++n) {
+          put_uint64 (offset, offsets.data() + 8*n);
+          out.write (reinterpret_cast<const char*> (compressed[n-first].data()), compressed[n-first].size());
+          offset += compressed[n-first].size();
+          ++progress;
+        }
+        if (!out.good())
+          throw Exception ("error writing to file \"" + files[0].name + "\": " + strerror (errno));
+      }
+      put_uint64 (offset, offsets.data() + 8*num_chunks);
+
+      out.seekp (file_header.size());
+      out.write (reinterpret_cast<const char*> (offsets.data()), offsets.size());
+      if (!out.good())
+        throw Exception ("error writing to file \"" + files[0].name + "\": " + strerror (errno));
+    }
+
+
+  }
+}
+
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#ifndef __image_io_chunked_h__
+#define __image_io_chunked_h__
+
+#include "datatype.h"
+#include "image_io/base.h"
+#include "file/mmap.h"
+
+namespace MR
+{
+
+  namespace ImageIO
+  {
+
+    //! image data stored as a series of independently compressed chunks
+    /*! The voxel data, in the order in which they are stored on file, are
+     * split into chunks of chunk_size voxels (the last chunk may be
+     * shorter). Each chunk is compressed separately using deflate (zlib
+     * format). The data section of the file consists of a table of
+     * (number of chunks + 1) little-endian 64-bit offsets (relative to the
+     * start of the data section) giving the location of each chunk,
+     * followed by the compressed chunks themselves.
+     *
+     * Each chunk is mapped to a segment: for read-only images, chunks are
+     * decompressed on demand as they are accessed, and held in a cache of
+     * limited size. Images opened read-write are decompressed in full, and
+     * all chunks are compressed and written back when the image is closed. */
+    class Chunked : public Base
+    {
+      public:
+        //! \a file_header holds the full header to write out, including any
+        //! padding up to the start of the data section
+        Chunked (const Header& header, const std::string& file_header, size_t chunk_size) :
+          Base (header),
+          file_header (file_header),
+          chunk_size (chunk_size),
+          bytes_per_chunk (0),
+          total_bytes (0),
+          table (nullptr) { }
+        Chunked (Chunked&&) = default;
+
+        //! the number of voxels to store per chunk for the given data type
+        static size_t default_chunk_size (const DataType& datatype);
+
+      protected:
+        std::string file_header;
+        size_t chunk_size;
+        int64_t bytes_per_chunk, total_bytes;
+        std::unique_ptr<File::MMap> mmap;
+        const uint8_t* table;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+        virtual void load_segment (size_t n);
+
+        int64_t chunk_bytes (size_t n) const {
+          return std::min (bytes_per_chunk, total_bytes - int64_t(n)*bytes_per_chunk);
+        }
+        void decompress_chunk (size_t n, uint8_t* dest) const;
+    };
+
+  }
+}
+
+#endif
+
+
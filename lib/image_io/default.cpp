@@ -17,6 +17,7 @@
 
 #include "app.h"
 #include "header.h"
+#include "thread.h"
 #include "file/ofstream.h"
 #include "image_io/default.h"
 
@@ -97,7 +98,7 @@ namespace MR
       if (!addresses[0]) 
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
-      if (is_new) memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
+      if (is_new) Thread::zero_fill (addresses[0].get(), files.size() * bytes_per_segment);
       else {
         for (size_t n = 0; n < files.size(); n++) {
           File::MMap file (files[n], false, false, bytes_per_segment);
@@ -13,6 +13,10 @@
  * 
  */
 
+#ifdef __AVX__
+# include <immintrin.h>
+#endif
+
 #include "image_io/fetch_store.h"
 
 namespace MR
@@ -96,41 +100,210 @@ namespace MR
 
 
 
-    // for single-byte types:
+    // single-value access, specialised for each on-disk type and byte
+    // order via the FETCH / STORE template arguments:
 
-    template <typename RAMType, typename DiskType> 
+    template <typename RAMType, typename DiskType, DiskType (*FETCH) (const void*, size_t)> 
       RAMType __fetch (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch<DiskType> (data, i), offset, scale)); 
+        return round_func<RAMType> (scale_from_storage (FETCH (data, i), offset, scale)); 
       }
 
-    template <typename RAMType, typename DiskType> 
+    template <typename RAMType, typename DiskType, void (*STORE) (DiskType, void*, size_t)> 
       void __store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i); 
+        STORE (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i); 
       }
 
-    // for little-endian multi-byte types:
 
-    template <typename RAMType, typename DiskType> 
-      RAMType __fetch_LE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_LE<DiskType> (data, i), offset, scale));
+
+    // SIMD conversion kernels for contiguous runs of data stored in native
+    // byte order, for the most common combinations (integer or
+    // floating-point on file, floating-point in RAM). The scaling is
+    // performed in double precision with the same sequence of operations as
+    // the scalar code, so the results are identical. Each kernel returns
+    // the number of values processed; the remainder is handled by the
+    // scalar loop. Where these are not available, nothing is processed.
+
+    template <typename RAMType, typename DiskType>
+      struct __simd_from_storage_available { static const bool value = false; };
+
+    template <typename RAMType, typename DiskType>
+      struct __simd_to_storage_available { static const bool value = false; };
+
+#ifdef __AVX__
+
+    // load 4 consecutive values as packed doubles:
+    inline __m256d __load4_pd (const int8_t* in) { int32_t v; memcpy (&v, in, 4); return _mm256_cvtepi32_pd (_mm_cvtepi8_epi32 (_mm_cvtsi32_si128 (v))); }
+    inline __m256d __load4_pd (const uint8_t* in) { int32_t v; memcpy (&v, in, 4); return _mm256_cvtepi32_pd (_mm_cvtepu8_epi32 (_mm_cvtsi32_si128 (v))); }
+    inline __m256d __load4_pd (const int16_t* in) { return _mm256_cvtepi32_pd (_mm_cvtepi16_epi32 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (in)))); }
+    inline __m256d __load4_pd (const uint16_t* in) { return _mm256_cvtepi32_pd (_mm_cvtepu16_epi32 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (in)))); }
+    inline __m256d __load4_pd (const int32_t* in) { return _mm256_cvtepi32_pd (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (in))); }
+    inline __m256d __load4_pd (const float* in) { return _mm256_cvtps_pd (_mm_loadu_ps (in)); }
+    inline __m256d __load4_pd (const double* in) { return _mm256_loadu_pd (in); }
+
+    // store 4 packed doubles:
+    inline void __store4_pd (float* out, __m256d v) { _mm_storeu_ps (out, _mm256_cvtpd_ps (v)); }
+    inline void __store4_pd (double* out, __m256d v) { _mm256_storeu_pd (out, v); }
+
+    template <typename T> struct __is_simd_float { static const bool value = std::is_same<T,float>::value || std::is_same<T,double>::value; };
+    template <typename T> struct __is_simd_loadable { static const bool value = __is_simd_float<T>::value || 
+      std::is_same<T,int8_t>::value || std::is_same<T,uint8_t>::value || std::is_same<T,int16_t>::value || 
+        std::is_same<T,uint16_t>::value || std::is_same<T,int32_t>::value; };
+
+    template <> struct __simd_from_storage_available<float,int8_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,uint8_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,int16_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,uint16_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,int32_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,float> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<float,double> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,int8_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,uint8_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,int16_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,uint16_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,int32_t> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,float> { static const bool value = true; };
+    template <> struct __simd_from_storage_available<double,double> { static const bool value = true; };
+
+    // integer types are not included for storage, since the rounding
+    // convention used (round half away from zero) has no SIMD equivalent:
+    template <> struct __simd_to_storage_available<float,float> { static const bool value = true; };
+    template <> struct __simd_to_storage_available<float,double> { static const bool value = true; };
+    template <> struct __simd_to_storage_available<double,float> { static const bool value = true; };
+    template <> struct __simd_to_storage_available<double,double> { static const bool value = true; };
+
+    template <typename RAMType, typename DiskType>
+      inline typename std::enable_if<__simd_from_storage_available<RAMType,DiskType>::value, size_t>::type 
+      __simd_from_storage (RAMType* values, const DiskType* in, size_t n, default_type offset, default_type scale) {
+        const __m256d o = _mm256_set1_pd (offset), s = _mm256_set1_pd (scale);
+        size_t k = 0;
+        for (; k+4 <= n; k += 4) 
+          __store4_pd (values+k, _mm256_add_pd (o, _mm256_mul_pd (s, __load4_pd (in+k))));
+        return k;
       }
 
-    template <typename RAMType, typename DiskType> 
-      void __store_LE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_LE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+    template <typename RAMType, typename DiskType>
+      inline typename std::enable_if<__simd_to_storage_available<RAMType,DiskType>::value, size_t>::type 
+      __simd_to_storage (const RAMType* values, DiskType* out, size_t n, default_type offset, default_type scale) {
+        const __m256d o = _mm256_set1_pd (offset), s = _mm256_set1_pd (scale);
+        size_t k = 0;
+        for (; k+4 <= n; k += 4) 
+          __store4_pd (out+k, _mm256_div_pd (_mm256_sub_pd (__load4_pd (values+k), o), s));
+        return k;
       }
 
+#endif
 
-    // for big-endian multi-byte types:
+    template <typename RAMType, typename DiskType>
+      inline typename std::enable_if<!__simd_from_storage_available<RAMType,DiskType>::value, size_t>::type 
+      __simd_from_storage (RAMType*, const DiskType*, size_t, default_type, default_type) { return 0; }
+
+    template <typename RAMType, typename DiskType>
+      inline typename std::enable_if<!__simd_to_storage_available<RAMType,DiskType>::value, size_t>::type 
+      __simd_to_storage (const RAMType*, DiskType*, size_t, default_type, default_type) { return 0; }
 
+
+
+
+    // plain copy, where no conversion is required:
+    template <typename OutType, typename InType>
+      inline typename std::enable_if<std::is_same<OutType,InType>::value, bool>::type 
+      __copy_run (OutType* out, const InType* in, size_t n) { std::copy (in, in+n, out); return true; }
+
+    template <typename OutType, typename InType>
+      inline typename std::enable_if<!std::is_same<OutType,InType>::value, bool>::type 
+      __copy_run (OutType*, const InType*, size_t) { return false; }
+
+
+
+    // block access: convert a (possibly strided) run of values in one call.
+    // The scaling and type conversion are inlined into the loop, avoiding
+    // an indirect function call per voxel. Contiguous runs are handled
+    // separately, using the SIMD kernels above where possible, or a plain
+    // copy if no conversion is needed at all:
+
+    template <typename RAMType, typename DiskType, bool NATIVE, DiskType (*FETCH) (const void*, size_t)> 
+      void __fetch_contiguous (RAMType* values, const void* data, size_t i, size_t n, default_type offset, default_type scale) {
+        const bool identity = ( offset == 0.0 && scale == 1.0 );
+        size_t k = 0;
+        if (NATIVE && !std::is_same<DiskType,bool>::value) {
+          const DiskType* in = reinterpret_cast<const DiskType*> (data) + i;
+          if (identity && __copy_run (values, in, n))
+            return;
+          k = __simd_from_storage (values, in, n, offset, scale);
+        }
+        if (identity) {
+          for (; k < n; ++k)
+            values[k] = round_func<RAMType> (FETCH (data, i+k)); 
+        }
+        else {
+          for (; k < n; ++k)
+            values[k] = round_func<RAMType> (scale_from_storage (FETCH (data, i+k), offset, scale)); 
+        }
+      }
+
+    template <typename RAMType, typename DiskType, bool NATIVE, void (*STORE) (DiskType, void*, size_t)> 
+      void __store_contiguous (const RAMType* values, void* data, size_t i, size_t n, default_type offset, default_type scale) {
+        const bool identity = ( offset == 0.0 && scale == 1.0 );
+        size_t k = 0;
+        if (NATIVE && !std::is_same<DiskType,bool>::value) {
+          DiskType* out = reinterpret_cast<DiskType*> (data) + i;
+          if (identity && __copy_run (out, values, n))
+            return;
+          k = __simd_to_storage (values, out, n, offset, scale);
+        }
+        if (identity) {
+          for (; k < n; ++k)
+            STORE (round_func<DiskType> (values[k]), data, i+k); 
+        }
+        else {
+          for (; k < n; ++k)
+            STORE (round_func<DiskType> (scale_to_storage (values[k], offset, scale)), data, i+k); 
+        }
+      }
+
+
+    template <typename RAMType, typename DiskType, bool NATIVE, DiskType (*FETCH) (const void*, size_t)> 
+      void __fetch_block (RAMType* values, const void* data, size_t i, size_t n, ssize_t stride, default_type offset, default_type scale) {
+        if (stride == 1)
+          return __fetch_contiguous<RAMType,DiskType,NATIVE,FETCH> (values, data, i, n, offset, scale);
+        for (size_t k = 0; k < n; ++k, i += stride)
+          values[k] = round_func<RAMType> (scale_from_storage (FETCH (data, i), offset, scale)); 
+      }
+
+    template <typename RAMType, typename DiskType, bool NATIVE, void (*STORE) (DiskType, void*, size_t)> 
+      void __store_block (const RAMType* values, void* data, size_t i, size_t n, ssize_t stride, default_type offset, default_type scale) {
+        if (stride == 1)
+          return __store_contiguous<RAMType,DiskType,NATIVE,STORE> (values, data, i, n, offset, scale);
+        for (size_t k = 0; k < n; ++k, i += stride)
+          STORE (round_func<DiskType> (scale_to_storage (values[k], offset, scale)), data, i); 
+      }
+
+
+
+    template <typename RAMType, typename DiskType, bool NATIVE, DiskType (*FETCH) (const void*, size_t), void (*STORE) (DiskType, void*, size_t)> 
+      inline void __assign (FetchStoreFunctions<RAMType>& functions) {
+        functions.fetch = __fetch<RAMType,DiskType,FETCH>;
+        functions.store = __store<RAMType,DiskType,STORE>;
+        functions.fetch_block = __fetch_block<RAMType,DiskType,NATIVE,FETCH>;
+        functions.store_block = __store_block<RAMType,DiskType,NATIVE,STORE>;
+      }
+
+    // for single-byte types:
     template <typename RAMType, typename DiskType> 
-      RAMType __fetch_BE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_BE<DiskType> (data, i), offset, scale));
+      inline void __assign (FetchStoreFunctions<RAMType>& functions) {
+        __assign<RAMType,DiskType,true,Raw::fetch_native<DiskType>,Raw::store_native<DiskType>> (functions);
       }
 
+    // for little-endian multi-byte types:
+    template <typename RAMType, typename DiskType> 
+      inline void __assign_LE (FetchStoreFunctions<RAMType>& functions) {
+        __assign<RAMType,DiskType,!MRTRIX_IS_BIG_ENDIAN,Raw::fetch_LE<DiskType>,Raw::store_LE<DiskType>> (functions);
+      }
+
+    // for big-endian multi-byte types:
     template <typename RAMType, typename DiskType> 
-      void __store_BE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_BE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+      inline void __assign_BE (FetchStoreFunctions<RAMType>& functions) {
+        __assign<RAMType,DiskType,MRTRIX_IS_BIG_ENDIAN,Raw::fetch_BE<DiskType>,Raw::store_BE<DiskType>> (functions);
       }
 
 
@@ -142,103 +315,33 @@ namespace MR
 
   template <typename ValueType>
     typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, 
+        FetchStoreFunctions<ValueType>& functions,
         DataType datatype) {
 
       switch (datatype()) {
-        case DataType::Bit:
-          fetch_func = __fetch<ValueType,bool>;
-          store_func = __store<ValueType,bool>;
-          return;
-        case DataType::Int8:
-          fetch_func = __fetch<ValueType,int8_t>;
-          store_func = __store<ValueType,int8_t>;
-          return;
-        case DataType::UInt8:
-          fetch_func = __fetch<ValueType,uint8_t>;
-          store_func = __store<ValueType,uint8_t>;
-          return;
-        case DataType::Int16LE:
-          fetch_func = __fetch_LE<ValueType,int16_t>;
-          store_func = __store_LE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16LE:
-          fetch_func = __fetch_LE<ValueType,uint16_t>;
-          store_func = __store_LE<ValueType,uint16_t>;
-          return;
-        case DataType::Int16BE:
-          fetch_func = __fetch_BE<ValueType,int16_t>;
-          store_func = __store_BE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16BE:
-          fetch_func = __fetch_BE<ValueType,uint16_t>;
-          store_func = __store_BE<ValueType,uint16_t>;
-          return;
-        case DataType::Int32LE:
-          fetch_func = __fetch_LE<ValueType,int32_t>;
-          store_func = __store_LE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32LE:
-          fetch_func = __fetch_LE<ValueType,uint32_t>;
-          store_func = __store_LE<ValueType,uint32_t>;
-          return;
-        case DataType::Int32BE:
-          fetch_func = __fetch_BE<ValueType,int32_t>;
-          store_func = __store_BE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32BE:
-          fetch_func = __fetch_BE<ValueType,uint32_t>;
-          store_func = __store_BE<ValueType,uint32_t>;
-          return;
-        case DataType::Int64LE:
-          fetch_func = __fetch_LE<ValueType,int64_t>;
-          store_func = __store_LE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64LE:
-          fetch_func = __fetch_LE<ValueType,uint64_t>;
-          store_func = __store_LE<ValueType,uint64_t>;
-          return;
-        case DataType::Int64BE:
-          fetch_func = __fetch_BE<ValueType,int64_t>;
-          store_func = __store_BE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64BE:
-          fetch_func = __fetch_BE<ValueType,uint64_t>;
-          store_func = __store_BE<ValueType,uint64_t>;
-          return;
-        case DataType::Float32LE:
-          fetch_func = __fetch_LE<ValueType,float>;
-          store_func = __store_LE<ValueType,float>;
-          return;
-        case DataType::Float32BE:
-          fetch_func = __fetch_BE<ValueType,float>;
-          store_func = __store_BE<ValueType,float>;
-          return;
-        case DataType::Float64LE:
-          fetch_func = __fetch_LE<ValueType,double>;
-          store_func = __store_LE<ValueType,double>;
-          return;
-        case DataType::Float64BE:
-          fetch_func = __fetch_BE<ValueType,double>;
-          store_func = __store_BE<ValueType,double>;
-          return;
-        case DataType::CFloat32LE:
-          fetch_func = __fetch_LE<ValueType,cfloat>;
-          store_func = __store_LE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat32BE:
-          fetch_func = __fetch_BE<ValueType,cfloat>;
-          store_func = __store_BE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat64LE:
-          fetch_func = __fetch_LE<ValueType,cdouble>;
-          store_func = __store_LE<ValueType,cdouble>;
-          return;
-        case DataType::CFloat64BE:
-          fetch_func = __fetch_BE<ValueType,cdouble>;
-          store_func = __store_BE<ValueType,cdouble>;
-          return;
+        case DataType::Bit:        __assign<ValueType,bool> (functions); return;
+        case DataType::Int8:       __assign<ValueType,int8_t> (functions); return;
+        case DataType::UInt8:      __assign<ValueType,uint8_t> (functions); return;
+        case DataType::Int16LE:    __assign_LE<ValueType,int16_t> (functions); return;
+        case DataType::UInt16LE:   __assign_LE<ValueType,uint16_t> (functions); return;
+        case DataType::Int16BE:    __assign_BE<ValueType,int16_t> (functions); return;
+        case DataType::UInt16BE:   __assign_BE<ValueType,uint16_t> (functions); return;
+        case DataType::Int32LE:    __assign_LE<ValueType,int32_t> (functions); return;
+        case DataType::UInt32LE:   __assign_LE<ValueType,uint32_t> (functions); return;
+        case DataType::Int32BE:    __assign_BE<ValueType,int32_t> (functions); return;
+        case DataType::UInt32BE:   __assign_BE<ValueType,uint32_t> (functions); return;
+        case DataType::Int64LE:    __assign_LE<ValueType,int64_t> (functions); return;
+        case DataType::UInt64LE:   __assign_LE<ValueType,uint64_t> (functions); return;
+        case DataType::Int64BE:    __assign_BE<ValueType,int64_t> (functions); return;
+        case DataType::UInt64BE:   __assign_BE<ValueType,uint64_t> (functions); return;
+        case DataType::Float32LE:  __assign_LE<ValueType,float> (functions); return;
+        case DataType::Float32BE:  __assign_BE<ValueType,float> (functions); return;
+        case DataType::Float64LE:  __assign_LE<ValueType,double> (functions); return;
+        case DataType::Float64BE:  __assign_BE<ValueType,double> (functions); return;
+        case DataType::CFloat32LE: __assign_LE<ValueType,cfloat> (functions); return;
+        case DataType::CFloat32BE: __assign_BE<ValueType,cfloat> (functions); return;
+        case DataType::CFloat64LE: __assign_LE<ValueType,cdouble> (functions); return;
+        case DataType::CFloat64BE: __assign_BE<ValueType,cdouble> (functions); return;
         default:
           throw Exception ("invalid data type in image header");
       }
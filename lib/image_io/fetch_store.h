@@ -23,18 +23,53 @@ namespace MR
 {
 
 
+  //! pointer to function used to read a single value from storage
+  template <typename ValueType>
+    using FetchFunc = ValueType (*) (const void* data, size_t i, default_type offset, default_type scale);
+
+  //! pointer to function used to write a single value to storage
+  template <typename ValueType>
+    using StoreFunc = void (*) (ValueType val, void* data, size_t i, default_type offset, default_type scale);
+
+  //! pointer to function used to read \a n values from storage
+  /*! values are read from offsets \a i, \a i + \a stride, ..., \a i +
+   * (\a n-1) \a stride, and written contiguously into \a values. */
+  template <typename ValueType>
+    using FetchBlockFunc = void (*) (ValueType* values, const void* data, size_t i, size_t n, ssize_t stride, default_type offset, default_type scale);
+
+  //! pointer to function used to write \a n values to storage
+  /*! the contiguous array \a values is written to offsets \a i, \a i +
+   * \a stride, ..., \a i + (\a n-1) \a stride. */
+  template <typename ValueType>
+    using StoreBlockFunc = void (*) (const ValueType* values, void* data, size_t i, size_t n, ssize_t stride, default_type offset, default_type scale);
+
+
+
+  //! the set of functions used to access data in a given on-disk format
+  /*! these are resolved once when the image is opened, based on the
+   * datatype (including endianness) of the data on file. Each function is a
+   * specialisation for one specific (ValueType, on-disk type) combination,
+   * so no further type dispatch is required on access. */
+  template <typename ValueType>
+    struct FetchStoreFunctions {
+      FetchFunc<ValueType> fetch = nullptr;
+      StoreFunc<ValueType> store = nullptr;
+      FetchBlockFunc<ValueType> fetch_block = nullptr;
+      StoreBlockFunc<ValueType> store_block = nullptr;
+    };
+
+
+
   template <typename ValueType>
     typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& /*fetch_func*/,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& /*store_func*/, 
+        FetchStoreFunctions<ValueType>& /*functions*/,
         DataType /*datatype*/) { }
 
 
 
   template <typename ValueType>
     typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, 
+        FetchStoreFunctions<ValueType>& functions,
         DataType datatype);
 
 
@@ -42,8 +77,7 @@ namespace MR
   // to avoid massive recompile times...
 #define __DEFINE_FETCH_STORE_FUNCTION_FOR_TYPE(ValueType) \
   MRTRIX_EXTERN template void __set_fetch_store_functions<ValueType> ( \
-      std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func, \
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, \
+        FetchStoreFunctions<ValueType>& functions, \
         DataType datatype) 
 
 #define __DEFINE_FETCH_STORE_FUNCTIONS \
@@ -18,8 +18,10 @@
 #include "app.h"
 #include "progressbar.h"
 #include "header.h"
+#include "file/config.h"
 #include "image_io/gz.h"
 #include "file/gz.h"
+#include "file/gz_blocks.h"
 
 #define BYTES_PER_ZCALL 524288
 
@@ -38,6 +40,9 @@ namespace MR
       if (files.size() * bytes_per_segment > std::numeric_limits<size_t>::max())
         throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
 
+      if (load_on_demand (header))
+        return;
+
       DEBUG ("loading image \"" + header.name() + "\"...");
       addresses.resize (header.datatype().bits() == 1 && files.size() > 1 ? files.size() : 1);
       addresses[0].reset (new uint8_t [files.size() * bytes_per_segment]);
@@ -47,12 +52,20 @@ namespace MR
       if (is_new)
         memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
       else {
-        ProgressBar progress ("uncompressing image \"" + header.name() + "\"",
-            files.size() * bytes_per_segment / BYTES_PER_ZCALL);
         for (size_t n = 0; n < files.size(); n++) {
+          uint8_t* address = addresses[0].get() + n*bytes_per_segment;
+
+          // files written as independently compressed blocks can be
+          // decompressed in parallel:
+          File::GZBlocks blocks (files[n].name);
+          if (blocks.valid()) {
+            blocks.read (address, files[n].start, bytes_per_segment, "uncompressing image \"" + header.name() + "\"");
+            continue;
+          }
+
+          ProgressBar progress ("uncompressing image \"" + header.name() + "\"", bytes_per_segment / BYTES_PER_ZCALL);
           File::GZ zf (files[n].name, "rb");
           zf.seek (files[n].start);
-          uint8_t* address = addresses[0].get() + n*bytes_per_segment;
           uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
           while (address < last) {
             zf.read (reinterpret_cast<char*> (address), BYTES_PER_ZCALL);
@@ -74,28 +87,84 @@ namespace MR
 
 
 
+    //CONF option: GZLoadOnDemand
+    //CONF default: 1 (true)
+    //CONF A boolean value to indicate whether read-only compressed images
+    //CONF written by MRtrix3 (which embed an index of their independently
+    //CONF compressed blocks) should be decompressed piecewise as the
+    //CONF data are accessed, rather than in full when the image is opened.
+    //CONF This greatly reduces the cost of accessing a small part of a
+    //CONF large compressed image.
+
+    bool GZ::load_on_demand (const Header& header)
+    {
+      if (is_new || writable || files.size() != 1 || header.datatype().bits() < 8)
+        return false;
+      static const bool on_demand = File::Config::get_bool ("GZLoadOnDemand", true);
+      if (!on_demand)
+        return false;
+
+      std::unique_ptr<File::GZBlocks> index (new File::GZBlocks (files[0].name));
+      if (!index->valid())
+        return false;
+
+      // the data must start on a block boundary, and all blocks holding
+      // the data must be the same size (bar the last), and hold a whole
+      // number of voxels. Each such block is then mapped to a segment:
+      const auto& list (index->blocks());
+      size_t first = 0;
+      while (first < list.size() && list[first].start < files[0].start)
+        ++first;
+      if (first == list.size() || list[first].start != files[0].start)
+        return false;
+      const int64_t block_size = list[first].size;
+      if (block_size % header.datatype().bytes())
+        return false;
+      const size_t nblocks = (bytes_per_segment + block_size - 1) / block_size;
+      if (first + nblocks > list.size())
+        throw Exception ("compressed file \"" + files[0].name + "\" is smaller than expected");
+      for (size_t n = first; n < first + nblocks - 1; ++n)
+        if (list[n].size != block_size)
+          return false;
+
+      DEBUG ("image \"" + header.name() + "\" will be decompressed on demand (" + str(nblocks) + " blocks)");
+      blocks = std::move (index);
+      first_block = first;
+      segsize = block_size / header.datatype().bytes();
+      addresses.resize (nblocks);
+      load_segments_on_demand();
+      return true;
+    }
+
+
+
+    void GZ::load_segment (size_t n)
+    {
+      assert (blocks);
+      const size_t nblock = first_block + n;
+      addresses[n].reset (new uint8_t [blocks->blocks()[nblock].size]);
+      blocks->read_block (nblock, addresses[n].get());
+    }
+
+
+
+
     void GZ::unload (const Header& header)
     {
+      if (blocks) { // read-only, decompressed on demand
+        blocks.reset();
+        return;
+      }
+
       if (addresses.size()) {
         assert (addresses[0]);
 
         if (writable) {
-          ProgressBar progress ("compressing image \"" + header.name() + "\"",
-              files.size() * bytes_per_segment / BYTES_PER_ZCALL);
           for (size_t n = 0; n < files.size(); n++) {
             assert (files[n].start == int64_t (lead_in_size));
-            File::GZ zf (files[n].name, "wb");
-            if (lead_in)
-              zf.write (reinterpret_cast<const char*> (lead_in.get()), lead_in_size);
-            uint8_t* address = addresses[0].get() + n*bytes_per_segment;
-            uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
-            while (address < last) {
-              zf.write (reinterpret_cast<const char*> (address), BYTES_PER_ZCALL);
-              address += BYTES_PER_ZCALL;
-              ++progress;
-            }
-            last += BYTES_PER_ZCALL;
-            zf.write (reinterpret_cast<const char*> (address), last - address);
+            File::GZBlocks::write (files[n].name, lead_in.get(), lead_in_size, 
+                addresses[0].get() + n*bytes_per_segment, bytes_per_segment,
+                "compressing image \"" + header.name() + "\"");
           }
         }
 
@@ -18,6 +18,7 @@
 
 #include "image_io/base.h"
 #include "file/mmap.h"
+#include "file/gz_blocks.h"
 
 namespace MR
 {
@@ -43,8 +44,15 @@ namespace MR
         size_t   lead_in_size;
         std::unique_ptr<uint8_t[]> lead_in;
 
+        // block index, when decompressing on demand:
+        std::unique_ptr<File::GZBlocks> blocks;
+        size_t first_block;
+
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
+        virtual void load_segment (size_t n);
+
+        bool load_on_demand (const Header& header);
     };
 
   }
@@ -16,6 +16,7 @@
 #ifndef __math_rng_h__
 #define __math_rng_h__
 
+#include <array>
 #include <random>
 #ifdef MRTRIX_WINDOWS
 #include <sys/time.h>
@@ -98,6 +99,46 @@ namespace MR
           ValueType operator() () { return dist (rng); }
       };
 
+    //! counter-based random number generator
+    /*! this implements the Philox4x32-10 generator (Salmon et al.,
+     * "Parallel random numbers: as easy as 1, 2, 3", SC 2011). Rather than
+     * advancing an internal state with each draw, it computes four 32-bit
+     * random values as a function of a 64-bit key and a 128-bit counter, so
+     * that the values for any given counter can be generated independently
+     * of all others. This can be used to provide each item of work with its
+     * own reproducible random stream (e.g. by seeding an RNG with the values
+     * obtained using the index of the item as the counter), irrespective of
+     * which thread ends up processing it. */
+    class Philox
+    {
+      public:
+        typedef std::array<uint32_t,4> counter_type;
+
+        Philox (const uint64_t key) : key ({ { uint32_t (key), uint32_t (key >> 32) } }) { }
+
+        counter_type operator() (counter_type counter) const
+        {
+          std::array<uint32_t,2> k (key);
+          for (size_t round = 0; round != 10; ++round) {
+            const uint64_t p0 = uint64_t (0xD2511F53) * counter[0];
+            const uint64_t p1 = uint64_t (0xCD9E8D57) * counter[2];
+            counter = { { uint32_t (p1 >> 32) ^ counter[1] ^ k[0], uint32_t (p1),
+                          uint32_t (p0 >> 32) ^ counter[3] ^ k[1], uint32_t (p0) } };
+            k[0] += 0x9E3779B9;
+            k[1] += 0xBB67AE85;
+          }
+          return counter;
+        }
+
+        counter_type operator() (const uint64_t counter) const {
+          return (*this) (counter_type ({ { uint32_t (counter), uint32_t (counter >> 32), 0, 0 } }));
+        }
+
+      private:
+        const std::array<uint32_t,2> key;
+    };
+
+
       template <typename ValueType>
         class RNG::Integer {
           public:
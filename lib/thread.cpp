@@ -14,6 +14,19 @@
  */
 
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+
+#ifdef __linux__
+# include <dirent.h>
+# include <pthread.h>
+# include <sched.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+#endif
 
 #include "app.h"
 #include "thread.h"
@@ -29,6 +42,257 @@ namespace MR
 
       size_t __number_of_threads = 0;
 
+
+
+      // buffers smaller than this are not worth distributing across threads:
+      constexpr size_t parallel_fill_threshold = 16 << 20;
+
+
+
+      //CONF option: NumaPolicy
+      //CONF default: none
+      //CONF How worker threads are placed on CPUs on multi-socket (NUMA)
+      //CONF systems. Set to 'none' to leave placement to the operating
+      //CONF system; 'compact' to pin each worker thread to its own CPU,
+      //CONF filling up each NUMA node in turn; or 'spread' to pin worker
+      //CONF threads to CPUs on each NUMA node in turn. When set to
+      //CONF 'compact' or 'spread', large read-only buffers (such as
+      //CONF preloaded images) are also interleaved across NUMA nodes.
+      //CONF Only supported on Linux.
+
+      class Topology {
+        public:
+          enum class Policy { none, compact, spread };
+
+          Topology () : policy (Policy::none) {
+            const std::string value = lowercase (File::Config::get ("NumaPolicy", "none"));
+            if (value == "compact")
+              policy = Policy::compact;
+            else if (value == "spread")
+              policy = Policy::spread;
+            else if (value != "none")
+              throw Exception ("invalid value \"" + value + "\" for config file entry \"NumaPolicy\" (expected none, compact or spread)");
+            if (policy == Policy::none)
+              return;
+
+#ifdef __linux__
+            cpu_set_t allowed;
+            CPU_ZERO (&allowed);
+            if (sched_getaffinity (0, sizeof (allowed), &allowed)) {
+              WARN ("unable to query CPU affinity - ignoring NumaPolicy config file entry");
+              policy = Policy::none;
+              return;
+            }
+
+            if (DIR* dir = opendir ("/sys/devices/system/node")) {
+              while (struct dirent* entry = readdir (dir)) {
+                int node;
+                if (sscanf (entry->d_name, "node%d", &node) != 1)
+                  continue;
+                std::ifstream in ("/sys/devices/system/node/" + std::string (entry->d_name) + "/cpulist");
+                std::string list;
+                std::getline (in, list);
+                std::vector<int> cpus;
+                for (const auto& range : split (list, ",", true)) {
+                  const auto bounds = split (range, "-");
+                  const int first = to<int> (bounds[0]);
+                  const int last = bounds.size() > 1 ? to<int> (bounds[1]) : first;
+                  for (int cpu = first; cpu <= last; ++cpu)
+                    if (cpu < CPU_SETSIZE && CPU_ISSET (cpu, &allowed))
+                      cpus.push_back (cpu);
+                }
+                if (cpus.size())
+                  nodes.push_back ({ node, cpus });
+              }
+              closedir (dir);
+            }
+            std::sort (nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+
+            if (nodes.empty()) {
+              // no NUMA information available - treat as a single node:
+              Node node = { 0, { } };
+              for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET (cpu, &allowed))
+                  node.cpus.push_back (cpu);
+              nodes.push_back (node);
+            }
+
+            if (policy == Policy::compact) {
+              for (const auto& node : nodes)
+                cpus.insert (cpus.end(), node.cpus.begin(), node.cpus.end());
+            }
+            else {
+              for (size_t n = 0; cpus.size() < num_cpus(); ++n)
+                for (const auto& node : nodes)
+                  if (n < node.cpus.size())
+                    cpus.push_back (node.cpus[n]);
+            }
+
+            DEBUG ("NUMA policy \"" + value + "\": " + str(nodes.size()) + " node(s), worker threads placed on CPUs " + str(cpus));
+#else
+            WARN ("NumaPolicy config file entry is only supported on Linux - ignored");
+            policy = Policy::none;
+#endif
+          }
+
+          struct Node {
+            int id;
+            std::vector<int> cpus;
+          };
+
+          Policy policy;
+          std::vector<Node> nodes;
+          // the order in which CPUs are assigned to worker threads:
+          std::vector<int> cpus;
+
+          size_t num_cpus () const {
+            size_t n = 0;
+            for (const auto& node : nodes)
+              n += node.cpus.size();
+            return n;
+          }
+
+          void set_affinity (size_t worker_index) const {
+#ifdef __linux__
+            if (policy == Policy::none || cpus.empty())
+              return;
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (cpus[worker_index % cpus.size()], &set);
+            if (pthread_setaffinity_np (pthread_self(), sizeof (set), &set))
+              DEBUG ("failed to set CPU affinity for worker thread " + str(worker_index));
+#endif
+          }
+      };
+
+      const Topology& topology ()
+      {
+        static const Topology topology;
+        return topology;
+      }
+
+
+
+
+      // Pool of worker threads, created on demand and reused until the
+      // process exits. Each worker waits on its own condition variable for
+      // a task to be assigned; once done, it returns itself to the list of
+      // idle workers. Tasks are never queued: if no worker is idle, a new
+      // one is created, since the tasks launched via Thread::run() may
+      // depend on each other to make progress.
+      class Pool {
+        public:
+          std::future<void> launch (std::function<void()>&& func) {
+            std::packaged_task<void()> task (std::move (func));
+            auto future = task.get_future();
+            std::unique_lock<std::mutex> lock (mutex);
+            if (idle.empty()) {
+              workers.push_back (std::unique_ptr<Worker> (new Worker));
+              Worker* worker = workers.back().get();
+              worker->index = workers.size() - 1;
+              worker->task = std::move (task);
+              worker->thread = std::thread (&Pool::run_worker, this, worker);
+              lock.unlock();
+              DEBUG ("created worker thread " + str(worker->index));
+            }
+            else {
+              Worker* worker = idle.back();
+              idle.pop_back();
+              worker->task = std::move (task);
+              lock.unlock();
+              worker->cond.notify_one();
+            }
+            return future;
+          }
+
+          //! stop and join all idle worker threads
+          /*! Since Thread::run() waits for its tasks to complete, all
+           * workers are normally idle by the time the process exits. A
+           * worker may still be busy if the process is terminated from
+           * within a task; such workers cannot be joined, and are instead
+           * detached. Returns false in that case, since the pool must then
+           * outlive them. */
+          bool shutdown () {
+            std::vector<Worker*> to_join;
+            bool all_idle;
+            {
+              std::lock_guard<std::mutex> lock (mutex);
+              stop = true;
+              to_join = idle;
+              all_idle = (idle.size() == workers.size());
+            }
+            for (auto worker : to_join)
+              worker->cond.notify_one();
+            for (auto& worker : workers) {
+              if (std::find (to_join.begin(), to_join.end(), worker.get()) != to_join.end()
+                  && worker->thread.get_id() != std::this_thread::get_id())
+                worker->thread.join();
+              else {
+                worker->thread.detach();
+                all_idle = false;
+              }
+            }
+            if (!all_idle) {
+              // busy workers may still access their Worker entries:
+              for (auto& worker : workers)
+                worker.release();
+            }
+            return all_idle;
+          }
+
+        private:
+          struct Worker {
+            std::packaged_task<void()> task;
+            std::condition_variable cond;
+            std::thread thread;
+            size_t index;
+          };
+
+          std::mutex mutex;
+          std::vector<std::unique_ptr<Worker>> workers;
+          std::vector<Worker*> idle;
+          bool stop = false;
+
+          void run_worker (Worker* worker) {
+            topology().set_affinity (worker->index);
+            std::unique_lock<std::mutex> lock (mutex);
+            while (true) {
+              auto task = std::move (worker->task);
+              lock.unlock();
+              task();
+              lock.lock();
+              idle.push_back (worker);
+              worker->cond.wait (lock, [this, worker] { return worker->task.valid() || stop; });
+              if (!worker->task.valid())
+                return;
+            }
+          }
+      };
+
+
+
+      // owns the pool, and shuts it down when the process exits:
+      class PoolOwner {
+        public:
+          PoolOwner () : pool (new Pool) { }
+          ~PoolOwner () {
+            if (pool->shutdown())
+              delete pool;
+          }
+          Pool* const pool;
+      };
+
+    }
+
+
+
+
+    std::future<void> __launch (std::function<void()>&& task)
+    {
+      // constructed first, so that it outlives the pool's worker threads:
+      topology();
+      static PoolOwner owner;
+      return owner.pool->launch (std::move (task));
     }
 
     //CONF option: NumberOfThreads
@@ -47,6 +311,69 @@ namespace MR
 
 
 
+    void zero_fill (void* address, size_t size)
+    {
+      interleave_memory (address, size);
+
+      const size_t nthreads = number_of_threads();
+      if (size < parallel_fill_threshold || nthreads < 2) {
+        memset (address, 0, size);
+        return;
+      }
+
+      // split into page-aligned blocks, one per thread:
+      const size_t block = ((size / nthreads + 4095) / 4096) * 4096;
+      std::atomic<size_t> next (0);
+      struct Filler {
+        uint8_t* data;
+        size_t size, block;
+        std::atomic<size_t>& next;
+        void execute () {
+          const size_t start = block * next++;
+          if (start < size)
+            memset (data + start, 0, std::min (block, size - start));
+        }
+      } filler = { static_cast<uint8_t*> (address), size, block, next };
+
+      run (multi (filler, nthreads), "zero fill").wait();
+    }
+
+
+
+
+    void interleave_memory (void* address, size_t size)
+    {
+#ifdef __linux__
+      const auto& numa = topology();
+      if (numa.policy == Topology::Policy::none || numa.nodes.size() < 2 || size < parallel_fill_threshold)
+        return;
+
+      // the page-aligned part of the buffer:
+      const size_t page = sysconf (_SC_PAGESIZE);
+      const uintptr_t start = ((reinterpret_cast<uintptr_t> (address) + page - 1) / page) * page;
+      const uintptr_t end = ((reinterpret_cast<uintptr_t> (address) + size) / page) * page;
+      if (end <= start)
+        return;
+
+      constexpr size_t max_nodes = 1024;
+      constexpr size_t bits_per_word = 8 * sizeof (unsigned long);
+      unsigned long mask[max_nodes / bits_per_word] = { };
+      for (const auto& node : numa.nodes)
+        if (node.id >= 0 && size_t (node.id) < max_nodes)
+          mask[node.id / bits_per_word] |= 1UL << (node.id % bits_per_word);
+
+      const int MPOL_INTERLEAVE = 3;
+      if (syscall (SYS_mbind, start, end - start, MPOL_INTERLEAVE, mask, max_nodes + 1, 0)) {
+        DEBUG ("unable to interleave memory across NUMA nodes: " + std::string (strerror (errno)));
+      } else {
+        DEBUG ("interleaving " + str(end - start) + " bytes across " + str(numa.nodes.size()) + " NUMA nodes");
+      }
+#endif
+    }
+
+
+
+
 
     void (*__Backend::previous_print_func) (const std::string& msg) = nullptr;
     void (*__Backend::previous_report_to_user_func) (const std::string& msg, int type) = nullptr;
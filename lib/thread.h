@@ -18,6 +18,7 @@
 
 #include <thread>
 #include <future>
+#include <functional>
 #include <mutex>
 
 #include "debug.h"
@@ -91,6 +92,17 @@ namespace MR
     };
 
 
+    //! run \a task on a thread from the persistent pool of worker threads
+    /*! Worker threads are created on demand and kept alive until the
+     * process exits (at which point they are joined), so that they can be
+     * reused by subsequent calls to Thread::run(), rather than creating and
+     * destroying a new set of threads each time. A worker is always
+     * available immediately: if all existing workers are busy, a new one is
+     * created. This is used internally by Thread::run(), and should not
+     * normally be invoked directly. */
+    std::future<void> __launch (std::function<void()>&& task);
+
+
     namespace {
 
       class __thread_base {
@@ -113,7 +125,8 @@ namespace MR
             __thread_base (name) { 
               DEBUG ("launching thread \"" + name + "\"...");
               typedef typename std::remove_reference<Functor>::type F;
-              thread = std::async (std::launch::async, &F::execute, &functor);
+              F* f = &functor;
+              thread = __launch ([f] { f->execute(); });
             }
           __single_thread (const __single_thread&) = delete;
           __single_thread (__single_thread&&) = default;
@@ -144,9 +157,12 @@ namespace MR
                 DEBUG ("launching " + str (nthreads) + " threads \"" + name + "\"...");
                 typedef typename std::remove_reference<Functor>::type F;
                 threads.reserve (nthreads);
-                for (auto& f : functors) 
-                  threads.push_back (std::async (std::launch::async, &F::execute, &f));
-                threads.push_back (std::async (std::launch::async, &F::execute, &functor));
+                for (auto& f : functors) {
+                  F* p = &f;
+                  threads.push_back (__launch ([p] { p->execute(); }));
+                }
+                F* p = &functor;
+                threads.push_back (__launch ([p] { p->execute(); }));
               }
 
             __multi_thread (const __multi_thread&) = delete;
@@ -243,6 +259,26 @@ namespace MR
     size_t number_of_threads ();
 
 
+    //! zero-fill a newly allocated buffer
+    /*! Large buffers are zeroed in parallel using the worker threads, to
+     * make better use of the available memory bandwidth; small buffers are
+     * simply zeroed in the calling thread. Since the threads that will
+     * subsequently process the data are not known at this point, no attempt
+     * is made to place pages on the nodes of their eventual users: instead,
+     * the pages are interleaved across NUMA nodes where supported (see
+     * interleave_memory()), so that no single memory controller needs to
+     * service all subsequent accesses. */
+    void zero_fill (void* address, size_t size);
+
+    //! request that the pages of a large buffer be interleaved across NUMA nodes
+    /*! This is intended for large buffers that will be shared read-only by
+     * all threads (e.g. preloaded input images), for which there is no
+     * preferred node. It must be invoked before the buffer is first written
+     * to, and only has an effect on Linux systems with more than one NUMA
+     * node when the NumaPolicy config file entry is set. */
+    void interleave_memory (void* address, size_t size);
+
+
 
     //! used to request multiple threads of the corresponding functor
     /*! This function is used in combination with Thread::run or
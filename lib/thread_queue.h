@@ -18,6 +18,7 @@
 #define __mrtrix_thread_queue_h__
 
 #include <stack>
+#include <atomic>
 #include <condition_variable>
 
 #include "memory.h"
@@ -360,32 +361,33 @@ namespace MR
          * MRTRIX_QUEUE_DEFAULT_CAPACITY items.
          */
         Queue (const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
+#ifdef MRTRIX_LOCKFREE_QUEUE
+          queued (buffer_size),
+          recycled (2 * buffer_size),
+          writers_waiting (0),
+          readers_waiting (0),
+#else
           buffer (new T* [buffer_size]),
           front (buffer),
           back (buffer),
           capacity (buffer_size),
+#endif
           writer_count (0),
           reader_count (0),
           name (description) {
-          assert (capacity > 0);
+          assert (buffer_size > 0);
         }
 
         //! needed for Thread::run_queue()
         Queue (const T& /*item_type*/, const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
-          buffer (new T* [buffer_size]),
-          front (buffer),
-          back (buffer),
-          capacity (buffer_size),
-          writer_count (0),
-          reader_count (0),
-          name (description) {
-          assert (capacity > 0);
-        }
+          Queue (description, buffer_size) { }
 
 
+#ifndef MRTRIX_LOCKFREE_QUEUE
         ~Queue () {
           delete [] buffer;
         }
+#endif
 
         //! This class is used to register a writer with the queue
         /*! Items cannot be written directly onto a Thread::Queue queue. An
@@ -522,6 +524,213 @@ namespace MR
             Queue<T>& Q;
         };
 
+#ifdef MRTRIX_LOCKFREE_QUEUE
+
+        //! Print out a status report for debugging purposes
+        void status () {
+          std::lock_guard<std::mutex> lock (mutex);
+          std::cerr << "Thread::Queue \"" + name + "\" (lock-free): "
+                    << writer_count << " writer" << (writer_count > 1 ? "s" : "") << ", "
+                    << reader_count << " reader" << (reader_count > 1 ? "s" : "") << ", items waiting: " << queued.size() << "\n";
+        }
+
+
+      private:
+        // bounded multi-producer / multi-consumer ring buffer of pointers,
+        // after D. Vyukov: each cell holds a sequence number indicating
+        // whether it is ready to be written or read for the current lap of
+        // the ring, so that producers and consumers only contend on a single
+        // atomic compare-and-swap of their respective position counters.
+        class Ring {
+          public:
+            Ring (size_t min_size) : mask (1) {
+              while (mask < min_size)
+                mask <<= 1;
+              cells.reset (new Cell [mask]);
+              for (size_t n = 0; n < mask; ++n)
+                cells[n].sequence.store (n, std::memory_order_relaxed);
+              --mask;
+              enqueue_pos.store (0, std::memory_order_relaxed);
+              dequeue_pos.store (0, std::memory_order_relaxed);
+            }
+
+            FORCE_INLINE bool push (T* item) {
+              Cell* cell;
+              size_t pos = enqueue_pos.load (std::memory_order_relaxed);
+              while (true) {
+                cell = &cells[pos & mask];
+                const ssize_t diff = ssize_t (cell->sequence.load (std::memory_order_acquire)) - ssize_t (pos);
+                if (diff == 0) {
+                  if (enqueue_pos.compare_exchange_weak (pos, pos+1, std::memory_order_relaxed))
+                    break;
+                }
+                else if (diff < 0)
+                  return false;
+                else
+                  pos = enqueue_pos.load (std::memory_order_relaxed);
+              }
+              cell->data = item;
+              cell->sequence.store (pos+1, std::memory_order_release);
+              return true;
+            }
+
+            FORCE_INLINE bool pop (T*& item) {
+              Cell* cell;
+              size_t pos = dequeue_pos.load (std::memory_order_relaxed);
+              while (true) {
+                cell = &cells[pos & mask];
+                const ssize_t diff = ssize_t (cell->sequence.load (std::memory_order_acquire)) - ssize_t (pos+1);
+                if (diff == 0) {
+                  if (dequeue_pos.compare_exchange_weak (pos, pos+1, std::memory_order_relaxed))
+                    break;
+                }
+                else if (diff < 0)
+                  return false;
+                else
+                  pos = dequeue_pos.load (std::memory_order_relaxed);
+              }
+              item = cell->data;
+              cell->sequence.store (pos+mask+1, std::memory_order_release);
+              return true;
+            }
+
+            size_t size () const {
+              return enqueue_pos.load (std::memory_order_relaxed) - dequeue_pos.load (std::memory_order_relaxed);
+            }
+            bool empty () const { return size() == 0; }
+            bool full () const { return size() > mask; }
+
+          private:
+            class Cell {
+              public:
+                std::atomic<size_t> sequence;
+                T* data;
+            };
+            std::unique_ptr<Cell[]> cells;
+            size_t mask;
+            // keep the producer & consumer positions on separate cache lines:
+            char pad0[64];
+            std::atomic<size_t> enqueue_pos;
+            char pad1[64];
+            std::atomic<size_t> dequeue_pos;
+            char pad2[64];
+        };
+
+        // the mutex & condition variables are only used when a thread needs
+        // to block, or on the rare occasions that new items are allocated:
+        std::mutex mutex;
+        std::condition_variable more_data, more_space;
+        Ring queued, recycled;
+        std::atomic<size_t> writers_waiting, readers_waiting;
+        std::atomic<size_t> writer_count, reader_count;
+        std::stack<T*,std::vector<T*> > item_stack;
+        std::vector<std::unique_ptr<T>> items;
+        std::string name;
+
+        Queue (const Queue&) = delete;
+        Queue& operator= (const Queue&) = delete;
+
+        void register_writer ()   { ++writer_count; }
+        void unregister_writer () {
+          assert (writer_count);
+          if (!--writer_count) {
+            DEBUG ("no writers left on queue \"" + name + "\"");
+            std::lock_guard<std::mutex> lock (mutex);
+            more_data.notify_all();
+          }
+        }
+        void register_reader ()   { ++reader_count; }
+        void unregister_reader () {
+          assert (reader_count);
+          if (!--reader_count) {
+            DEBUG ("no readers left on queue \"" + name + "\"");
+            std::lock_guard<std::mutex> lock (mutex);
+            more_space.notify_all();
+          }
+        }
+
+        FORCE_INLINE T* get_item () {
+          T* item;
+          if (recycled.pop (item))
+            return item;
+          std::lock_guard<std::mutex> lock (mutex);
+          if (item_stack.size()) {
+            item = item_stack.top();
+            item_stack.pop();
+            return item;
+          }
+          item = new T;
+          items.push_back (std::unique_ptr<T> (item));
+          return item;
+        }
+
+        FORCE_INLINE void recycle (T* item) {
+          if (recycled.push (item))
+            return;
+          std::lock_guard<std::mutex> lock (mutex);
+          item_stack.push (item);
+        }
+
+        // spin briefly, then block until woken up by the other side. The
+        // fence pairs with that in wake(): either the waker sees this thread
+        // as waiting (and notifies it under the mutex), or this thread sees
+        // the state the waker published before checking, so no wakeup is lost:
+        template <class Condition>
+          void wait (size_t& attempts, std::condition_variable& cond, std::atomic<size_t>& waiting, Condition&& ready) {
+            if (attempts++ < 64) {
+              std::this_thread::yield();
+              return;
+            }
+            std::unique_lock<std::mutex> lock (mutex);
+            ++waiting;
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            cond.wait (lock, ready);
+            --waiting;
+          }
+
+        FORCE_INLINE void wake (std::condition_variable& cond, std::atomic<size_t>& waiting) {
+          std::atomic_thread_fence (std::memory_order_seq_cst);
+          if (waiting.load (std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock (mutex);
+            cond.notify_one();
+          }
+        }
+
+        FORCE_INLINE bool push (T*& item) {
+          size_t attempts = 0;
+          while (true) {
+            if (!reader_count)
+              return false;
+            if (queued.push (item))
+              break;
+            wait (attempts, more_space, writers_waiting, [this]{ return !queued.full() || !reader_count; });
+          }
+          wake (more_data, readers_waiting);
+          item = get_item();
+          return true;
+        }
+
+        FORCE_INLINE bool pop (T*& item) {
+          if (item)
+            recycle (item);
+          item = nullptr;
+          size_t attempts = 0;
+          while (!queued.pop (item)) {
+            if (!writer_count) {
+              // last writer may have pushed its final item just before
+              // unregistering:
+              if (queued.pop (item))
+                break;
+              return false;
+            }
+            wait (attempts, more_data, readers_waiting, [this]{ return !queued.empty() || !writer_count; });
+          }
+          wake (more_space, writers_waiting);
+          return true;
+        }
+
+#else
+
         //! Print out a status report for debugging purposes
         void status () {
           std::lock_guard<std::mutex> lock (mutex);
@@ -627,6 +836,8 @@ namespace MR
           if (p >= buffer + capacity) p = buffer;
           return p;
         }
+
+#endif
     };
 
 
@@ -46,7 +46,7 @@ namespace MR {
           ++min_linkage;
           std::vector<dir_t> next_to_expand;
           for (const auto& i : to_expand) {
-            for (const auto& j : adj_dirs[i]) {
+            for (const auto& j : get_adj_dirs (i)) {
               if (j == two) {
                 return min_linkage;
               } else if (!processed[j]) {
@@ -81,7 +81,9 @@ namespace MR {
 
       void Set::initialise_adjacency()
       {
-        adj_dirs.assign (size(), std::vector<dir_t>());
+        // Adjacency lists are first built per direction, then packed into
+        //   contiguous storage once complete
+        std::vector<std::vector<dir_t>> adjacency (size());
 
         // New algorithm for determining direction adjacency
         // * Duplicate all directions to get a full spherical set
@@ -288,19 +290,26 @@ namespace MR {
               case 5: from = vertices[current.indices[2]].index; to = vertices[current.indices[0]].index; break;
             }
             bool found = false;
-            for (auto i : adj_dirs[from]) {
+            for (auto i : adjacency[from]) {
               if (i == to) {
                 found = true;
                 break;
               }
             }
             if (!found)
-              adj_dirs[from].push_back (to);
+              adjacency[from].push_back (to);
           }
         }
 
-        for (auto& i : adj_dirs)
+        adj_offsets.assign (size() + 1, 0);
+        for (size_t i = 0; i != size(); ++i)
+          adj_offsets[i+1] = adj_offsets[i] + adjacency[i].size();
+        adj_dirs.clear();
+        adj_dirs.reserve (adj_offsets.back());
+        for (auto& i : adjacency) {
           std::sort (i.begin(), i.end());
+          adj_dirs.insert (adj_dirs.end(), i.begin(), i.end());
+        }
       }
 
       void Set::initialise_mask()
@@ -364,9 +373,9 @@ namespace MR {
         double adj_dot_product_sum = 0.0;
         size_t adj_dot_product_count = 0;
         for (size_t i = 0; i != size(); ++i) {
-          for (std::vector<dir_t>::const_iterator j = adj_dirs[i].begin(); j != adj_dirs[i].end(); ++j) {
-            if (*j > i) {
-              adj_dot_product_sum += std::abs (unit_vectors[i].dot (unit_vectors[*j]));
+          for (const auto j : get_adj_dirs (i)) {
+            if (j > i) {
+              adj_dot_product_sum += std::abs (unit_vectors[i].dot (unit_vectors[j]));
               ++adj_dot_product_count;
             }
           }
@@ -424,7 +433,7 @@ namespace MR {
           const size_t num_to_expand = this_grid.size();
           for (size_t index_to_expand = 0; index_to_expand != num_to_expand; ++index_to_expand) {
             const dir_t dir_to_expand = this_grid[index_to_expand];
-            for (std::vector<dir_t>::const_iterator adj = get_adj_dirs(dir_to_expand).begin(); adj != get_adj_dirs(dir_to_expand).end(); ++adj) {
+            for (const dir_t* adj = get_adj_dirs(dir_to_expand).begin(); adj != get_adj_dirs(dir_to_expand).end(); ++adj) {
 
               // Size of lookup tables could potentially be reduced by being more prohibitive of adjacent direction inclusion in the lookup table for this grid
 
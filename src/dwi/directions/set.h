@@ -37,6 +37,21 @@ namespace MR {
 
 
 
+      // Lightweight view of the directions adjacent to a particular direction,
+      //   as stored contiguously within the Set
+      class AdjacentDirs {
+        public:
+          AdjacentDirs (const dir_t* first, const dir_t* last) : first (first), last (last) { }
+          const dir_t* begin() const { return first; }
+          const dir_t* end() const { return last; }
+          size_t size() const { return last - first; }
+          dir_t operator[] (const size_t i) const { assert (first + i < last); return first[i]; }
+        private:
+          const dir_t* first;
+          const dir_t* last;
+      };
+
+
       class Set {
 
         public:
@@ -69,6 +84,7 @@ namespace MR {
           Set (Set&& that) :
               unit_vectors (std::move (that.unit_vectors)),
               adj_dirs (std::move (that.adj_dirs)),
+              adj_offsets (std::move (that.adj_offsets)),
               dir_mask_bytes (that.dir_mask_bytes),
               dir_mask_excess_bits (that.dir_mask_excess_bits),
               dir_mask_excess_bits_mask (that.dir_mask_excess_bits_mask)
@@ -88,10 +104,13 @@ namespace MR {
 
           size_t size () const { return unit_vectors.size(); }
           const Eigen::Vector3f& get_dir (const size_t i) const { return unit_vectors[i]; }
-          const std::vector<dir_t>& get_adj_dirs (const size_t i) const { return adj_dirs[i]; }
+          AdjacentDirs get_adj_dirs (const size_t i) const {
+            assert (i < size());
+            return AdjacentDirs (adj_dirs.data() + adj_offsets[i], adj_dirs.data() + adj_offsets[i+1]);
+          }
 
           bool dirs_are_adjacent (const dir_t one, const dir_t two) const {
-            for (const auto& i : adj_dirs[one]) {
+            for (const auto& i : get_adj_dirs (one)) {
               if (i == two)
                 return true;
             }
@@ -108,7 +127,10 @@ namespace MR {
 
           // TODO Change to double
           std::vector<Eigen::Vector3f> unit_vectors;
-          std::vector< std::vector<dir_t> > adj_dirs; // Note: not self-inclusive
+          // Adjacency is stored in compressed sparse row form: the directions adjacent
+          //   to direction i are adj_dirs[adj_offsets[i]] to adj_dirs[adj_offsets[i+1]-1]
+          std::vector<dir_t> adj_dirs; // Note: not self-inclusive
+          std::vector<size_t> adj_offsets;
 
 
         private:
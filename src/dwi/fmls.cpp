@@ -18,6 +18,9 @@
 
 #include "dwi/fmls.h"
 
+#include <algorithm>
+#include <limits>
+
 
 
 namespace MR {
@@ -177,11 +180,6 @@ namespace MR {
 
 
 
-      class Max_abs {
-        public:
-          bool operator() (const default_type& a, const default_type& b) const { return (std::abs (a) > std::abs (b)); }
-      };
-
       bool Segmenter::operator() (const SH_coefs& in, FOD_lobes& out) const {
 
         assert (in.size() == ssize_t (Math::SH::NforL (lmax)));
@@ -194,36 +192,94 @@ namespace MR {
 
         Eigen::Matrix<default_type, Eigen::Dynamic, 1> values (dirs.size());
         transform->SH2A (values, in);
+        segment (in, values, out);
+        return true;
 
-        typedef std::multimap<default_type, dir_t, Max_abs> map_type;
-        map_type data_in_order;
-        for (size_t i = 0; i != size_t(values.size()); ++i)
-          data_in_order.insert (std::make_pair (values[i], i));
+      }
+
+
+
+      bool Segmenter::operator() (const std::vector<SH_coefs>& in, std::vector<FOD_lobes>& out) const {
+
+        const size_t num_coefs = Math::SH::NforL (lmax);
+        out.resize (in.size());
 
-        if (data_in_order.begin()->first <= 0.0)
+        // Voxels with no FOD are excluded from the matrix product
+        std::vector<size_t> to_segment;
+        for (size_t i = 0; i != in.size(); ++i) {
+          assert (in[i].size() == ssize_t (num_coefs));
+          out[i].clear();
+          out[i].vox = in[i].vox;
+          if (in[i][0] > 0.0 && std::isfinite (in[i][0]))
+            to_segment.push_back (i);
+        }
+        if (to_segment.empty())
           return true;
 
+        Eigen::Matrix<default_type, Eigen::Dynamic, Eigen::Dynamic> coefs (num_coefs, to_segment.size());
+        for (size_t i = 0; i != to_segment.size(); ++i)
+          coefs.col (i) = in[to_segment[i]];
+        const Eigen::Matrix<default_type, Eigen::Dynamic, Eigen::Dynamic> amplitudes (transform->mat_SH2A() * coefs);
+
+        Eigen::Matrix<default_type, Eigen::Dynamic, 1> values (dirs.size());
+        for (size_t i = 0; i != to_segment.size(); ++i) {
+          values = amplitudes.col (i);
+          segment (in[to_segment[i]], values, out[to_segment[i]]);
+        }
+        return true;
+
+      }
+
+
+
+      void Segmenter::segment (const SH_coefs& in, const Eigen::Matrix<default_type, Eigen::Dynamic, 1>& values, FOD_lobes& out) const {
+
+        // Amplitudes cannot be ordered if any are non-finite
+        if (!values.allFinite())
+          return;
+
+        // Process directions in order of decreasing absolute amplitude; ties are
+        //   broken by direction index, so that the order is fully deterministic
+        std::vector< std::pair<default_type, dir_t> > data_in_order;
+        data_in_order.reserve (values.size());
+        for (size_t i = 0; i != size_t(values.size()); ++i)
+          data_in_order.push_back (std::make_pair (values[i], dir_t(i)));
+        std::sort (data_in_order.begin(), data_in_order.end(),
+            [] (const std::pair<default_type, dir_t>& a, const std::pair<default_type, dir_t>& b) {
+              const default_type abs_a = std::abs (a.first), abs_b = std::abs (b.first);
+              return (abs_a > abs_b) || (abs_a == abs_b && a.second < b.second);
+            });
+
+        if (data_in_order.front().first <= 0.0)
+          return;
+
         std::vector< std::pair<dir_t, uint32_t> > retrospective_assignments;
 
-        for (const auto& i : data_in_order) {
+        // Index of the lobe to which each direction has been assigned; this avoids
+        //   having to test every existing lobe for adjacency to each new direction
+        const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> dir_lobes (dirs.size(), unassigned);
 
-          std::vector<uint32_t> adj_lobes;
-          for (uint32_t l = 0; l != out.size(); ++l) {
-            if ((((i.first <= 0.0) &&  out[l].is_negative())
-                  || ((i.first >  0.0) && !out[l].is_negative()))
-                && (out[l].get_mask().is_adjacent (i.second))) {
+        std::vector<uint32_t> adj_lobes;
+        for (const auto& i : data_in_order) {
 
+          adj_lobes.clear();
+          for (const auto d : dirs.get_adj_dirs (i.second)) {
+            const uint32_t l = dir_lobes[d];
+            if (l != unassigned && (i.first <= 0.0) == out[l].is_negative())
               adj_lobes.push_back (l);
-
-            }
           }
+          std::sort (adj_lobes.begin(), adj_lobes.end());
+          adj_lobes.erase (std::unique (adj_lobes.begin(), adj_lobes.end()), adj_lobes.end());
 
           if (adj_lobes.empty()) {
 
+            dir_lobes[i.second] = out.size();
             out.push_back (FOD_lobe (dirs, i.second, i.first, (*weights)[i.second]));
 
           } else if (adj_lobes.size() == 1) {
 
+            dir_lobes[i.second] = adj_lobes.front();
             out[adj_lobes.front()].add (i.second, i.first, (*weights)[i.second]);
 
           } else {
@@ -233,7 +289,6 @@ namespace MR {
             //   contents of retrospective_assignments accordingly
             if (std::abs (i.first) / out[adj_lobes.back()].get_max_peak_value() > ratio_of_peak_value_to_merge) {
 
-              std::sort (adj_lobes.begin(), adj_lobes.end());
               for (size_t j = 1; j != adj_lobes.size(); ++j)
                 out[adj_lobes[0]].merge (out[adj_lobes[j]]);
               out[adj_lobes[0]].add (i.second, i.first, (*weights)[i.second]);
@@ -255,6 +310,21 @@ namespace MR {
                   j->second = lobe_index;
                 }
               }
+              dir_lobes[i.second] = adj_lobes[0];
+              for (auto& j : dir_lobes) {
+                if (j == unassigned || j < adj_lobes[1])
+                  continue;
+                if (std::binary_search (adj_lobes.begin() + 1, adj_lobes.end(), j)) {
+                  j = adj_lobes[0];
+                } else {
+                  uint32_t lobe_index = j;
+                  for (size_t k = adj_lobes.size() - 1; k; --k) {
+                    if (adj_lobes[k] < lobe_index)
+                      --lobe_index;
+                  }
+                  j = lobe_index;
+                }
+              }
               for (size_t j = adj_lobes.size() - 1; j; --j) {
                 std::vector<FOD_lobe>::iterator ptr = out.begin();
                 advance (ptr, adj_lobes[j]);
@@ -331,7 +401,7 @@ namespace MR {
 
               for (dir_t dir = 0; dir != dirs.size(); ++dir) {
                 if (!processed[dir]) {
-                  for (std::vector<dir_t>::const_iterator neighbour = dirs.get_adj_dirs (dir).begin(); neighbour != dirs.get_adj_dirs (dir).end(); ++neighbour) {
+                  for (const dir_t* neighbour = dirs.get_adj_dirs (dir).begin(); neighbour != dirs.get_adj_dirs (dir).end(); ++neighbour) {
                     if (processed[*neighbour])
                       new_assignments[dir].push_back (out.lut[*neighbour]);
                   }
@@ -374,8 +444,6 @@ namespace MR {
           out.push_back (FOD_lobe (null_mask));
         }
 
-        return true;
-
       }
 
 
@@ -18,7 +18,6 @@
 #ifndef __dwi_fmls_h__
 #define __dwi_fmls_h__
 
-#include <map> // Used for sorting FOD samples
 
 #include "memory.h"
 #include "math/SH.h"
@@ -34,6 +33,7 @@
 #define FMLS_RATIO_TO_NEGATIVE_LOBE_MEAN_PEAK_DEFAULT 1.0 // Peak amplitude needs to be greater than the mean negative peak
 #define FMLS_PEAK_VALUE_THRESHOLD 0.1 // Throw out anything that's below the CSD regularisation threshold
 #define FMLS_RATIO_TO_PEAK_VALUE_DEFAULT 1.0 // By default, turn all peaks into lobes (discrete peaks are never merged)
+#define FMLS_BATCH_SIZE 128 // Number of voxels for which the SH -> amplitude transform is performed as a single matrix product
 
 
 // By default, the mean direction of each FOD lobe is calculated by taking a weighted average of the
@@ -206,6 +206,9 @@ namespace MR
                 if (!mask.value())
                   ++loop;
               } while (loop && !mask.value());
+              // The final voxel(s) of the image may be outside the mask
+              if (!loop)
+                return false;
             }
             assign_pos_of (fod).to (out.vox);
             out.resize (fod.size (3));
@@ -215,6 +218,18 @@ namespace MR
             return true;
           }
 
+          // Provide voxels in batches of up to FMLS_BATCH_SIZE, for use with
+          //   the batched Segmenter::operator()
+          bool operator() (std::vector<SH_coefs>& out)
+          {
+            out.resize (FMLS_BATCH_SIZE);
+            size_t count = 0;
+            while (count != FMLS_BATCH_SIZE && (*this) (out[count]))
+              ++count;
+            out.resize (count);
+            return count;
+          }
+
         private:
           FODImageType fod;
           MaskImageType mask;
@@ -245,6 +260,11 @@ namespace MR
 
           bool operator() (const SH_coefs&, FOD_lobes&) const;
 
+          // Segment a batch of voxels; the transformation from SH coefficients to
+          //   amplitudes is performed for all voxels in the batch as a single
+          //   matrix-matrix product, rather than one matrix-vector product per voxel
+          bool operator() (const std::vector<SH_coefs>&, std::vector<FOD_lobes>&) const;
+
 
           default_type get_ratio_to_negative_lobe_integral  ()               const { return ratio_to_negative_lobe_integral; }
           void         set_ratio_to_negative_lobe_integral  (const default_type i) { ratio_to_negative_lobe_integral = i; }
@@ -281,6 +301,8 @@ namespace MR
           bool         dilate_lookup_table; // If this is set, the lookup table created for each voxel will be dilated so that all directions correspond to the nearest positive non-zero FOD lobe
 
 
+          void segment (const SH_coefs&, const Eigen::Matrix<default_type, Eigen::Dynamic, 1>&, FOD_lobes&) const;
+
           void verify_settings() const
           {
             if (create_null_lobe && dilate_lookup_table)
@@ -72,9 +72,12 @@ namespace MR
           }
           Model (const Model& that) = delete;
 
-          virtual ~Model ();
 
 
+          // Store the streamline contributions in a temporary file rather than in RAM;
+          //   must be invoked before map_streamlines()
+          void set_out_of_core() { contributions.set_out_of_core(); }
+
           // Over-rides the function defined in ModelBase; need to build contributions member also
           void map_streamlines (const std::string&);
 
@@ -93,7 +96,7 @@ namespace MR
 
         protected:
           std::string tck_file_path;
-          std::vector<TrackContribution*> contributions;
+          TrackContributions contributions;
 
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
@@ -112,11 +115,13 @@ namespace MR
               MappedTrackReceiver (Model& i) :
                 master (i),
                 mutex (new std::mutex),
+                appender (master.contributions),
                 TD_sum (0.0),
                 fixel_TDs (master.fixels.size(), 0.0) { }
               MappedTrackReceiver (const MappedTrackReceiver& that) :
                 master (that.master),
                 mutex (that.mutex),
+                appender (that.appender),
                 TD_sum (0.0),
                 fixel_TDs (master.fixels.size(), 0.0) { }
               ~MappedTrackReceiver();
@@ -124,6 +129,8 @@ namespace MR
             private:
               Model& master;
               std::shared_ptr<std::mutex> mutex;
+              TrackContributions::Appender appender;
+              std::vector<Track_fixel_contribution> masked_contributions;
               double TD_sum;
               std::vector<double> fixel_TDs;
           };
@@ -146,20 +153,6 @@ namespace MR
 
 
 
-      template <class Fixel>
-      Model<Fixel>::~Model ()
-      {
-        for (std::vector<TrackContribution*>::iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i) {
-            delete *i;
-            *i = nullptr;
-          }
-        }
-      }
-
-
-
-
       template <class Fixel>
       void Model<Fixel>::map_streamlines (const std::string& path)
       {
@@ -170,32 +163,33 @@ namespace MR
         if (!count)
           throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
-        contributions.assign (count, nullptr);
+        contributions.assign (count);
 
         {
-          Mapping::TrackLoader loader (file, count);
+          Mapping::ParallelTrackLoader loader (file, count);
           Mapping::TrackMapperBase mapper (Fixel_map<Fixel>::header(), dirs);
           mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
           mapper.set_use_precise_mapping (true);
           MappedTrackReceiver receiver (*this);
           Thread::run_queue (
-              loader,
+              Thread::multi (loader),
               Thread::batch (Tractography::Streamline<>()),
               Thread::multi (mapper),
               Thread::batch (Mapping::SetDixel()),
               Thread::multi (receiver));
         }
+        contributions.finalise();
 
-        if (!contributions.back()) {
+        if (!contributions.exists (contributions.size() - 1)) {
           track_t num_tracks = 0, max_index = 0;
           for (track_t i = 0; i != contributions.size(); ++i) {
-            if (contributions[i]) {
+            if (contributions.exists (i)) {
               ++num_tracks;
               max_index = std::max (max_index, i);
             }
-            WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
-            contributions.resize (max_index + 1);
           }
+          WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
+          contributions.resize (max_index + 1);
         }
 
         tck_file_path = path;
@@ -252,7 +246,7 @@ namespace MR
 
         fixels.swap (new_fixels);
 
-        TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
+        TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions, "Removing excluded fixels");
         FixelRemapper remapper (*this, fixel_index_mapping);
         Thread::run_queue (writer, TrackIndexRange(), Thread::multi (remapper));
 
@@ -282,9 +276,9 @@ namespace MR
         VAR (sum_from_fixels);
         VAR (sum_from_fixels_weighted);
         double sum_from_tracks = 0.0;
-        for (std::vector<TrackContribution*>::const_iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i)
-            sum_from_tracks += (*i)->get_total_contribution();
+        for (track_t i = 0; i != contributions.size(); ++i) {
+          if (contributions.exists (i))
+            sum_from_tracks += contributions[i].get_total_contribution();
         }
         VAR (sum_from_tracks);
       }
@@ -303,12 +297,13 @@ namespace MR
         ProgressBar progress ("Writing non-contributing streamlines output file", contributions.size());
         track_t tck_counter = 0;
         while (reader (tck) && tck_counter < contributions.size()) {
-          if (contributions[tck_counter] && !contributions[tck_counter++]->get_total_contribution())
+          if (contributions.exists (tck_counter) && !contributions[tck_counter++].get_total_contribution())
             writer (tck);
           else
             writer (null_tck);
           ++progress;
         }
+        writer.finalise();
         reader.close();
       }
 
@@ -336,12 +331,12 @@ namespace MR
 
         if (in.index >= master.contributions.size())
           throw Exception ("Received mapped streamline beyond the expected number of streamlines (run tckfixcount on your .tck file!)");
-        if (master.contributions[in.index])
+        if (master.contributions.exists (in.index))
           throw Exception ("FIXME: Same streamline has been mapped multiple times! (?)");
 
         try {
 
-          std::vector<Track_fixel_contribution> masked_contributions;
+          masked_contributions.clear();
           double total_contribution = 0.0, total_length = 0.0;
 
           for (Mapping::SetDixel::const_iterator i = in.begin(); i != in.end(); ++i) {
@@ -359,7 +354,7 @@ namespace MR
             }
           }
 
-          master.contributions[in.index] = new TrackContribution (masked_contributions, total_contribution, total_length);
+          appender (in.index, masked_contributions, total_contribution, total_length);
 
           TD_sum += total_contribution;
           for (std::vector<Track_fixel_contribution>::const_iterator i = masked_contributions.begin(); i != masked_contributions.end(); ++i)
@@ -381,8 +376,8 @@ namespace MR
       bool Model<Fixel>::FixelRemapper::operator() (const TrackIndexRange& in)
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
-          if (master.contributions[track_index]) {
-            TrackContribution& this_cont (*master.contributions[track_index]);
+          if (master.contributions.exists (track_index)) {
+            const TrackContribution this_cont (master.contributions[track_index]);
             std::vector<Track_fixel_contribution> new_cont;
             double total_contribution = 0.0;
             for (size_t i = 0; i != this_cont.dim(); ++i) {
@@ -392,9 +387,7 @@ namespace MR
                 total_contribution += this_cont[i].get_length() * master[new_index].get_weight();
               }
             }
-            TrackContribution* new_contribution = new TrackContribution (new_cont, total_contribution, this_cont.get_total_length());
-            delete master.contributions[track_index];
-            master.contributions[track_index] = new_contribution;
+            master.contributions.replace (track_index, new_cont, total_contribution);
           }
         }
         return true;
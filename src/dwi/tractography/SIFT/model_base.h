@@ -151,6 +151,13 @@ namespace MR
 
             virtual bool operator() (const FMLS::FOD_lobes& in);
             virtual bool operator() (const Mapping::SetDixel& in);
+            bool operator() (const std::vector<FMLS::FOD_lobes>& in) {
+              for (const auto& i : in) {
+                if (!(*this) (i))
+                  return false;
+              }
+              return true;
+            }
 
             double calc_cost_function() const;
 
@@ -200,7 +207,7 @@ namespace MR
           DWI::FMLS::Segmenter fmls (dirs, Math::SH::LforN (data.size(3)));
           fmls.set_dilate_lookup_table (!App::get_options ("no_dilate_lut").size());
           fmls.set_create_null_lobe (App::get_options ("make_null_lobes").size());
-          Thread::run_queue (writer, Thread::batch (FMLS::SH_coefs()), Thread::multi (fmls), Thread::batch (FMLS::FOD_lobes()), *this);
+          Thread::run_queue (writer, std::vector<FMLS::SH_coefs>(), Thread::multi (fmls), std::vector<FMLS::FOD_lobes>(), *this);
           have_null_lobes = fmls.get_create_null_lobe();
         }
 
@@ -242,12 +249,12 @@ namespace MR
           if (!count)
             throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
-          Mapping::TrackLoader loader (file, count);
+          Mapping::ParallelTrackLoader loader (file, count);
           Mapping::TrackMapperBase mapper (Fixel_map<Fixel>::header(), dirs);
           mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
           mapper.set_use_precise_mapping (true);
           Thread::run_queue (
-              loader,
+              Thread::multi (loader),
               Thread::batch (Tractography::Streamline<float>()),
               Thread::multi (mapper),
               Thread::batch (Mapping::SetDixel()),
@@ -15,6 +15,8 @@
 
 #include "dwi/tractography/SIFT/sifter.h"
 
+#include <algorithm>
+
 #include "progressbar.h"
 #include "memory.h"
 #include "timer.h"
@@ -58,11 +60,11 @@ namespace MR
         double sum_contributing_length = 0.0, sum_noncontributing_length = 0.0;
         std::vector<track_t> noncontributing_indices;
         for (track_t i = 0; i != contributions.size(); ++i) {
-          if (contributions[i]) {
-            if (contributions[i]->get_total_contribution()) {
-              sum_contributing_length    += contributions[i]->get_total_length();
+          if (contributions.exists (i)) {
+            if (contributions[i].get_total_contribution()) {
+              sum_contributing_length    += contributions[i].get_total_length();
             } else {
-              sum_noncontributing_length += contributions[i]->get_total_length();
+              sum_noncontributing_length += contributions[i].get_total_length();
               noncontributing_indices.push_back (i);
             }
           }
@@ -78,6 +80,9 @@ namespace MR
           throw Exception ("Error assigning memory for SIFT gradient vector");
         }
 
+        if (incremental)
+          init_cost_terms();
+
         unsigned int tracks_remaining = num_tracks();
 
         if (tracks_remaining < term_number)
@@ -109,8 +114,10 @@ namespace MR
           const double current_cf     = calc_cost_function();
           const double current_roc_cf = calc_roc_cost_function();
 
+          if (incremental)
+            update_cost_terms();
 
-          TrackIndexRangeWriter range_writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+          TrackIndexRangeWriter range_writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
           TrackGradientCalculator gradient_calculator (*this, gradient_vector, current_mu, current_roc_cf);
           Thread::run_queue (range_writer, TrackIndexRange(), Thread::multi (gradient_calculator));
 
@@ -168,9 +175,8 @@ namespace MR
               noncontributing_indices.pop_back();
 
               // Remove this streamline, and adjust all of the relevant quantities
-              noncontributing_length_removed += contributions[to_remove]->get_total_length();
-              delete contributions[to_remove];
-              contributions[to_remove] = nullptr;
+              noncontributing_length_removed += contributions[to_remove].get_total_length();
+              contributions.remove (to_remove);
               ++removed_this_iteration;
               --tracks_remaining;
 
@@ -188,12 +194,12 @@ namespace MR
               }
 
               assert (candidate_index != num_tracks());
-              assert (contributions[candidate_index]);
+              assert (contributions.exists (candidate_index));
 
               const double streamline_density_ratio = candidate->get_cost_gradient() / (sum_contributing_length - contributing_length_removed);
               const double required_cf_change_ratio = - term_ratio * streamline_density_ratio * current_cf;
 
-              const TrackContribution& candidate_contribution (*contributions[candidate_index]);
+              const TrackContribution candidate_contribution (contributions[candidate_index]);
 
               const double old_mu = mu();
               const double new_mu = FOD_sum / (TD_sum - candidate_contribution.get_total_contribution());
@@ -225,8 +231,7 @@ namespace MR
                 }
                 TD_sum -= candidate_contribution.get_total_contribution();
                 contributing_length_removed += candidate_contribution.get_total_length();
-                delete contributions[candidate_index];
-                contributions[candidate_index] = nullptr;
+                contributions.remove (candidate_index);
                 ++removed_this_iteration;
                 --tracks_remaining;
 
@@ -321,12 +326,13 @@ namespace MR
         ProgressBar progress ("Writing filtered tracks output file", contributions.size());
         Tractography::Streamline<> empty_tck;
         while (reader (tck) && tck_counter < contributions.size()) {
-          if (contributions[tck_counter++])
+          if (contributions.exists (tck_counter++))
             writer (tck);
           else
             writer (empty_tck);
           ++progress;
         }
+        writer.finalise();
         reader.close();
       }
 
@@ -338,7 +344,7 @@ namespace MR
       {
         File::OFStream out (path, std::ios_base::out | std::ios_base::trunc);
         for (track_t i = 0; i != contributions.size(); ++i) {
-          if (contributions[i])
+          if (contributions.exists (i))
             out << "1\n";
           else
             out << "0\n";
@@ -426,9 +432,9 @@ namespace MR
 
       double SIFTer::calc_gradient (const track_t index, const double current_mu, const double current_roc_cost) const
       {
-        if (!contributions[index])
+        if (!contributions.exists (index))
           return std::numeric_limits<double>::max();
-        const TrackContribution& tck_cont = *contributions[index];
+        const TrackContribution tck_cont (contributions[index]);
         const double TD_sum_if_removed = TD_sum - tck_cont.get_total_contribution();
         const double mu_if_removed = FOD_sum / TD_sum_if_removed;
         const double mu_change_if_removed = mu_if_removed - current_mu;
@@ -447,12 +453,85 @@ namespace MR
 
 
 
+      void SIFTer::init_cost_terms()
+      {
+        // Build the list of streamlines traversing each fixel; since these are filled in order of
+        //   streamline index, each list is sorted by streamline index
+        fixel_track_offsets.assign (fixels.size() + 1, 0);
+        for (track_t i = 0; i != num_tracks(); ++i) {
+          if (contributions.exists (i)) {
+            const TrackContribution tck_cont (contributions[i]);
+            for (size_t f = 0; f != tck_cont.dim(); ++f)
+              ++fixel_track_offsets[tck_cont[f].get_fixel_index() + 1];
+          }
+        }
+        for (size_t f = 0; f != fixels.size(); ++f)
+          fixel_track_offsets[f+1] += fixel_track_offsets[f];
+        try {
+          fixel_tracks.assign (fixel_track_offsets.back(), FixelTrack (0, 0.0f));
+          cost_terms.assign (num_tracks(), TrackCostTerms());
+        } catch (...) {
+          throw Exception ("Error assigning memory for incremental SIFT gradient calculation");
+        }
+        std::vector<uint64_t> positions (fixel_track_offsets.begin(), fixel_track_offsets.end() - 1);
+        for (track_t i = 0; i != num_tracks(); ++i) {
+          if (contributions.exists (i)) {
+            const TrackContribution tck_cont (contributions[i]);
+            for (size_t f = 0; f != tck_cont.dim(); ++f)
+              fixel_tracks[positions[tck_cont[f].get_fixel_index()]++] = FixelTrack (i, tck_cont[f].get_length());
+          }
+        }
+        // Forces calculation of all cost terms on first update
+        synced_TDs.clear();
+      }
+
+
+
+      void SIFTer::update_cost_terms()
+      {
+        // Find those fixels that have been modified since the cost terms were last updated,
+        //   and the number of cost terms that would need to be updated as a result
+        std::vector<uint32_t> modified_fixels;
+        uint64_t update_count = 0;
+        if (synced_TDs.size()) {
+          for (uint32_t f = 0; f != fixels.size(); ++f) {
+            if (fixels[f].get_TD() != synced_TDs[f]) {
+              modified_fixels.push_back (f);
+              update_count += fixel_track_offsets[f+1] - fixel_track_offsets[f];
+            }
+          }
+        }
+
+        if (synced_TDs.empty() || 2 * update_count > fixel_tracks.size()) {
+          // Cheaper to calculate all terms from scratch
+          TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+          TrackCostTermsCalculator calculator (*this);
+          Thread::run_queue (writer, TrackIndexRange(), Thread::multi (calculator));
+          synced_TDs.resize (fixels.size());
+          for (size_t f = 0; f != fixels.size(); ++f)
+            synced_TDs[f] = fixels[f].get_TD();
+        } else if (modified_fixels.size()) {
+          // Each thread must search the list of every modified fixel for its range of streamlines, so use fewer, larger ranges
+          const track_t range_size = std::max (track_t(SIFT_TRACK_INDEX_BUFFER_SIZE), track_t(num_tracks() / (4 * std::max (size_t(1), Thread::number_of_threads())) + 1));
+          TrackIndexRangeWriter writer (range_size, num_tracks());
+          TrackCostTermsUpdater updater (*this, modified_fixels);
+          Thread::run_queue (writer, TrackIndexRange(), Thread::multi (updater));
+          for (auto f : modified_fixels)
+            synced_TDs[f] = fixels[f].get_TD();
+        }
+      }
+
+
+
       bool SIFTer::TrackGradientCalculator::operator() (const TrackIndexRange& in) const
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
-          if (master.contributions[track_index]) {
-            const double gradient = master.calc_gradient (track_index, current_mu, current_roc_cost);
-            const double grad_per_unit_length = master.contributions[track_index]->get_total_contribution() ? (gradient / master.contributions[track_index]->get_total_contribution()) : 0.0;
+          if (master.contributions.exists (track_index)) {
+            const double total_contribution = master.contributions[track_index].get_total_contribution();
+            const double gradient = master.incremental ?
+                master.cost_terms[track_index].gradient (current_mu, master.FOD_sum / (master.TD_sum - total_contribution), current_roc_cost) :
+                master.calc_gradient (track_index, current_mu, current_roc_cost);
+            const double grad_per_unit_length = total_contribution ? (gradient / total_contribution) : 0.0;
             gradient_vector[track_index].set (track_index, gradient, grad_per_unit_length);
           } else {
             gradient_vector[track_index].set (master.num_tracks(), 0.0, 0.0);
@@ -463,6 +542,44 @@ namespace MR
 
 
 
+      bool SIFTer::TrackCostTermsCalculator::operator() (const TrackIndexRange& in) const
+      {
+        for (track_t track_index = in.first; track_index != in.second; ++track_index) {
+          TrackCostTerms terms;
+          if (master.contributions.exists (track_index)) {
+            const TrackContribution tck_cont (master.contributions[track_index]);
+            for (size_t f = 0; f != tck_cont.dim(); ++f) {
+              const Fixel& fixel = master.fixels[tck_cont[f].get_fixel_index()];
+              terms.add (fixel, fixel.get_TD(), tck_cont[f].get_length(), 1.0);
+            }
+          }
+          master.cost_terms[track_index] = terms;
+        }
+        return true;
+      }
+
+
+
+      bool SIFTer::TrackCostTermsUpdater::operator() (const TrackIndexRange& in) const
+      {
+        for (auto f : modified_fixels) {
+          const Fixel& fixel = master.fixels[f];
+          const double old_TD = master.synced_TDs[f], new_TD = fixel.get_TD();
+          const auto end = master.fixel_tracks.cbegin() + master.fixel_track_offsets[f+1];
+          auto i = std::lower_bound (master.fixel_tracks.cbegin() + master.fixel_track_offsets[f], end, in.first,
+                                     [] (const FixelTrack& a, const track_t b) { return a.track < b; });
+          // Terms of streamlines that have already been removed are also updated, but never used
+          for (; i != end && i->track < in.second; ++i) {
+            TrackCostTerms& terms (master.cost_terms[i->track]);
+            terms.add (fixel, old_TD, i->length, -1.0);
+            terms.add (fixel, new_TD, i->length, 1.0);
+          }
+        }
+        return true;
+      }
+
+
+
 
 
       }
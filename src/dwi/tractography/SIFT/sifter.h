@@ -60,7 +60,8 @@ namespace MR
             term_number (0),
             term_ratio (0.0),
             term_mu (0.0),
-            enforce_quantisation (true) { }
+            enforce_quantisation (true),
+            incremental (false) { }
 
         SIFTer (const SIFTer& that) = delete;
 
@@ -77,6 +78,7 @@ namespace MR
         void set_term_ratio  (const float i)        { term_ratio = i; }
         void set_term_mu     (const float i)        { term_mu = i; }
         void set_csv_path    (const std::string& i) { csv_path = i; }
+        void set_incremental (const bool i)         { incremental = i; }
 
         void set_regular_outputs (const std::vector<int>&, const bool);
 
@@ -103,6 +105,7 @@ namespace MR
         float   term_ratio;
         double  term_mu;
         bool    enforce_quantisation;
+        bool    incremental;
         std::string csv_path;
 
 
@@ -112,6 +115,55 @@ namespace MR
 
 
 
+        // For incremental calculation of the streamline removal gradients:
+        // The gradient of each streamline depends on the fixels it traverses only through three sums
+        //   over those fixels; these are stored for each streamline, and between iterations are updated
+        //   only for those streamlines that traverse a fixel from which a streamline was removed
+        //   (found using the list of streamlines traversing each fixel)
+        class TrackCostTerms
+        {
+          public:
+            TrackCostTerms () : E (0.0), R (0.0), U (0.0) { }
+
+            // Add (multiplier = 1) or subtract (multiplier = -1) the terms for a fixel with a given TD
+            void add (const Fixel& fixel, const double TD, const double length, const double multiplier)
+            {
+              const double TD_if_removed = std::max (TD - length, 0.0);
+              const double w = multiplier * fixel.get_weight();
+              E += w * (TD_if_removed - TD) * (TD_if_removed + TD);
+              R += w * TD * TD;
+              U += w * fixel.get_FOD() * (TD - TD_if_removed);
+            }
+
+            // Equivalent to calc_gradient()
+            double gradient (const double current_mu, const double mu_if_removed, const double current_roc_cost) const
+            {
+              const double mu_change = mu_if_removed - current_mu;
+              return (current_roc_cost * mu_change) + (E * Math::pow2 (mu_if_removed)) + (R * Math::pow2 (mu_change)) + (2.0 * U * mu_if_removed);
+            }
+
+          private:
+            double E, R, U;
+        };
+
+        class FixelTrack
+        {
+          public:
+            FixelTrack (const track_t t, const float l) : track (t), length (l) { }
+            track_t track;
+            float length;
+        };
+
+        std::vector<TrackCostTerms> cost_terms;
+        std::vector<uint64_t> fixel_track_offsets;
+        std::vector<FixelTrack> fixel_tracks;
+        std::vector<double> synced_TDs;
+
+        void init_cost_terms();
+        void update_cost_terms();
+
+
+
         // For calculating the streamline removal gradients in a multi-threaded fashion
         class TrackGradientCalculator
         {
@@ -125,6 +177,30 @@ namespace MR
             const double current_mu, current_roc_cost;
         };
 
+        // For calculating the streamline cost terms from scratch
+        class TrackCostTermsCalculator
+        {
+          public:
+            TrackCostTermsCalculator (SIFTer& sifter) :
+                master (sifter) { }
+            bool operator() (const TrackIndexRange&) const;
+          private:
+            SIFTer& master;
+        };
+
+        // For updating the streamline cost terms based on the fixels modified in the previous iteration;
+        //   each thread updates only the streamlines within its index range, so no locking is required
+        class TrackCostTermsUpdater
+        {
+          public:
+            TrackCostTermsUpdater (SIFTer& sifter, const std::vector<uint32_t>& fixels) :
+                master (sifter), modified_fixels (fixels) { }
+            bool operator() (const TrackIndexRange&) const;
+          private:
+            SIFTer& master;
+            const std::vector<uint32_t>& modified_fixels;
+        };
+
 
       };
 
@@ -15,6 +15,14 @@
 
 #include "dwi/tractography/SIFT/track_contribution.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef MRTRIX_WINDOWS
+# include <sys/mman.h>
+#endif
+
+#include "file/utils.h"
+
 namespace MR
 {
   namespace DWI
@@ -29,6 +37,218 @@ namespace MR
         float Track_fixel_contribution::scale_from_storage = 0.0;
         float Track_fixel_contribution::min_length_for_storage = 0.0;
 
+        constexpr uint32_t TrackContributions::absent;
+
+
+
+        void TrackContributions::Appender::operator() (const track_t index, const std::vector<Track_fixel_contribution>& data, const float total_contribution, const float total_length)
+        {
+          if (data.size() > remaining) {
+            if (data.size() > SIFT_CONTRIBUTION_BLOCK_SIZE)
+              throw Exception ("Streamline " + str(index) + " has too many fixel contributions (" + str(data.size()) + ")");
+            flush();
+            block = master.new_block (offset);
+            if (!block) {
+              if (!buffer)
+                buffer.reset (new Track_fixel_contribution[SIFT_CONTRIBUTION_BLOCK_SIZE]);
+              block = buffer.get();
+            }
+            block_start = offset;
+            remaining = SIFT_CONTRIBUTION_BLOCK_SIZE;
+          }
+          std::copy (data.begin(), data.end(), block + (offset % SIFT_CONTRIBUTION_BLOCK_SIZE));
+          master.offsets[index] = offset;
+          master.sizes[index] = data.size();
+          master.total_contributions[index] = total_contribution;
+          master.total_lengths[index] = total_length;
+          offset += data.size();
+          remaining -= data.size();
+        }
+
+
+
+        void TrackContributions::Appender::flush ()
+        {
+          if (buffer && offset > block_start)
+            master.write (block_start, buffer.get(), offset - block_start);
+          block_start = offset;
+        }
+
+
+
+        TrackContributions::~TrackContributions ()
+        {
+          unmap();
+          if (fd >= 0)
+            close (fd);
+        }
+
+
+
+        void TrackContributions::set_out_of_core ()
+        {
+#ifdef MRTRIX_WINDOWS
+          throw Exception ("Out-of-core storage of streamline visitations is not supported on Windows");
+#else
+          assert (!size());
+          const std::string path = File::create_tempfile (0, "dat");
+          fd = open (path.c_str(), O_RDWR);
+          if (fd < 0)
+            throw Exception ("error opening temporary file \"" + path + "\": " + strerror (errno));
+          // The file is only accessed through its descriptor, so it can be unlinked
+          //   immediately; this ensures it is removed however the program terminates
+          unlink (path.c_str());
+          INFO ("Streamline visitations will be stored in temporary file \"" + path + "\"");
+#endif
+        }
+
+
+
+        void TrackContributions::finalise ()
+        {
+#ifndef MRTRIX_WINDOWS
+          if (fd < 0 || mapping)
+            return;
+          if (write_error)
+            throw Exception ("Error writing streamline visitations to temporary file: " + std::string (strerror (write_error)));
+          if (!num_blocks)
+            return;
+          const size_t bytes = num_blocks * SIFT_CONTRIBUTION_BLOCK_SIZE * sizeof (Track_fixel_contribution);
+          if (ftruncate (fd, bytes))
+            throw Exception ("Error resizing temporary file for streamline visitations: " + std::string (strerror (errno)));
+          void* addr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if (addr == MAP_FAILED)
+            throw Exception ("Error memory-mapping temporary file for streamline visitations: " + std::string (strerror (errno)));
+          mapping = static_cast<Track_fixel_contribution*> (addr);
+#endif
+        }
+
+
+
+        void TrackContributions::prefetch (const track_t first, const track_t last) const
+        {
+#ifndef MRTRIX_WINDOWS
+          if (!mapping)
+            return;
+          static const uint64_t page_size = sysconf (_SC_PAGESIZE);
+          // Merge the contributions of consecutive streamlines into contiguous byte ranges
+          uint64_t start = 0, end = 0;
+          auto request = [&] () {
+            if (end > start) {
+              const uint64_t aligned_start = (start / page_size) * page_size;
+              madvise (reinterpret_cast<uint8_t*> (mapping) + aligned_start, end - aligned_start, MADV_WILLNEED);
+            }
+          };
+          for (track_t i = first; i != last; ++i) {
+            if (!exists (i) || !sizes[i])
+              continue;
+            const uint64_t this_start = offsets[i] * sizeof (Track_fixel_contribution);
+            const uint64_t this_end = this_start + sizes[i] * sizeof (Track_fixel_contribution);
+            if (this_start >= start && this_start <= end + page_size) {
+              end = std::max (end, this_end);
+            } else {
+              request();
+              start = this_start;
+              end = this_end;
+            }
+          }
+          request();
+#endif
+        }
+
+
+
+        void TrackContributions::assign (const track_t num_tracks)
+        {
+          unmap();
+          blocks.clear();
+          num_blocks = 0;
+          offsets.assign (num_tracks, 0);
+          sizes.assign (num_tracks, absent);
+          total_contributions.assign (num_tracks, 0.0f);
+          total_lengths.assign (num_tracks, 0.0f);
+        }
+
+
+
+        void TrackContributions::resize (const track_t num_tracks)
+        {
+          assert (num_tracks <= size());
+          offsets.resize (num_tracks);
+          sizes.resize (num_tracks);
+          total_contributions.resize (num_tracks);
+          total_lengths.resize (num_tracks);
+        }
+
+
+
+        void TrackContributions::replace (const track_t index, const std::vector<Track_fixel_contribution>& contributions, const float total_contribution)
+        {
+          assert (exists (index));
+          if (contributions.size() > sizes[index])
+            throw Exception ("FIXME: Cannot increase the number of fixel contributions of a streamline in place");
+          std::copy (contributions.begin(), contributions.end(), data (offsets[index]));
+          sizes[index] = contributions.size();
+          total_contributions[index] = total_contribution;
+        }
+
+
+
+        Track_fixel_contribution* TrackContributions::new_block (uint64_t& offset)
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          offset = num_blocks++ * SIFT_CONTRIBUTION_BLOCK_SIZE;
+          // If out-of-core, the Appender fills its own buffer, which is then written to file
+          if (fd >= 0)
+            return nullptr;
+          try {
+            blocks.push_back (std::unique_ptr<Track_fixel_contribution[]> (new Track_fixel_contribution[SIFT_CONTRIBUTION_BLOCK_SIZE]));
+          } catch (...) {
+            throw Exception ("Error allocating memory for streamline visitations");
+          }
+          return blocks.back().get();
+        }
+
+
+
+        void TrackContributions::write (const uint64_t offset, const Track_fixel_contribution* data, const size_t count)
+        {
+#ifndef MRTRIX_WINDOWS
+          // Appenders write to distinct regions of the file, so no locking is required
+          const char* ptr = reinterpret_cast<const char*> (data);
+          size_t remaining = count * sizeof (Track_fixel_contribution);
+          off_t position = offset * sizeof (Track_fixel_contribution);
+          while (remaining) {
+            const ssize_t written = pwrite (fd, ptr, remaining, position);
+            if (written < 0) {
+              if (errno == EINTR)
+                continue;
+              // Reported in finalise(), since this may be invoked from a destructor
+              const int error = errno;
+              std::lock_guard<std::mutex> lock (mutex);
+              if (!write_error)
+                write_error = error;
+              return;
+            }
+            ptr += written;
+            position += written;
+            remaining -= written;
+          }
+#endif
+        }
+
+
+
+        void TrackContributions::unmap ()
+        {
+#ifndef MRTRIX_WINDOWS
+          if (mapping) {
+            munmap (mapping, num_blocks * SIFT_CONTRIBUTION_BLOCK_SIZE * sizeof (Track_fixel_contribution));
+            mapping = nullptr;
+          }
+#endif
+        }
+
 
       }
     }
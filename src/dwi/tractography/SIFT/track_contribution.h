@@ -20,12 +20,22 @@
 
 
 #include <stdint.h>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "header.h"
-#include "min_mem_array.h"
 
 #include "math/math.h"
 
+#include "dwi/tractography/SIFT/types.h"
+
+
+// Number of streamline-fixel contributions allocated at a time by
+//   TrackContributions; must be a power of two
+#define SIFT_CONTRIBUTION_BLOCK_SIZE (1u << 20)
+
 
 namespace MR
 {
@@ -129,26 +139,28 @@ class Track_fixel_contribution
 
 
 
-      class TrackContribution : public Min_mem_array<Track_fixel_contribution>
+      //! the contributions of a single streamline to the fixels it traverses
+      /*! This is a lightweight view into the storage of a TrackContributions
+       * instance; it remains valid only for as long as that storage. */
+      class TrackContribution
       {
 
         public:
-        TrackContribution (const std::vector<Track_fixel_contribution>& in, const float c, const float l) :
-            Min_mem_array<Track_fixel_contribution> (in),
+        TrackContribution (const Track_fixel_contribution* data, const uint32_t size, const float c, const float l) :
+            data (data),
+            size (size),
             total_contribution (c),
             total_length       (l) { }
 
-        TrackContribution () :
-            Min_mem_array<Track_fixel_contribution> (),
-            total_contribution (0.0),
-            total_length       (0.0) { }
-
-        ~TrackContribution() { }
+        size_t dim() const { return size; }
+        const Track_fixel_contribution& operator[] (const size_t i) const { assert (i < size); return data[i]; }
 
         float get_total_contribution() const { return total_contribution; }
         float get_total_length      () const { return total_length; }
 
         private:
+          const Track_fixel_contribution* const data;
+          const uint32_t size;
           const float total_contribution, total_length;
 
       };
@@ -156,6 +168,148 @@ class Track_fixel_contribution
 
 
 
+      //! storage for the fixel contributions of all streamlines
+      /*! Rather than allocating the contributions of each streamline
+       * individually, these are stored in compressed sparse row form: the
+       * Track_fixel_contribution entries of all streamlines are packed into a
+       * single arena, and each streamline is described only by the offset of
+       * its entries within that arena, their number, and its total
+       * contribution & length.
+       *
+       * The arena is allocated in blocks of SIFT_CONTRIBUTION_BLOCK_SIZE
+       * entries, so that it can be populated concurrently without any
+       * reallocation: each thread appends the contributions of the
+       * streamlines it receives to its own block via an Appender. Since
+       * streamlines are mapped approximately in order, the contributions of
+       * consecutive streamlines are then also largely contiguous in memory.
+       *
+       * Streamlines that have not been mapped, or that have been removed
+       * (e.g. by SIFT), are flagged as such; their entries remain in the
+       * arena.
+       *
+       * If set_out_of_core() is invoked, the arena is instead stored in a
+       * temporary file: each Appender fills a single block in RAM, which is
+       * written to file whenever it is full, and the file is memory-mapped
+       * once all streamlines have been mapped (see finalise()). The memory
+       * required then scales with the number of streamlines only through
+       * the per-streamline offset, size, contribution & length. Processing
+       * should iterate over the streamlines using a TrackIndexRangeWriter
+       * constructed from this class, so that the contributions of upcoming
+       * streamlines are read from file while the current ones are being
+       * processed (see prefetch()). */
+      class TrackContributions
+      {
+        public:
+          TrackContributions () :
+              num_blocks (0),
+              fd (-1),
+              mapping (nullptr),
+              write_error (0) { }
+          TrackContributions (const TrackContributions&) = delete;
+          ~TrackContributions ();
+
+
+          class Appender
+          {
+            public:
+              Appender (TrackContributions& master) :
+                  master (master),
+                  block (nullptr),
+                  offset (0),
+                  block_start (0),
+                  remaining (0) { }
+              Appender (const Appender& that) :
+                  master (that.master),
+                  block (nullptr),
+                  offset (0),
+                  block_start (0),
+                  remaining (0) { }
+              ~Appender () { flush(); }
+
+              void operator() (const track_t index, const std::vector<Track_fixel_contribution>& data, const float total_contribution, const float total_length);
+
+            private:
+              TrackContributions& master;
+              Track_fixel_contribution* block;
+              uint64_t offset, block_start;
+              size_t remaining;
+              // Only used when out-of-core
+              std::unique_ptr<Track_fixel_contribution[]> buffer;
+
+              void flush ();
+          };
+
+
+          //! store the contributions in a temporary file rather than in RAM
+          /*! The file is created in the directory specified by the
+           * TmpFileDir configuration file entry. This must be invoked before
+           * assign(). */
+          void set_out_of_core ();
+          bool is_out_of_core () const { return fd >= 0; }
+
+          //! make the contributions accessible once all Appenders have been destroyed
+          void finalise ();
+
+          //! initiate reading of the contributions of a range of streamlines from file
+          /*! This returns immediately; it does nothing unless out-of-core. */
+          void prefetch (const track_t first, const track_t last) const;
+
+
+          //! set the number of streamlines; any existing contributions are discarded
+          void assign (const track_t num_tracks);
+          //! reduce the number of streamlines
+          void resize (const track_t num_tracks);
+
+          track_t size() const { return sizes.size(); }
+          bool exists (const track_t index) const { return sizes[index] != absent; }
+
+          TrackContribution operator[] (const track_t index) const
+          {
+            if (!exists (index))
+              return TrackContribution (nullptr, 0, 0.0f, 0.0f);
+            return TrackContribution (data (offsets[index]), sizes[index], total_contributions[index], total_lengths[index]);
+          }
+
+          void remove (const track_t index) { sizes[index] = absent; }
+
+          //! overwrite the contributions of a streamline in place
+          /*! The number of entries must not exceed that currently stored for
+           * this streamline. Different streamlines can be replaced
+           * concurrently. */
+          void replace (const track_t index, const std::vector<Track_fixel_contribution>& data, const float total_contribution);
+
+
+        private:
+          static constexpr uint32_t absent = std::numeric_limits<uint32_t>::max();
+
+          std::vector<std::unique_ptr<Track_fixel_contribution[]>> blocks;
+          uint64_t num_blocks;
+          std::mutex mutex;
+
+          // Only used when out-of-core
+          int fd;
+          Track_fixel_contribution* mapping;
+          int write_error; // errno of the first failed write, if any
+
+          std::vector<uint64_t> offsets;
+          std::vector<uint32_t> sizes;
+          std::vector<float> total_contributions, total_lengths;
+
+          const Track_fixel_contribution* data (const uint64_t offset) const {
+            return mapping ? (mapping + offset) : (blocks[offset / SIFT_CONTRIBUTION_BLOCK_SIZE].get() + (offset % SIFT_CONTRIBUTION_BLOCK_SIZE));
+          }
+          Track_fixel_contribution* data (const uint64_t offset) {
+            return mapping ? (mapping + offset) : (blocks[offset / SIFT_CONTRIBUTION_BLOCK_SIZE].get() + (offset % SIFT_CONTRIBUTION_BLOCK_SIZE));
+          }
+
+          Track_fixel_contribution* new_block (uint64_t& offset);
+          void write (const uint64_t offset, const Track_fixel_contribution* data, const size_t count);
+          void unmap ();
+      };
+
+
+
+
       }
     }
   }
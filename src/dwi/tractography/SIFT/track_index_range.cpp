@@ -16,6 +16,8 @@
 
 #include "dwi/tractography/SIFT/track_index_range.h"
 
+#include "dwi/tractography/SIFT/track_contribution.h"
+
 
 namespace MR
 {
@@ -32,7 +34,18 @@ namespace MR
         size  (buffer_size),
         end   (num_tracks),
         start (0),
-        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))) { }
+        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))),
+        contributions (nullptr),
+        prefetched (0) { }
+
+
+      TrackIndexRangeWriter::TrackIndexRangeWriter (const track_t buffer_size, const TrackContributions& contributions, const std::string& message) :
+        size  (buffer_size),
+        end   (contributions.size()),
+        start (0),
+        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))),
+        contributions (contributions.is_out_of_core() ? &contributions : nullptr),
+        prefetched (0) { }
 
 
       bool TrackIndexRangeWriter::operator() (TrackIndexRange& out)
@@ -43,6 +56,14 @@ namespace MR
         const track_t last = std::min (start + size, end);
         out.second = last;
         start = last;
+        // Keep enough ranges in flight to supply every thread, plus those already in the queue
+        if (contributions) {
+          const track_t target = std::min<uint64_t> (end, last + uint64_t(Thread::number_of_threads() + 1) * size);
+          if (target > prefetched) {
+            contributions->prefetch (std::max (prefetched, out.first), target);
+            prefetched = target;
+          }
+        }
         if (progress)
           ++*progress;
         return true;
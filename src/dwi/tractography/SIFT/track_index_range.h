@@ -36,6 +36,10 @@ namespace MR
 
 
 
+      class TrackContributions;
+
+
+
       typedef std::pair<track_t, track_t> TrackIndexRange;
       typedef Thread::Queue< TrackIndexRange > TrackIndexRangeQueue;
 
@@ -45,11 +49,14 @@ namespace MR
       //   if multi-threading is done on a per-track basis the I/O associated with multi-threading begins to dominate
       // Instead, the input queue for multi-threading is filled with std::pair<track_t, track_t>'s, where the values
       //   are the start and end track indices to be processed
+      // If constructed from the streamline contributions, these will additionally be prefetched from file
+      //   ahead of processing if they are stored out-of-core
       class TrackIndexRangeWriter
       {
 
         public:
           TrackIndexRangeWriter (const track_t, const track_t, const std::string& message = std::string ());
+          TrackIndexRangeWriter (const track_t, const TrackContributions&, const std::string& message = std::string ());
 
           bool operator() (TrackIndexRange&);
 
@@ -57,6 +64,8 @@ namespace MR
           const track_t size, end;
           track_t start;
           std::unique_ptr<ProgressBar> progress;
+          const TrackContributions* contributions;
+          track_t prefetched;
 
       };
 
@@ -77,6 +77,7 @@ namespace MR
 
           // Functions for altering the state of this more advanced fixel class
           void exclude()          { excluded = true; }
+          void include()          { excluded = false; }
           void store_orig_TD()    { orig_TD = get_TD(); }
           void clear_mean_coeff() { mean_coeff = 0.0; }
 
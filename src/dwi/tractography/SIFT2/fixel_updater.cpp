@@ -53,8 +53,10 @@ namespace MR {
       bool FixelUpdater::operator() (const SIFT::TrackIndexRange& range)
       {
         for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
+          if (!master.in_subset (track_index))
+            continue;
           const double coefficient = master.coefficients[track_index];
-          const SIFT::TrackContribution& this_contribution (*(master.contributions[track_index]));
+          const SIFT::TrackContribution this_contribution (master.contributions[track_index]);
           const double weighting_factor = (coefficient > master.min_coeff) ? std::exp (coefficient) : 0.0;
           for (size_t j = 0; j != this_contribution.dim(); ++j) {
             const size_t fixel_index = this_contribution[j].get_fixel_index();
@@ -19,6 +19,7 @@
 #include "image.h"
 
 #include "math/math.h"
+#include "math/rng.h"
 
 #include "sparse/fixel_metric.h"
 #include "sparse/image.h"
@@ -115,7 +116,7 @@ namespace MR {
         TD_sum = 0.0;
 
         for (SIFT::track_t track_index = 0; track_index != num_tracks(); ++track_index) {
-          const SIFT::TrackContribution& tck_cont (*contributions[track_index]);
+          const SIFT::TrackContribution tck_cont (contributions[track_index]);
           const double weight = 1.0 / tck_cont.get_total_length();
           coefficients[track_index] = std::log (weight);
           for (size_t i = 0; i != tck_cont.dim(); ++i)
@@ -152,7 +153,7 @@ namespace MR {
 
         // Just do single-threaded for now
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          const SIFT::TrackContribution& tckcont = *contributions[i];
+          const SIFT::TrackContribution tckcont (contributions[i]);
           double sum_afd = 0.0;
           for (size_t f = 0; f != tckcont.dim(); ++f) {
             const size_t fixel_index = tckcont[f].get_fixel_index();
@@ -169,7 +170,7 @@ namespace MR {
           i->clear_mean_coeff();
         }
         {
-          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
           FixelUpdater worker (*this);
           Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
         }
@@ -181,34 +182,144 @@ namespace MR {
 
 
 
+      void TckFactor::load_coefficients (const std::string& path)
+      {
+        auto values = load_vector (path);
+        if (size_t(values.size()) != num_tracks())
+          throw Exception ("Number of entries in initial coefficients file \"" + Path::basename (path) + "\" (" + str(values.size()) + ") "
+                           "does not match number of streamlines (" + str(num_tracks()) + ")");
+        // Non-finite values are written by -out_coeffs for streamlines with a weight of zero
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i)
+          values[i] = std::isfinite (values[i]) ? std::min (std::max (values[i], min_coeff), max_coeff) : min_coeff;
+        coefficients = values;
+      }
+
+
+
+
       void TckFactor::estimate_factors()
       {
 
-        try {
-          coefficients = decltype(coefficients)::Zero (num_tracks());
-        } catch (...) {
-          throw Exception ("Error assigning memory for streamline weights vector");
+        // Convergence is assessed relative to the cost function with all streamlines
+        //   having unit weight, regardless of how the coefficients are initialised
+        const double init_cf = calc_cost_function();
+
+        const bool warm_start = (size_t(coefficients.size()) == num_tracks());
+        if (!warm_start) {
+          try {
+            coefficients = decltype(coefficients)::Zero (num_tracks());
+          } catch (...) {
+            throw Exception ("Error assigning memory for streamline weights vector");
+          }
         }
 
-        const double init_cf = calc_cost_function();
-        double cf_data = init_cf;
-        double new_cf = init_cf;
-        double prev_cf = init_cf;
-        double cf_reg = 0.0;
+        std::unique_ptr<std::ofstream> csv_out;
+        if (!csv_path.empty()) {
+          csv_out.reset (new std::ofstream());
+          csv_out->open (csv_path.c_str(), std::ios_base::trunc);
+          (*csv_out) << "Iteration,Cost_data,Cost_reg_tik,Cost_reg_tv,Cost_reg,Cost_total,Streamlines,Fixels_excluded,Step_min,Step_mean,Step_mean_abs,Step_var,Step_max,Coeff_min,Coeff_mean,Coeff_mean_abs,Coeff_var,Coeff_max,Coeff_norm,Stage,\n";
+          csv_out->flush();
+        }
+
+        unsigned int iter = 0;
+        if (subset_fraction)
+          estimate_subset_factors (init_cf, iter, csv_out.get());
+        else if (warm_start)
+          update_fixels();
+        optimise ("full", init_cf, iter, csv_out.get());
+
+      }
+
+
+
+
+      void TckFactor::estimate_subset_factors (const double full_init_cf, unsigned int& iter, std::ofstream* csv_out)
+      {
+
+        Math::RNG::Uniform<double> rng;
+        subset.reset (new BitSet (num_tracks()));
+        SIFT::track_t subset_count = 0;
+        double subset_TD_sum = 0.0;
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
+          if (rng() < subset_fraction) {
+            (*subset)[i] = true;
+            ++subset_count;
+            subset_TD_sum += contributions[i].get_total_contribution();
+          }
+        }
+        if (!subset_TD_sum) {
+          WARN ("Streamline subset for initial coefficient estimation is empty; skipping");
+          subset.reset();
+          update_fixels();
+          return;
+        }
+        CONSOLE ("Estimating initial coefficients using subset of " + str(subset_count) + " streamlines");
+
+        // Construct the model using only the streamlines in the subset; fixels excluded during this
+        //   stage will be reinstated for the full optimisation
+        const double full_TD_sum = TD_sum;
+        const double full_reg_multiplier_tikhonov = reg_multiplier_tikhonov, full_reg_multiplier_tv = reg_multiplier_tv;
+        std::vector<bool> excluded (fixels.size());
+        for (size_t i = 0; i != fixels.size(); ++i)
+          excluded[i] = fixels[i].is_excluded();
+
+        store_unweighted_TDs();
+        TD_sum = subset_TD_sum;
+        // The regularisation terms are summed over streamlines, whereas the data term is not
+        reg_multiplier_tikhonov *= double(num_tracks()) / double(subset_count);
+        reg_multiplier_tv       *= double(num_tracks()) / double(subset_count);
+        const double subset_init_cf = calc_cost_function();
+        update_fixels();
+
+        optimise ("subset", subset_init_cf, iter, csv_out);
+
+        // Initialise the coefficients of all other streamlines from the mean coefficients of the fixels they traverse
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
+          if (!(*subset)[i]) {
+            const SIFT::TrackContribution this_contribution (contributions[i]);
+            double sum = 0.0, sum_lengths = 0.0;
+            for (size_t j = 0; j != this_contribution.dim(); ++j) {
+              sum         += this_contribution[j].get_length() * fixels[this_contribution[j].get_fixel_index()].get_mean_coeff();
+              sum_lengths += this_contribution[j].get_length();
+            }
+            coefficients[i] = sum_lengths ? std::min (std::max (sum / sum_lengths, min_coeff), max_coeff) : 0.0;
+          }
+        }
+
+        // Restore the full model
+        subset.reset();
+        TD_sum = full_TD_sum;
+        reg_multiplier_tikhonov = full_reg_multiplier_tikhonov;
+        reg_multiplier_tv       = full_reg_multiplier_tv;
+        for (size_t i = 0; i != fixels.size(); ++i) {
+          if (!excluded[i])
+            fixels[i].include();
+        }
+        store_unweighted_TDs();
+        update_fixels();
+        INFO ("Cost function after initialisation from streamline subset is " + str(100.0 * calc_cost_function() / full_init_cf) + "\% of initial value");
+
+      }
+
+
+
+
+      void TckFactor::optimise (const std::string& stage, const double init_cf, unsigned int& iter, std::ofstream* csv_out)
+      {
+
+        double cf_data = calc_cost_function();
+        double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
+        double cf_reg = calc_regularisation (cf_reg_tik, cf_reg_tv);
+        double new_cf = cf_data + cf_reg;
+        double prev_cf = new_cf;
         const double required_cf_change = -min_cf_decrease_percentage * init_cf;
 
         unsigned int nonzero_streamlines = 0;
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          if (contributions[i] && contributions[i]->dim())
+          if (in_subset (i) && contributions[i].dim() && coefficients[i] > min_coeff)
             ++nonzero_streamlines;
         }
 
-        unsigned int iter = 0;
-        
-        auto display_func = [&](){ return printf("    %5u        %3.3f%%         %2.3f%%        %u", iter, 100.0 * cf_data / init_cf, 100.0 * cf_reg / init_cf, nonzero_streamlines); };
-        CONSOLE ("  Iteration     CF (data)      CF (reg)     Streamlines");
-        ProgressBar progress ("");
-
         // Keep track of total exclusions, not just how many are removed in each iteration
         size_t total_excluded = 0;
         for (size_t i = 1; i != fixels.size(); ++i) {
@@ -216,15 +327,16 @@ namespace MR {
             ++total_excluded;
         }
 
-        std::unique_ptr<std::ofstream> csv_out;
-        if (!csv_path.empty()) {
-          csv_out.reset (new std::ofstream());
-          csv_out->open (csv_path.c_str(), std::ios_base::trunc);
-          (*csv_out) << "Iteration,Cost_data,Cost_reg_tik,Cost_reg_tv,Cost_reg,Cost_total,Streamlines,Fixels_excluded,Step_min,Step_mean,Step_mean_abs,Step_var,Step_max,Coeff_min,Coeff_mean,Coeff_mean_abs,Coeff_var,Coeff_max,Coeff_norm,\n";
-          (*csv_out) << "0," << init_cf << ",0,0,0," << init_cf << "," << nonzero_streamlines << "," << total_excluded << ",0,0,0,0,0,0,0,0,0,0,0,\n";
+        if (csv_out && !iter) {
+          (*csv_out) << str (iter) << "," << str (cf_data) << "," << str (cf_reg_tik) << "," << str (cf_reg_tv) << "," << str (cf_reg) << "," << str (new_cf) << "," << str (nonzero_streamlines) << "," << str (total_excluded) << ",0,0,0,0,0,0,0,0,0,0,0," << stage << ",\n";
           csv_out->flush();
         }
 
+        const unsigned int first_iter = iter;
+        auto display_func = [&](){ return printf("    %5u        %3.3f%%         %2.3f%%        %u", iter, 100.0 * cf_data / init_cf, 100.0 * cf_reg / init_cf, nonzero_streamlines); };
+        CONSOLE ("  Iteration     CF (data)      CF (reg)     Streamlines");
+        ProgressBar progress ("");
+
         // Initial estimates of how each weighting coefficient is going to change
         // The ProjectionCalculator classes overwrite these in place, so do an initial allocation but
         //   don't bother wiping it at every iteration
@@ -245,7 +357,7 @@ namespace MR {
           fixels_to_exclude.clear();
           double sum_costs = 0.0;
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
             //CoefficientOptimiserGSS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             //CoefficientOptimiserQLS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             CoefficientOptimiserIterative worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
@@ -267,18 +379,7 @@ namespace MR {
           }
 
           // Multi-threaded calculation of updated streamline density, and mean weighting coefficient, in each fixel
-          for (std::vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i) {
-            i->clear_TD();
-            i->clear_mean_coeff();
-          }
-          {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            FixelUpdater worker (*this);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-          }
-          // Scale the fixel mean coefficient terms (each streamline in the fixel is weighted by its length)
-          for (std::vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i)
-            i->normalise_mean_coeff();
+          update_fixels();
           indicate_progress();
 
           cf_data = calc_cost_function();
@@ -286,32 +387,23 @@ namespace MR {
           // Calculate the cost of regularisation, given the updates to both the
           //   streamline weighting coefficients and the new fixel mean coefficients
           // Log different regularisation costs separately
-          double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
-          {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-          }
-          cf_reg_tik *= reg_multiplier_tikhonov;
-          cf_reg_tv  *= reg_multiplier_tv;
-
-          cf_reg = cf_reg_tik + cf_reg_tv;
+          cf_reg = calc_regularisation (cf_reg_tik, cf_reg_tv);
 
           new_cf = cf_data + cf_reg;
 
-          if (!csv_path.empty()) {
+          if (csv_out) {
             (*csv_out) << str (iter) << "," << str (cf_data) << "," << str (cf_reg_tik) << "," << str (cf_reg_tv) << "," << str (cf_reg) << "," << str (new_cf) << "," << str (nonzero_streamlines) << "," << str (total_excluded) << ","
                 << str (step_stats       .get_min()) << "," << str (step_stats       .get_mean()) << "," << str (step_stats       .get_mean_abs()) << "," << str (step_stats       .get_var()) << "," << str (step_stats       .get_max()) << ","
                 << str (coefficient_stats.get_min()) << "," << str (coefficient_stats.get_mean()) << "," << str (coefficient_stats.get_mean_abs()) << "," << str (coefficient_stats.get_var()) << "," << str (coefficient_stats.get_max()) << ","
-                << str (coefficient_stats.get_var() * (num_tracks() - 1))
-                << ",\n";
+                << str (coefficient_stats.get_var() * (num_tracks() - 1)) << ","
+                << stage << ",\n";
             csv_out->flush();
           }
 
           progress.update (display_func);
           
           // Leaving out testing the fixel exclusion mask criterion; doesn't converge, and results in CF increase
-        } while (((new_cf - prev_cf < required_cf_change) || (iter < min_iters) /* || !fixels_to_exclude.empty() */ ) && (iter < max_iters));
+        } while (((new_cf - prev_cf < required_cf_change) || (iter - first_iter < min_iters) /* || !fixels_to_exclude.empty() */ ) && (iter - first_iter < max_iters));
 
         progress.done();
       }
@@ -319,6 +411,52 @@ namespace MR {
 
 
 
+      void TckFactor::update_fixels()
+      {
+        for (std::vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i) {
+          i->clear_TD();
+          i->clear_mean_coeff();
+        }
+        {
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
+          FixelUpdater worker (*this);
+          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+        }
+        // Scale the fixel mean coefficient terms (each streamline in the fixel is weighted by its length)
+        for (std::vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i)
+          i->normalise_mean_coeff();
+      }
+
+
+
+      void TckFactor::store_unweighted_TDs()
+      {
+        // The original TD of each fixel is the TD with all streamlines (in the subset, if set) having unit weight
+        decltype(coefficients) temp = decltype(coefficients)::Zero (num_tracks());
+        std::swap (coefficients, temp);
+        update_fixels();
+        store_orig_TDs();
+        std::swap (coefficients, temp);
+      }
+
+
+
+      double TckFactor::calc_regularisation (double& cf_reg_tik, double& cf_reg_tv)
+      {
+        cf_reg_tik = cf_reg_tv = 0.0;
+        {
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
+          RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
+          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+        }
+        cf_reg_tik *= reg_multiplier_tikhonov;
+        cf_reg_tv  *= reg_multiplier_tv;
+        return cf_reg_tik + cf_reg_tv;
+      }
+
+
+
+
       void TckFactor::output_factors (const std::string& path) const
       {
         if (size_t(coefficients.size()) != contributions.size())
@@ -359,7 +497,7 @@ namespace MR {
           ProgressBar progress ("Generating streamline coefficient statistic images", num_tracks());
           for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
             const double coeff = coefficients[i];
-            const SIFT::TrackContribution& this_contribution (*contributions[i]);
+            const SIFT::TrackContribution this_contribution (contributions[i]);
             if (coeff > min_coeff) {
               for (size_t j = 0; j != this_contribution.dim(); ++j) {
                 const size_t fixel_index = this_contribution[j].get_fixel_index();
@@ -23,6 +23,7 @@
 #include <limits>
 #include <mutex>
 
+#include "bitset.h"
 #include "image.h"
 #include "types.h"
 
@@ -72,6 +73,7 @@ namespace MR {
               max_coeff (SIFT2_MAX_COEFF_DEFAULT),
               max_coeff_step (SIFT2_MAX_COEFF_STEP_DEFAULT),
               min_cf_decrease_percentage (SIFT2_MIN_CF_DECREASE_DEFAULT),
+              subset_fraction (0.0),
               data_scale_term (0.0) { }
 
 
@@ -84,6 +86,7 @@ namespace MR {
           void set_max_coeff       (const double i) { max_coeff = i; }
           void set_max_coeff_step  (const double i) { max_coeff_step = i; }
           void set_min_cf_decrease (const double i) { min_cf_decrease_percentage = i; }
+          void set_subset_fraction (const double i) { subset_fraction = i; }
 
           void set_csv_path (const std::string& i) { csv_path = i; }
 
@@ -101,6 +104,9 @@ namespace MR {
           //   see how the cost function fares
           void calc_afcsa();
 
+          // Initialise the weighting coefficients from file, rather than from zero
+          void load_coefficients (const std::string&);
+
           void estimate_factors();
 
           void output_factors (const std::string&) const;
@@ -115,10 +121,21 @@ namespace MR {
           double reg_multiplier_tikhonov, reg_multiplier_tv;
           size_t min_iters, max_iters;
           double min_coeff, max_coeff, max_coeff_step, min_cf_decrease_percentage;
+          double subset_fraction;
           std::string csv_path;
 
           double data_scale_term;
 
+          // If set, only those streamlines within the subset are included in the model
+          std::unique_ptr<BitSet> subset;
+          bool in_subset (const SIFT::track_t i) const { return !subset || (*subset)[i]; }
+
+          void optimise (const std::string&, const double, unsigned int&, std::ofstream*);
+          void estimate_subset_factors (const double, unsigned int&, std::ofstream*);
+          void update_fixels();
+          void store_unweighted_TDs();
+          double calc_regularisation (double&, double&);
+
 
           friend class LineSearchFunctor;
           friend class CoefficientOptimiserBase;
@@ -163,6 +163,7 @@ void WriterExemplars::write (const node_t one, const node_t two, const std::stri
     if (selectors[i] (one, two))
       writer (exemplars[i].get());
   }
+  writer.finalise();
   if (weights_path.size()) {
     File::OFStream output (weights_path);
     for (size_t i = 0; i != exemplars.size(); ++i) {
@@ -181,6 +182,7 @@ void WriterExemplars::write (const node_t node, const std::string& path, const s
     if (selectors[i] (node))
       writer (exemplars[i].get());
   }
+  writer.finalise();
   if (weights_path.size()) {
     File::OFStream output (weights_path);
     for (size_t i = 0; i != exemplars.size(); ++i) {
@@ -197,6 +199,7 @@ void WriterExemplars::write (const std::string& path, const std::string& weights
   Tractography::Writer<float> writer (path, properties);
   for (std::vector<Exemplar>::const_iterator i = exemplars.begin(); i != exemplars.end(); ++i)
     writer (i->get());
+  writer.finalise();
   if (weights_path.size()) {
     File::OFStream output (weights_path);
     for (std::vector<Exemplar>::const_iterator i = exemplars.begin(); i != exemplars.end(); ++i)
@@ -312,6 +315,21 @@ bool WriterExtraction::operator() (const Connectome::Streamline_nodelist& in) co
   return true;
 }
 
+void WriterExtraction::finalise() const
+{
+  for (size_t i = 0; i != writers.size(); ++i)
+    writers[i]->finalise();
+}
+
+void WriterExtraction::skip (const uint64_t num) const
+{
+  // In exclusive mode, such streamlines are not passed to any of the
+  //   selectors, and so do not contribute to the total count
+  if (exclusive || !num) return;
+  for (size_t i = 0; i != file_count(); ++i)
+    writers[i]->skip (num);
+}
+
 
 
 
@@ -116,6 +116,11 @@ class WriterExtraction
     bool operator() (const Connectome::Streamline_nodepair&) const;
     bool operator() (const Connectome::Streamline_nodelist&) const;
 
+    // Account for streamlines that do not visit any node of interest
+    void skip (const uint64_t) const;
+
+    void finalise() const;
+
     size_t file_count() const { return writers.size(); }
 
 
@@ -17,6 +17,8 @@
 #define __dwi_tractography_editing_loader_h__
 
 
+#include <algorithm>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -34,45 +36,139 @@ namespace MR {
 
 
 
+        //! Load streamlines from one or more track files in turn
+        /*! Streamlines are read in blocks of consecutive streamlines directly
+         * from the memory-mapped track files. This functor can also be run
+         * using Thread::multi(), in which case multiple threads read
+         * different blocks concurrently, and streamlines are then no longer
+         * delivered in order.
+         *
+         * If a list of streamline indices is provided, only those
+         * streamlines are loaded (in the order listed), each being read
+         * directly from its location within the file. Indices refer to the
+         * position of each streamline across the concatenation of all input
+         * files. */
         class Loader
         {
 
           public:
-            Loader (const std::vector<std::string>& files) :
-              file_list (files),
-              dummy_properties (),
-              reader (new Reader<> (file_list[0], dummy_properties)),
-              file_index (0) { }
+            Loader (const std::vector<std::string>& files, const std::vector<uint64_t>& indices = std::vector<uint64_t>()) :
+              shared (new Shared (files, indices)),
+              reader (nullptr),
+              next (0),
+              end (0) { }
 
             bool operator() (Streamline<>&);
 
 
           private:
-            const std::vector<std::string>& file_list;
-            Properties dummy_properties;
-            std::unique_ptr<Reader<> > reader;
-            size_t file_index;
+            class Shared
+            {
+              public:
+                Shared (const std::vector<std::string>&, const std::vector<uint64_t>&);
+
+                bool next_block (Reader<>*&, size_t&, size_t&);
+
+                bool selection () const { return indices.size(); }
+                void load_selected (size_t, Streamline<>&) const;
+
+              private:
+                static constexpr size_t block_size = 256;
+                const std::vector<std::string>& file_list;
+                const std::vector<uint64_t> indices;
+                Properties dummy_properties;
+                // readers remain open until all threads are done with them:
+                std::vector<std::unique_ptr<Reader<>>> readers;
+                // index of the first streamline of each file, when loading a selection:
+                std::vector<uint64_t> starts;
+                size_t next;
+                std::mutex mutex;
+
+                void open_next ()
+                {
+                  dummy_properties.clear();
+                  readers.push_back (std::unique_ptr<Reader<>> (new Reader<> (file_list[readers.size()], dummy_properties)));
+                  readers.back()->index();
+                  next = 0;
+                }
+            };
+
+            std::shared_ptr<Shared> shared;
+            Reader<>* reader;
+            size_t next, end;
 
         };
 
 
 
-        bool Loader::operator() (Streamline<>& out)
+        Loader::Shared::Shared (const std::vector<std::string>& files, const std::vector<uint64_t>& indices) :
+            file_list (files),
+            indices (indices),
+            next (0)
         {
-          out.clear();
+          open_next();
+          if (indices.empty())
+            return;
+
+          starts.push_back (0);
+          while (true) {
+            starts.push_back (starts.back() + readers.back()->num_streamlines());
+            if (readers.size() == file_list.size())
+              break;
+            open_next();
+          }
+          for (const auto i : indices)
+            if (i >= starts.back())
+              throw Exception ("streamline index " + str(i) + " is out of range (input contains " + str(starts.back()) + " streamlines)");
+        }
+
+
 
-          if ((*reader) (out))
+        bool Loader::Shared::next_block (Reader<>*& reader, size_t& first, size_t& last)
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          if (selection()) {
+            // blocks are positions within the list of selected streamlines:
+            if (next == indices.size())
+              return false;
+            first = next;
+            last = next = std::min (next + block_size, indices.size());
             return true;
+          }
 
-          while (++file_index != file_list.size()) {
-            dummy_properties.clear();
-            reader.reset (new Reader<> (file_list[file_index], dummy_properties));
-            if ((*reader) (out))
-              return true;
+          while (next == readers.back()->num_streamlines()) {
+            if (readers.size() == file_list.size())
+              return false;
+            open_next();
           }
+          reader = readers.back().get();
+          first = next;
+          last = next = std::min (next + block_size, reader->num_streamlines());
+          return true;
+        }
+
 
-          return false;
 
+        void Loader::Shared::load_selected (size_t position, Streamline<>& out) const
+        {
+          const uint64_t index = indices[position];
+          const size_t file = std::upper_bound (starts.begin(), starts.end(), index) - starts.begin() - 1;
+          readers[file]->load (index - starts[file], out);
+        }
+
+
+
+        bool Loader::operator() (Streamline<>& out)
+        {
+          if (next == end && !shared->next_block (reader, next, end)) {
+            out.clear();
+            return false;
+          }
+          if (shared->selection())
+            shared->load_selected (next++, out);
+          else
+            reader->load (next++, out);
+          return true;
         }
 
 
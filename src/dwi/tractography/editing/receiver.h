@@ -62,6 +62,8 @@ namespace MR {
 
             bool operator() (const Streamline<>&);
 
+            void finalise () { writer.finalise(); }
+
 
           private:
 
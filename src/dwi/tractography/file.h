@@ -22,10 +22,15 @@
 #include "app.h"
 #include "types.h"
 #include "memory.h"
+#include "raw.h"
 #include "file/config.h"
 #include "file/key_value.h"
+#include "file/mmap.h"
 #include "file/ofstream.h"
+#include "file/utils.h"
 #include "dwi/tractography/file_base.h"
+#include "dwi/tractography/file_compact.h"
+#include "dwi/tractography/offset_index.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
@@ -51,26 +56,51 @@ namespace MR
       {
         public:
           virtual bool operator() (const Streamline<ValueType>&) = 0;
+          //! complete the output file once all streamlines have been written
+          virtual void finalise () { }
           virtual ~WriterInterface() { }
       };
 
 
 
       //! A class to read streamlines data
+      /*! The track data are memory-mapped, and streamlines can be read either
+       * sequentially using operator(), or directly by their index using
+       * load() or view(). Random access requires the streamline offset index
+       * (see OffsetIndex), which is built on first use of index(); once
+       * built, load() and view() can safely be invoked concurrently from
+       * multiple threads, allowing different ranges of the file to be read
+       * in parallel.
+       *
+       * Files in the compact format (.tckq suffix; see Compact::Decoder)
+       * are handled transparently. These hold their own index of streamline
+       * locations, so that no separate index needs to be built. */
       template <class ValueType = float>
       class Reader : public __ReaderBase__, public ReaderInterface<ValueType>
       {
         public:
+          typedef Eigen::Matrix<ValueType,3,1> point_type;
+          //! vertices of a streamline, directly within the memory-mapped file
+          typedef Eigen::Map<const Eigen::Matrix<ValueType,Eigen::Dynamic,3,Eigen::RowMajor>> View;
 
           //! open the \c file for reading and load header into \c properties
           Reader (const std::string& file, Properties& properties) :
-            current_index (0) {
-              open (file, "tracks", properties);
+            current_index (0),
+            position (0) {
+              const bool is_compact = Path::has_suffix (file, ".tckq");
+              const File::Entry entry = read_header (file, is_compact ? "compact tracks" : "tracks", properties);
+              data_file = entry.name;
+              mmap.reset (new File::MMap (entry, false, true));
+              vertex_bytes = 3 * dtype.bytes();
+              num_vertices = mmap->size() / vertex_bytes;
+              if (is_compact)
+                compact.reset (new Compact::Decoder (file, mmap->address(), mmap->size(), dtype, properties));
               auto opt = App::get_options ("tck_weights_in");
               if (opt.size()) {
-                weights_file.reset (new std::ifstream (str(opt[0][0]).c_str(), std::ios_base::in));
+                weights_path = str(opt[0][0]);
+                weights_file.reset (new std::ifstream (weights_path.c_str(), std::ios_base::in));
                 if (!weights_file->good())
-                  throw Exception ("Unable to open streamlines weights file " + str(opt[0][0]));
+                  throw Exception ("Unable to open streamlines weights file " + weights_path);
               }
             }
 
@@ -79,95 +109,170 @@ namespace MR
             bool operator() (Streamline<ValueType>& tck) {
               tck.clear();
 
-              if (!in.is_open())
+              if (!mmap)
                 return false;
 
-              do {
-                auto p = get_next_point();
-                if (std::isinf (p[0])) {
-                  in.close();
+              if (compact) {
+                if (current_index == compact->size()) {
+                  close();
                   check_excess_weights();
                   return false;
                 }
-                if (in.eof()) {
-                  in.close();
+                compact->load (current_index, tck);
+              } else {
+                const size_t end = find_delimiter (position);
+                if (end == num_vertices || std::isinf (get_x (end))) {
+                  close();
                   check_excess_weights();
                   return false;
                 }
+                get_vertices (position, end - position, tck);
+                position = end + 1;
+              }
+              tck.index = current_index++;
+
+              if (weights_file) {
 
-                if (std::isnan (p[0])) {
-                  tck.index = current_index++;
+                (*weights_file) >> tck.weight;
+                if (weights_file->fail()) {
+                  WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
+                  close();
+                  tck.clear();
+                  return false;
+                }
 
-                  if (weights_file) {
+              } else {
+                tck.weight = 1.0;
+              }
 
-                    (*weights_file) >> tck.weight;
-                    if (weights_file->fail()) {
-                      WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
-                      in.close();
-                      tck.clear();
-                      return false;
-                    }
+              return true;
+            }
 
-                  } else {
-                    tck.weight = 1.0;
-                  }
 
-                  return true;
-                }
+            //! release the memory-mapped track data
+            void close () { compact.reset(); mmap.reset(); }
 
-                tck.push_back (p);
-              } while (in.good());
 
-              in.close();
-              return false;
+            //! prepare for random access, building (or loading) the streamline offset index if required
+            /*! This must be invoked before streamlines are accessed
+             * concurrently using load() or view(). */
+            void index () {
+              if (!offsets) {
+                if (!mmap)
+                  throw Exception ("FIXME: random access to track file \"" + data_file + "\" requested after end of sequential read");
+                offsets.reset (new OffsetIndex);
+                if (!compact)
+                  offsets->build (data_file, mmap->address(), num_vertices, dtype);
+                if (weights_path.size())
+                  load_weights();
+              }
             }
 
+            //! the number of streamlines available for random access
+            size_t num_streamlines () {
+              index();
+              return compact ? compact->size() : offsets->size();
+            }
+
+            //! read streamline \a n directly
+            /*! \note index() must have been invoked beforehand */
+            void load (size_t n, Streamline<ValueType>& tck) const {
+              assert (offsets && mmap);
+              if (compact)
+                compact->load (n, tck);
+              else
+                get_vertices (offsets->first (n), offsets->num_vertices (n), tck);
+              tck.index = n;
+              tck.weight = weights.size() ? weights[n] : 1.0;
+            }
+
+            //! whether view() can be used, i.e. the file holds data of type ValueType in native byte order
+            bool is_direct () const {
+              if (compact)
+                return false;
+              DataType native (DataType::from<ValueType>());
+              native.set_byte_order_native();
+              return dtype == native;
+            }
+
+            //! the vertices of streamline \a n, without any copying
+            /*! \note index() must have been invoked beforehand, and the
+             * data type must allow direct access (see is_direct()) */
+            View view (size_t n) const {
+              assert (offsets && mmap && is_direct());
+              return View (reinterpret_cast<const ValueType*> (mmap->address() + offsets->first (n) * vertex_bytes), offsets->num_vertices (n), 3);
+            }
 
 
         protected:
-          using __ReaderBase__::in;
           using __ReaderBase__::dtype;
 
-          uint64_t current_index;
+          uint64_t current_index, position, num_vertices;
+          size_t vertex_bytes;
+          std::string data_file, weights_path;
+          std::unique_ptr<File::MMap> mmap;
+          std::unique_ptr<OffsetIndex> offsets;
+          std::unique_ptr<Compact::Decoder> compact;
           std::unique_ptr<std::ifstream> weights_file;
+          std::vector<float> weights;
+
+          //! x coordinate of the vertex at position \a n, used to identify delimiters
+          ValueType get_x (size_t n) const {
+            using namespace Raw;
+            const uint8_t* data = mmap->address();
+            switch (dtype()) {
+              case DataType::Float32LE: return fetch_LE<float32> (data, 3*n);
+              case DataType::Float32BE: return fetch_BE<float32> (data, 3*n);
+              case DataType::Float64LE: return fetch_LE<float64> (data, 3*n);
+              case DataType::Float64BE: return fetch_BE<float64> (data, 3*n);
+              default: assert (0); return NaN;
+            }
+          }
+
+          //! position of the first non-finite vertex from \a n onwards
+          size_t find_delimiter (size_t n) const {
+            while (n < num_vertices && std::isfinite (get_x (n)))
+              ++n;
+            return n;
+          }
 
           //! takes care of byte ordering issues
+          void get_vertices (size_t first, size_t count, Streamline<ValueType>& tck) const {
+            tck.resize (count);
+            switch (dtype()) {
+              case DataType::Float32LE: copy_vertices<float32,false> (first, tck); break;
+              case DataType::Float32BE: copy_vertices<float32,true>  (first, tck); break;
+              case DataType::Float64LE: copy_vertices<float64,false> (first, tck); break;
+              case DataType::Float64BE: copy_vertices<float64,true>  (first, tck); break;
+              default: assert (0); break;
+            }
+          }
 
-            Eigen::Matrix<ValueType,3,1> get_next_point ()
-            { 
-              using namespace ByteOrder;
-              switch (dtype()) {
-                case DataType::Float32LE: 
-                  {
-                    float p[3];
-                    in.read ((char*) p, sizeof (p));
-                    return { ValueType(LE(p[0])), ValueType(LE(p[1])), ValueType(LE(p[2])) };
-                  }
-                case DataType::Float32BE:
-                  {
-                    float p[3];
-                    in.read ((char*) p, sizeof (p));
-                    return { ValueType(BE(p[0])), ValueType(BE(p[1])), ValueType(BE(p[2])) };
-                  }
-                case DataType::Float64LE:
-                  {
-                    double p[3];
-                    in.read ((char*) p, sizeof (p));
-                    return { ValueType(LE(p[0])), ValueType(LE(p[1])), ValueType(LE(p[2])) };
-                  }
-                case DataType::Float64BE:
-                  {
-                    double p[3];
-                    in.read ((char*) p, sizeof (p));
-                    return { ValueType(BE(p[0])), ValueType(BE(p[1])), ValueType(BE(p[2])) };
-                  }
-                default:
-                  assert (0);
-                  break;
+          template <typename StoredType, bool big_endian>
+            void copy_vertices (size_t first, Streamline<ValueType>& tck) const {
+              using namespace Raw;
+              const uint8_t* data = mmap->address() + first * vertex_bytes;
+              for (size_t n = 0; n < tck.size(); ++n) {
+                for (size_t axis = 0; axis < 3; ++axis)
+                  tck[n][axis] = ValueType (big_endian ? fetch_BE<StoredType> (data, 3*n+axis) : fetch_LE<StoredType> (data, 3*n+axis));
               }
-              return { NaN, NaN, NaN };
             }
 
+          //! read all weights up-front, for use with random access
+          void load_weights () {
+            std::ifstream in (weights_path.c_str(), std::ios_base::in);
+            weights.resize (compact ? compact->size() : offsets->size());
+            for (auto& w : weights) {
+              in >> w;
+              if (in.fail())
+                throw Exception ("Streamline weights file " + weights_path + " contains less entries than .tck file");
+            }
+            float temp;
+            in >> temp;
+            if (!in.fail())
+              WARN ("Streamline weights file contains more entries than .tck file");
+          }
+
           //! Check that the weights file does not contain excess entries
           void check_excess_weights()
           {
@@ -200,6 +305,11 @@ namespace MR
        * use cases where a very large number of track files are being written
        * at once. For most applications (where typically one track file is
        * written at a time), the Writer class is more appropriate.
+       *
+       * If the file uses the .tckq suffix, tracks are written in the compact
+       * format (see Compact::Encoder). In this case, streamlines are
+       * necessarily committed to file in blocks, and the file is only
+       * complete once finalise() has been invoked.
        * */
       template <class ValueType = float>
         class WriterUnbuffered : public __WriterBase__<ValueType>, public WriterInterface<ValueType>
@@ -213,15 +323,26 @@ namespace MR
           using __WriterBase__<ValueType>::verify_stream;
           using __WriterBase__<ValueType>::update_counts;
           using __WriterBase__<ValueType>::open_success;
+          using __WriterBase__<ValueType>::count_offset;
 
           typedef Eigen::Matrix<ValueType,3,1> vector_type;
 
+          //! the information required to resume writing to an existing track file
+          /*! see resume_point() */
+          class ResumePoint
+          {
+            public:
+              uint64_t count, total_count;
+              int64_t count_offset, barrier_addr, weights_size;
+          };
+
           //! create a new track file with the specified properties
           WriterUnbuffered (const std::string& file, const Properties& properties) :
-              __WriterBase__<ValueType> (file) {
+              __WriterBase__<ValueType> (file),
+              weights_size (0) {
 
-            if (!Path::has_suffix (name, ".tck"))
-              throw Exception ("output track files must use the .tck suffix");
+            if (!Path::has_suffix (name, { ".tck", ".tckq" }))
+              throw Exception ("output track files must use the .tck or .tckq suffix");
 
             File::OFStream out;
             try {
@@ -233,12 +354,18 @@ namespace MR
             const_cast<Properties&> (properties).set_timestamp();
             const_cast<Properties&> (properties).set_version_info();
 
-            create (out, properties, "tracks");
-            barrier_addr = out.tellp();
-
-            vector_type x;
-            format_point (barrier(), x);
-            out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            if (Path::has_suffix (name, ".tckq")) {
+              compact.reset (new Compact::Encoder (name, dtype));
+              create (out, properties, "compact tracks", compact->header_entries());
+              compact->set_data_offset (out.tellp());
+            } else {
+              create (out, properties, "tracks");
+              barrier_addr = out.tellp();
+
+              vector_type x;
+              format_point (barrier(), x);
+              out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            }
             if (!out.good())
               throw Exception ("error writing tracks file \"" + name + "\": " + strerror (errno));
             open_success = true;
@@ -248,9 +375,69 @@ namespace MR
               set_weights_path (opt[0][0]);
           }
 
+          //! re-open an existing track file, and resume writing at the point specified
+          /*! Any track data (and weights, if the -tck_weights_out option is
+           * in use) written to file beyond \a resume are discarded. This is
+           * only supported for the standard .tck format. */
+          WriterUnbuffered (const std::string& file, const ResumePoint& resume) :
+              __WriterBase__<ValueType> (file, false),
+              barrier_addr (resume.barrier_addr),
+              weights_size (0) {
+
+            if (!Path::has_suffix (name, ".tck"))
+              throw Exception ("resuming output of track files is only supported for the .tck format");
+            if (!Path::is_file (name))
+              throw Exception ("cannot resume output to track file \"" + name + "\": file not found");
+
+            count = resume.count;
+            total_count = resume.total_count;
+            count_offset = resume.count_offset;
+
+            {
+              std::ifstream in (name.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+              if (int64_t (in.tellg()) < barrier_addr + int64_t (sizeof (vector_type)))
+                throw Exception ("cannot resume output to track file \"" + name + "\": file is shorter than expected");
+            }
+            File::resize (name, barrier_addr + sizeof (vector_type));
+
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            vector_type x;
+            format_point (barrier(), x);
+            out.seekp (barrier_addr);
+            out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            verify_stream (out);
+            update_counts (out);
+            open_success = true;
+
+            auto opt = App::get_options ("tck_weights_out");
+            if (opt.size()) {
+              weights_name = std::string (opt[0][0]);
+              if (!Path::is_file (weights_name))
+                throw Exception ("cannot resume output to streamline weights file \"" + weights_name + "\": file not found");
+              File::resize (weights_name, resume.weights_size);
+              weights_size = resume.weights_size;
+            }
+          }
+
+          //! complete the output file
+          /*! For compact (.tckq) files, this writes any remaining streamlines
+           * followed by the block table, and must be invoked once all
+           * streamlines have been written; this has no effect for the
+           * standard .tck format. */
+          void finalise () override {
+            if (compact && open_success)
+              compact->finalise();
+          }
+
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
-            if (tck.size()) {
+            if (tck.size() && compact) {
+              compact->append (tck);
+              if (weights_name.size())
+                write_weights (str(tck.weight) + "\n");
+              ++count;
+            }
+            else if (tck.size()) {
               // allocate buffer on the stack for performance:
               NON_POD_VLA (buffer, vector_type, tck.size()+2);
               for (size_t n = 0; n < tck.size(); ++n)
@@ -268,6 +455,13 @@ namespace MR
             return true;
           }
 
+          //! account for streamlines that are not written to file
+          /*! equivalent to passing \a num empty streamlines to operator(),
+           * without any of the per-streamline overhead */
+          void skip (const uint64_t num) {
+            total_count += num;
+          }
+
 
           //! set the path to the track weights
           void set_weights_path (const std::string& path) {
@@ -278,9 +472,20 @@ namespace MR
             File::OFStream out (weights_name, std::ios::out | std::ios::binary | std::ios::trunc);
           }
 
+          //! the point up to which data have been committed to file
+          /*! A WriterUnbuffered constructed from this information resumes
+           * writing at this point. Note that for the buffered Writer, this
+           * does not include any data yet to be flushed. This is only valid
+           * for the standard .tck format. */
+          ResumePoint resume_point () const {
+            assert (!compact);
+            return { count, total_count, count_offset, barrier_addr, weights_size };
+          }
+
         protected:
           std::string weights_name;
-          int64_t barrier_addr;
+          int64_t barrier_addr, weights_size;
+          std::unique_ptr<Compact::Encoder> compact;
 
           //! indicates end of track and start of new track
           vector_type delimiter () const { return { ValueType(NaN), ValueType(NaN), ValueType(NaN) }; }
@@ -302,6 +507,7 @@ namespace MR
             out << contents;
             if (!out.good())
               throw Exception ("error writing streamline weights file \"" + weights_name + "\": " + strerror (errno));
+            weights_size += contents.size();
           }
 
 
@@ -358,6 +564,7 @@ namespace MR
           using WriterUnbuffered<ValueType>::format_point;
           using WriterUnbuffered<ValueType>::weights_name;
           using WriterUnbuffered<ValueType>::write_weights;
+          using WriterUnbuffered<ValueType>::compact;
           typedef typename WriterUnbuffered<ValueType>::vector_type vector_type;
 
           //! create new RAM-buffered track file with specified properties
@@ -377,6 +584,14 @@ namespace MR
             buffer (new vector_type [buffer_capacity]),
             buffer_size (0) { }
 
+          //! re-open an existing track file, and resume writing at the point specified
+          /*! see WriterUnbuffered::resume_point() */
+          Writer (const std::string& file, const typename WriterUnbuffered<ValueType>::ResumePoint& resume, size_t default_buffer_capacity = 16777216) :
+            WriterUnbuffered<ValueType> (file, resume),
+            buffer_capacity (File::Config::get_int ("TrackWriterBufferSize", default_buffer_capacity) / sizeof (vector_type)),
+            buffer (new vector_type [buffer_capacity]),
+            buffer_size (0) { }
+
           Writer (const Writer& W) = delete;
 
           //! commits any remaining data to file
@@ -386,7 +601,16 @@ namespace MR
 
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
-            if (tck.size()) {
+            if (tck.size() && compact) {
+              // the compact encoder does its own buffering; only need to
+              // flush the weights whenever a block has been written
+              if (weights_name.size())
+                weights_buffer += str (tck.weight) + ' ';
+              if (compact->append (tck))
+                commit();
+              ++count;
+            }
+            else if (tck.size()) {
               if (buffer_size + tck.size() + 2 > buffer_capacity)
                 commit ();
 
@@ -403,6 +627,18 @@ namespace MR
             return true;
           }
 
+          //! commit any data held in the RAM buffer to file
+          void flush () {
+            commit();
+          }
+
+          //! commit any data held in the RAM buffer, and complete the output file
+          /*! see WriterUnbuffered::finalise() */
+          void finalise () override {
+            commit();
+            WriterUnbuffered<ValueType>::finalise();
+          }
+
 
         protected:
           const size_t buffer_capacity;
@@ -23,6 +23,17 @@ namespace MR {
 
 
       void __ReaderBase__::open (const std::string& file, const std::string& type, Properties& properties)
+      {
+        const File::Entry entry = read_header (file, type, properties);
+        in.open (entry.name.c_str(), std::ios::in | std::ios::binary);
+        if (!in)
+          throw Exception ("error opening " + type  + " data file \"" + entry.name + "\": " + strerror(errno));
+        in.seekg (entry.start);
+      }
+
+
+
+      File::Entry __ReaderBase__::read_header (const std::string& file, const std::string& type, Properties& properties)
       {
         properties.clear();
         dtype = DataType::Undefined;
@@ -75,10 +86,7 @@ namespace MR {
         else
           fname = file;
 
-        in.open (fname.c_str(), std::ios::in | std::ios::binary);
-        if (!in)
-          throw Exception ("error opening " + type  + " data file \"" + fname + "\": " + strerror(errno));
-        in.seekg (offset);
+        return File::Entry (fname, offset);
       }
 
     }
@@ -20,6 +20,7 @@
 #include <map>
 
 #include "types.h"
+#include "file/entry.h"
 #include "file/key_value.h"
 #include "file/ofstream.h"
 #include "file/path.h"
@@ -50,6 +51,9 @@ namespace MR
 
         protected:
 
+          //! parse the header, and return the location of the data
+          File::Entry read_header (const std::string& file, const std::string& firstline, Properties& properties);
+
           std::ifstream  in;
           DataType  dtype;
       };
@@ -61,7 +65,7 @@ namespace MR
           public:
             typedef ValueType value_type;
 
-            __WriterBase__(const std::string& name) :
+            __WriterBase__(const std::string& name, const bool new_file = true) :
               count (0),
               total_count (0),
               name (name), 
@@ -74,7 +78,8 @@ namespace MR
                 dtype != DataType::Float64LE && dtype != DataType::Float64BE)
               throw Exception ("only supported datatype for tracks file are "
                   "Float32LE, Float32BE, Float64LE & Float64BE");
-            App::check_overwrite (name);
+            if (new_file)
+              App::check_overwrite (name);
           }
 
             ~__WriterBase__()
@@ -85,13 +90,16 @@ namespace MR
               }
             }
 
-            void create (File::OFStream& out, const Properties& properties, const std::string& type) {
+            void create (File::OFStream& out, const Properties& properties, const std::string& type,
+                const std::map<std::string,std::string>& format_entries = std::map<std::string,std::string>()) {
               out << "mrtrix " + type + "\nEND\n";
 
               for (const auto& i : properties) {
-                if ((i.first != "count") && (i.first != "total_count"))
+                if ((i.first != "count") && (i.first != "total_count") && !format_entries.count (i.first))
                   out << i.first << ": " << i.second << "\n";
               }
+              for (const auto& i : format_entries)
+                out << i.first << ": " << i.second << "\n";
 
               for (const auto& i : properties.comments) 
                 out << "comment: " << i << "\n";
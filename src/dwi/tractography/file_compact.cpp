@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+
+#include "dwi/tractography/file_compact.h"
+
+#include <atomic>
+#include <cstring>
+#include <zlib.h>
+
+#include "file/config.h"
+#include "file/ofstream.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Compact
+      {
+
+
+        namespace {
+
+          const char signature[] = "TCKQ";
+
+          std::atomic<uint64_t> next_uid (1);
+
+          template <typename ValueType>
+            void put (std::vector<uint8_t>& buffer, const ValueType value) {
+              buffer.resize (buffer.size() + sizeof (ValueType));
+              Raw::store_LE<ValueType> (value, &buffer[buffer.size() - sizeof (ValueType)]);
+            }
+
+        }
+
+
+
+        constexpr size_t Encoder::streamlines_per_block;
+
+
+
+        //CONF option: CompactTrackQuantisation
+        //CONF default: 0.001
+        //CONF The step size (in mm) to which vertex positions are quantised
+        //CONF when writing track files in the compact (.tckq) format. Smaller
+        //CONF values preserve vertex positions more precisely, at the expense
+        //CONF of larger files.
+
+        //CONF option: CompactTrackCompression
+        //CONF default: 0 (false)
+        //CONF Whether to additionally compress each block of streamlines when
+        //CONF writing track files in the compact (.tckq) format. This further
+        //CONF reduces file size, at the expense of slower reading & writing.
+        Encoder::Encoder (const std::string& path, const DataType dtype) :
+            path (path),
+            dtype (dtype),
+            step (to<default_type> (File::Config::get ("CompactTrackQuantisation", "0.001"))),
+            inv_step (1.0 / step),
+            deflate (File::Config::get_bool ("CompactTrackCompression", false)),
+            out (path, std::ios::in | std::ios::out | std::ios::binary),
+            finalised (false),
+            data_offset (0),
+            num_streamlines (0),
+            data_size (0)
+        {
+          if (!std::isfinite (step) || step <= 0.0)
+            throw Exception ("invalid value for config file entry CompactTrackQuantisation (must be positive)");
+        }
+
+
+
+        std::map<std::string,std::string> Encoder::header_entries () const
+        {
+          std::map<std::string,std::string> entries;
+          entries["quantisation"] = str (step, 10);
+          entries["compression"] = deflate ? "deflate" : "none";
+          return entries;
+        }
+
+
+
+        void Encoder::commit ()
+        {
+          if (streamline_offsets.empty())
+            return;
+
+          std::vector<uint8_t> raw;
+          raw.reserve (4 * (streamline_offsets.size()+1) + payload.size());
+          put<uint32_t> (raw, streamline_offsets.size());
+          for (const auto offset : streamline_offsets)
+            put<uint32_t> (raw, offset);
+          raw.insert (raw.end(), payload.begin(), payload.end());
+          payload.clear();
+          streamline_offsets.clear();
+
+          std::vector<uint8_t> block;
+          put<uint32_t> (block, 0);
+          put<uint32_t> (block, raw.size());
+          if (deflate) {
+            uLongf stored_size = compressBound (raw.size());
+            block.resize (8 + stored_size);
+            if (compress2 (&block[8], &stored_size, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+              throw Exception ("error compressing data for track file \"" + path + "\"");
+            block.resize (8 + stored_size);
+          } else {
+            block.insert (block.end(), raw.begin(), raw.end());
+          }
+          Raw::store_LE<uint32_t> (block.size() - 8, &block[0]);
+
+          out.seekp (data_offset + data_size);
+          out.write (reinterpret_cast<const char*> (block.data()), block.size());
+          if (!out.good())
+            throw Exception ("error writing track file \"" + path + "\": " + strerror (errno));
+
+          block_offsets.push_back (data_size);
+          data_size += block.size();
+        }
+
+
+
+        void Encoder::finalise ()
+        {
+          if (finalised)
+            return;
+          commit();
+
+          std::vector<uint8_t> table;
+          for (const auto offset : block_offsets)
+            put<uint64_t> (table, offset);
+          put<uint64_t> (table, data_size);
+          put<uint64_t> (table, block_offsets.size());
+          put<uint64_t> (table, num_streamlines);
+          put<uint32_t> (table, streamlines_per_block);
+          table.insert (table.end(), signature, signature+4);
+
+          out.seekp (data_offset + data_size);
+          out.write (reinterpret_cast<const char*> (table.data()), table.size());
+          out.close();
+          if (!out.good())
+            throw Exception ("error writing track file \"" + path + "\": " + strerror (errno));
+          finalised = true;
+        }
+
+
+
+
+
+
+
+        Decoder::Decoder (const std::string& path, const uint8_t* data, size_t size, const DataType dtype, Properties& properties) :
+            path (path),
+            data (data),
+            dtype (dtype),
+            step (NaN),
+            deflate (false),
+            uid (next_uid++)
+        {
+          auto it = properties.find ("quantisation");
+          if (it == properties.end())
+            throw Exception ("missing quantisation entry in header of track file \"" + path + "\"");
+          step = to<default_type> (it->second);
+          properties.erase (it);
+
+          it = properties.find ("compression");
+          if (it != properties.end()) {
+            if (it->second == "deflate")
+              deflate = true;
+            else if (it->second != "none")
+              throw Exception ("unsupported compression \"" + it->second + "\" in track file \"" + path + "\"");
+            properties.erase (it);
+          }
+
+          if (size < trailer_size || memcmp (data + size - 4, signature, 4)) {
+            scan (size);
+            return;
+          }
+          const uint8_t* trailer = data + size - trailer_size;
+          const uint64_t table_offset = Raw::fetch_LE<uint64_t> (trailer);
+          num_blocks = Raw::fetch_LE<uint64_t> (trailer + 8);
+          num_streamlines = Raw::fetch_LE<uint64_t> (trailer + 16);
+          streamlines_per_block = Raw::fetch_LE<uint32_t> (trailer + 24);
+          if (!streamlines_per_block ||
+              table_offset + 8*num_blocks + trailer_size != size ||
+              num_blocks != (num_streamlines + streamlines_per_block - 1) / streamlines_per_block)
+            throw Exception ("track file \"" + path + "\" is incomplete or corrupt");
+          table = data + table_offset;
+          blocks_size = table_offset;
+        }
+
+
+
+        void Decoder::scan (size_t size)
+        {
+          // Output was not finalised: recover all blocks that were written in full
+          streamlines_per_block = Encoder::streamlines_per_block;
+          uint64_t offset = 0;
+          while (offset + 8 <= size) {
+            const uint64_t stored_size = Raw::fetch_LE<uint32_t> (data + offset);
+            if (!stored_size || offset + 8 + stored_size > size)
+              break;
+            put<uint64_t> (scanned_table, offset);
+            offset += 8 + stored_size;
+          }
+          num_blocks = scanned_table.size() / 8;
+          table = scanned_table.data();
+          blocks_size = offset;
+
+          num_streamlines = 0;
+          if (num_blocks) {
+            size_t raw_size;
+            const uint8_t* last = block (num_blocks-1, raw_size);
+            if (raw_size < 4)
+              throw Exception ("track file \"" + path + "\" is corrupt");
+            num_streamlines = (num_blocks-1) * streamlines_per_block + Raw::fetch_LE<uint32_t> (last);
+          }
+          WARN ("track file \"" + path + "\" is incomplete; only the " + str(num_streamlines) + " streamlines contained in complete blocks can be read");
+        }
+
+
+
+        const uint8_t* Decoder::block (size_t b, size_t& raw_size) const
+        {
+          assert (b < num_blocks);
+          const uint64_t offset = Raw::fetch_LE<uint64_t> (table, b);
+          if (offset + 8 > blocks_size)
+            throw Exception ("track file \"" + path + "\" is corrupt");
+          const uint8_t* p = data + offset;
+          const uint32_t stored_size = Raw::fetch_LE<uint32_t> (p);
+          if (offset + 8 + stored_size > blocks_size)
+            throw Exception ("track file \"" + path + "\" is corrupt");
+          if (!deflate) {
+            raw_size = stored_size;
+            return p + 8;
+          }
+
+          struct Cache {
+            uint64_t uid = 0;
+            size_t block = 0;
+            std::vector<uint8_t> contents;
+          };
+          static thread_local Cache cache;
+          if (cache.uid != uid || cache.block != b) {
+            uLongf size = Raw::fetch_LE<uint32_t> (p + 4);
+            cache.contents.resize (size);
+            if (uncompress (cache.contents.data(), &size, p + 8, stored_size) != Z_OK || size != cache.contents.size()) {
+              cache.uid = 0;
+              throw Exception ("error decompressing data from track file \"" + path + "\"");
+            }
+            cache.uid = uid;
+            cache.block = b;
+          }
+          raw_size = cache.contents.size();
+          return cache.contents.data();
+        }
+
+
+
+        void Decoder::get_origin (const uint8_t*& p, const uint8_t* end, double* origin) const
+        {
+          if (end - p < ptrdiff_t (3*dtype.bytes()))
+            throw Exception ("track file \"" + path + "\" is corrupt");
+          const bool is_big_endian = !dtype.is_little_endian();
+          if (dtype.bytes() == 4) {
+            for (size_t axis = 0; axis != 3; ++axis)
+              origin[axis] = Raw::fetch<float32> (p, axis, is_big_endian);
+            p += 12;
+          } else {
+            for (size_t axis = 0; axis != 3; ++axis)
+              origin[axis] = Raw::fetch<float64> (p, axis, is_big_endian);
+            p += 24;
+          }
+        }
+
+
+
+      }
+    }
+  }
+}
+
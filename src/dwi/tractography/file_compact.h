@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+#ifndef __dwi_tractography_file_compact_h__
+#define __dwi_tractography_file_compact_h__
+
+
+#include <map>
+#include <vector>
+
+#include "datatype.h"
+#include "raw.h"
+#include "types.h"
+#include "file/ofstream.h"
+#include "dwi/tractography/properties.h"
+#include "dwi/tractography/streamline.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+      //! support for the compact track file format (.tckq)
+      /*! In this format, the first vertex of each streamline is stored at
+       * full precision, and each subsequent vertex is stored as the
+       * difference from the previous vertex, quantised to a fixed step size
+       * (CompactTrackQuantisation config file entry), using a variable-length
+       * integer encoding. Since quantisation is performed relative to the
+       * first vertex rather than to the previous reconstructed vertex,
+       * quantisation errors do not accumulate along the streamline.
+       *
+       * Streamlines are grouped into blocks, each of which can optionally be
+       * compressed independently (CompactTrackCompression config file
+       * entry). The location of each block is stored in a table at the end
+       * of the file, allowing any streamline to be accessed directly by its
+       * index.
+       *
+       * The data following the text header are laid out as follows (all
+       * integers little-endian):
+       * - for each block: the stored size and the decompressed size of the
+       *   block (uint32 each), followed by the block contents;
+       * - the block table: the offset of each block from the start of the
+       *   data (uint64 each);
+       * - a trailer: the offset of the block table, the number of blocks,
+       *   the number of streamlines (uint64 each), the number of streamlines
+       *   per block (uint32), and the signature "TCKQ".
+       *
+       * The block table and trailer are only written once output is complete
+       * (see Encoder::finalise()). If these are absent, the blocks are instead
+       * located by scanning through the file, and any streamlines that had
+       * not yet been committed to a complete block are lost.
+       *
+       * Once decompressed, each block consists of the number of streamlines
+       * it contains (uint32), the offset of each streamline relative to the
+       * end of this table (uint32 each), followed by the streamlines
+       * themselves. Each streamline is stored as its number of vertices
+       * (varint), its first vertex (3 values of the header datatype), and the
+       * differences between consecutive quantised vertex positions (3 signed
+       * varints per vertex). */
+      namespace Compact
+      {
+
+        constexpr size_t trailer_size = 32;
+
+
+        //! encodes streamlines and appends them to the file in blocks
+        /*! The file must already exist when the Encoder is constructed; it is
+         * kept open until finalise() is invoked. */
+        class Encoder
+        {
+          public:
+            Encoder (const std::string& path, const DataType dtype);
+
+            //! the header entries describing the encoding
+            std::map<std::string,std::string> header_entries () const;
+
+            //! the offset of the data within the file, once the header has been written
+            void set_data_offset (int64_t offset) { data_offset = offset; }
+
+            //! add a streamline, returns true if a block was written to file as a result
+            template <typename ValueType>
+              bool append (const Streamline<ValueType>& tck)
+              {
+                assert (tck.size());
+                if (finalised)
+                  throw Exception ("cannot append streamlines to track file \"" + path + "\" once it has been finalised");
+                streamline_offsets.push_back (payload.size());
+                put_varint (tck.size());
+
+                double origin[3];
+                const size_t bytes = dtype.bytes();
+                payload.resize (payload.size() + 3*bytes);
+                uint8_t* p = &payload[payload.size() - 3*bytes];
+                for (size_t axis = 0; axis != 3; ++axis) {
+                  if (bytes == 4) {
+                    const float32 value (tck[0][axis]);
+                    Raw::store<float32> (value, p, axis, !dtype.is_little_endian());
+                    origin[axis] = value;
+                  } else {
+                    const float64 value (tck[0][axis]);
+                    Raw::store<float64> (value, p, axis, !dtype.is_little_endian());
+                    origin[axis] = value;
+                  }
+                }
+
+                int64_t previous[3] = { 0, 0, 0 };
+                for (size_t n = 1; n != tck.size(); ++n) {
+                  for (size_t axis = 0; axis != 3; ++axis) {
+                    const double offset = (double (tck[n][axis]) - origin[axis]) * inv_step;
+                    if (!std::isfinite (offset))
+                      throw Exception ("non-finite vertex encountered while writing track file \"" + path + "\"");
+                    const int64_t q = std::llround (offset);
+                    const int64_t delta = q - previous[axis];
+                    put_varint ((uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+                    previous[axis] = q;
+                  }
+                }
+
+                ++num_streamlines;
+                if (streamline_offsets.size() == streamlines_per_block) {
+                  commit();
+                  return true;
+                }
+                return false;
+              }
+
+            //! write any remaining streamlines, followed by the block table
+            /*! This has no effect if the file has already been finalised. */
+            void finalise ();
+
+            bool is_finalised () const { return finalised; }
+
+            static constexpr size_t streamlines_per_block = 256;
+
+          protected:
+            const std::string path;
+            const DataType dtype;
+            const default_type step, inv_step;
+            const bool deflate;
+            File::OFStream out;
+            bool finalised;
+            int64_t data_offset;
+            uint64_t num_streamlines, data_size;
+            std::vector<uint8_t> payload;
+            std::vector<uint32_t> streamline_offsets;
+            std::vector<uint64_t> block_offsets;
+
+            void put_varint (uint64_t value) {
+              while (value >= 0x80) {
+                payload.push_back (uint8_t (value | 0x80));
+                value >>= 7;
+              }
+              payload.push_back (uint8_t (value));
+            }
+
+            void commit ();
+        };
+
+
+
+
+        //! decodes streamlines from the memory-mapped contents of a file
+        /*! load() can be invoked concurrently from multiple threads. If the
+         * blocks are compressed, each thread keeps the most recently
+         * decompressed block, so that consecutive streamlines can be read
+         * without decompressing the same block repeatedly. */
+        class Decoder
+        {
+          public:
+            //! \a data & \a size refer to the data following the header; the
+            //! encoding entries are removed from \a properties
+            Decoder (const std::string& path, const uint8_t* data, size_t size, const DataType dtype, Properties& properties);
+
+            size_t size () const { return num_streamlines; }
+
+            template <typename ValueType>
+              void load (size_t n, Streamline<ValueType>& tck) const
+              {
+                assert (n < num_streamlines);
+                size_t raw_size;
+                const uint8_t* raw = block (n / streamlines_per_block, raw_size);
+                const uint8_t* const end = raw + raw_size;
+                if (raw_size < 4)
+                  throw Exception ("track file \"" + path + "\" is corrupt");
+                const uint32_t count = Raw::fetch_LE<uint32_t> (raw);
+                const size_t i = n % streamlines_per_block;
+                if (i >= count || 4*(uint64_t(count)+1) > raw_size)
+                  throw Exception ("track file \"" + path + "\" is corrupt");
+                const uint64_t offset = 4*(uint64_t(count)+1) + Raw::fetch_LE<uint32_t> (raw, i+1);
+                if (offset >= raw_size)
+                  throw Exception ("track file \"" + path + "\" is corrupt");
+                const uint8_t* p = raw + offset;
+
+                const uint64_t num_vertices = get_varint (p, end);
+                // each vertex beyond the first occupies at least 3 bytes
+                if (!num_vertices || num_vertices > uint64_t (end - p) / 3 + 1)
+                  throw Exception ("track file \"" + path + "\" is corrupt");
+                tck.resize (num_vertices);
+                double origin[3];
+                get_origin (p, end, origin);
+                tck[0] = { ValueType (origin[0]), ValueType (origin[1]), ValueType (origin[2]) };
+                int64_t q[3] = { 0, 0, 0 };
+                for (size_t v = 1; v < tck.size(); ++v) {
+                  for (size_t axis = 0; axis != 3; ++axis) {
+                    const uint64_t zigzag = get_varint (p, end);
+                    q[axis] += int64_t (zigzag >> 1) ^ -int64_t (zigzag & 1);
+                    tck[v][axis] = ValueType (origin[axis] + q[axis] * step);
+                  }
+                }
+              }
+
+          protected:
+            const std::string path;
+            const uint8_t* data;
+            const DataType dtype;
+            default_type step;
+            bool deflate;
+            uint64_t num_streamlines, num_blocks, streamlines_per_block;
+            uint64_t blocks_size;
+            const uint8_t* table;
+            std::vector<uint8_t> scanned_table;
+            const uint64_t uid;
+
+            //! locate the blocks in a file that has no block table
+            void scan (size_t size);
+
+            //! the decompressed contents of block \a b, and their size
+            const uint8_t* block (size_t b, size_t& raw_size) const;
+
+            void get_origin (const uint8_t*& p, const uint8_t* end, double* origin) const;
+
+            uint64_t get_varint (const uint8_t*& p, const uint8_t* end) const {
+              uint64_t value = 0;
+              for (size_t shift = 0; shift < 64; shift += 7) {
+                if (p == end)
+                  break;
+                const uint8_t byte = *p++;
+                value |= uint64_t (byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                  return value;
+              }
+              throw Exception ("track file \"" + path + "\" is corrupt");
+            }
+        };
+
+
+      }
+
+    }
+  }
+}
+
+
+#endif
+
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+
+#include "dwi/tractography/file_parallel.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+
+      __ParallelOutput__::__ParallelOutput__ (const std::string& name) :
+          name (name)
+      {
+#ifdef MRTRIX_WINDOWS
+        fd = ::open (name.c_str(), O_WRONLY | O_BINARY);
+#else
+        fd = ::open (name.c_str(), O_WRONLY);
+#endif
+        if (fd < 0)
+          throw Exception ("error opening track file \"" + name + "\" for writing: " + strerror (errno));
+      }
+
+
+
+      __ParallelOutput__::~__ParallelOutput__ ()
+      {
+        ::close (fd);
+      }
+
+
+
+      void __ParallelOutput__::write (const void* data, size_t size, int64_t offset)
+      {
+        const char* p = reinterpret_cast<const char*> (data);
+#ifdef MRTRIX_WINDOWS
+        // no pwrite() on Windows: serialise seek & write instead
+        std::lock_guard<std::mutex> lock (mutex);
+        if (lseek64 (fd, offset, SEEK_SET) != offset)
+          throw Exception ("error writing track file \"" + name + "\": " + strerror (errno));
+#endif
+        while (size) {
+#ifdef MRTRIX_WINDOWS
+          const ssize_t written = ::write (fd, p, size);
+#else
+          const ssize_t written = ::pwrite (fd, p, size, offset);
+#endif
+          if (written < 0) {
+            if (errno == EINTR)
+              continue;
+            throw Exception ("error writing track file \"" + name + "\": " + strerror (errno));
+          }
+          p += written;
+          size -= written;
+          offset += written;
+        }
+      }
+
+
+
+    }
+  }
+}
+
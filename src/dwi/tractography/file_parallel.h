@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+#ifndef __dwi_tractography_file_parallel_h__
+#define __dwi_tractography_file_parallel_h__
+
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "app.h"
+#include "raw.h"
+#include "thread.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "dwi/tractography/file_base.h"
+#include "dwi/tractography/properties.h"
+#include "dwi/tractography/streamline.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! \cond skip
+      // write data to arbitrary locations within a file from multiple threads
+      class __ParallelOutput__
+      {
+        public:
+          __ParallelOutput__ (const std::string& name);
+          ~__ParallelOutput__ ();
+
+          void write (const void* data, size_t size, int64_t offset);
+
+        protected:
+          const std::string name;
+          int fd;
+#ifdef MRTRIX_WINDOWS
+          std::mutex mutex;
+#endif
+      };
+      //! \endcond
+
+
+
+
+      //! class to handle writing tracks to file concurrently from multiple threads
+      /*! Each thread appends streamlines to its own ParallelWriter::Buffer.
+       * Once full, the buffer reserves the next region of the file by
+       * atomically advancing the end of the track data, and writes its
+       * contents directly into that region, without waiting for any other
+       * thread. Streamlines are therefore stored in the order in which
+       * buffers are committed, rather than the order in which they were
+       * generated.
+       *
+       * Track weights (if requested via the -tck_weights_out option) are
+       * held in memory along with the location of the corresponding data,
+       * and are written out in the correct order once all buffers have been
+       * committed. The streamline counts in the header and the end-of-data
+       * barrier are likewise only written by finish(); the file cannot be
+       * read before then.
+       *
+       * Each buffer must be committed before finish() is invoked, and
+       * destroyed before the ParallelWriter itself; data remaining in a
+       * buffer when it is destroyed are discarded. Where a buffer is
+       * committed from a context in which exceptions cannot be propagated
+       * (e.g. as a thread terminates), Buffer::close() records any failure,
+       * which is then reported by finish(). Only the standard .tck format is
+       * supported.
+       *
+       * \code
+       * ParallelWriter<float> writer (path, properties);
+       * // in each thread:
+       * ParallelWriter<float>::Buffer buffer (writer);
+       * Streamline<float> tck;
+       * while (...)
+       *   buffer (tck);
+       * buffer.close();
+       * // once all threads have completed:
+       * writer.finish();
+       * \endcode */
+      template <typename ValueType = float>
+        class ParallelWriter : public __WriterBase__<ValueType>
+      {
+        public:
+          using __WriterBase__<ValueType>::count;
+          using __WriterBase__<ValueType>::total_count;
+          using __WriterBase__<ValueType>::name;
+          using __WriterBase__<ValueType>::dtype;
+          using __WriterBase__<ValueType>::create;
+          using __WriterBase__<ValueType>::open_success;
+
+          typedef Eigen::Matrix<ValueType,3,1> vector_type;
+
+          //! create a new track file with the specified properties
+          ParallelWriter (const std::string& file, const Properties& properties) :
+              __WriterBase__<ValueType> (file),
+              written (0),
+              processed (0)
+          {
+            if (!Path::has_suffix (name, ".tck"))
+              throw Exception ("concurrent writing of track files is only supported for the .tck format");
+
+            {
+              File::OFStream out (name, std::ios::out | std::ios::binary | std::ios::trunc);
+              const_cast<Properties&> (properties).set_timestamp();
+              const_cast<Properties&> (properties).set_version_info();
+              create (out, properties, "tracks");
+              end = out.tellp();
+              const vector_type x = format (barrier());
+              out.write (reinterpret_cast<const char*> (&x[0]), sizeof (x));
+              if (!out.good())
+                throw Exception ("error writing tracks file \"" + name + "\": " + strerror (errno));
+            }
+            output.reset (new __ParallelOutput__ (name));
+            open_success = true;
+
+            auto opt = App::get_options ("tck_weights_out");
+            if (opt.size()) {
+              weights_name = std::string (opt[0][0]);
+              File::OFStream out (weights_name, std::ios::out | std::ios::binary | std::ios::trunc);
+            }
+          }
+
+          ParallelWriter (const ParallelWriter&) = delete;
+
+          //! the number of streamlines written so far, by buffers that have been committed
+          uint64_t num_written () const { return written; }
+          //! the number of streamlines processed so far (including empty streamlines), by buffers that have been committed
+          uint64_t num_processed () const { return processed; }
+
+          //! write the end-of-data barrier, weights, and final counts
+          /*! This must be invoked once all buffers have been committed. Any
+           * failure to write to file, including those recorded by
+           * Buffer::close(), is reported by throwing an Exception. */
+          void finish ()
+          {
+            if (!open_success || !output)
+              return;
+            {
+              std::lock_guard<std::mutex> lock (mutex);
+              if (failure)
+                throw *failure;
+            }
+            const vector_type x = format (barrier());
+            output->write (&x[0], sizeof (x), end);
+            output.reset();
+            count = written;
+            total_count = processed;
+
+            if (weights_name.size()) {
+              std::sort (weights.begin(), weights.end());
+              File::OFStream out (weights_name, std::ios::out | std::ios::binary | std::ios::trunc);
+              for (const auto& w : weights)
+                out << w.second;
+              if (!out.good())
+                throw Exception ("error writing streamline weights file \"" + weights_name + "\": " + strerror (errno));
+            }
+          }
+
+
+
+          //! buffer holding the streamlines from one thread
+          /*! Copy-constructing a Buffer produces a new, empty buffer writing
+           * to the same ParallelWriter, so that functors holding a Buffer
+           * can be duplicated using Thread::multi(). The capacity of the
+           * buffer (in bytes) can be set using the TrackWriterBufferSize
+           * config file entry, divided equally between threads. */
+          class Buffer
+          {
+            public:
+              Buffer (ParallelWriter& writer) :
+                  writer (writer),
+                  capacity (File::Config::get_int ("TrackWriterBufferSize", 16777216) / (sizeof (vector_type) * std::max (Thread::number_of_threads(), size_t(1)))),
+                  written (0),
+                  processed (0) {
+                    data.reserve (capacity);
+                  }
+
+              Buffer (const Buffer& that) :
+                  Buffer (that.writer) { }
+
+              //! write the contents of the buffer to file, recording any failure in the ParallelWriter
+              void close () {
+                try {
+                  commit();
+                }
+                catch (Exception& e) {
+                  std::lock_guard<std::mutex> lock (writer.mutex);
+                  if (!writer.failure)
+                    writer.failure.reset (new Exception (e));
+                }
+              }
+
+              //! append track to buffer
+              void operator() (const Streamline<ValueType>& tck) {
+                if (tck.size()) {
+                  if (data.size() + tck.size() + 1 > capacity)
+                    commit();
+                  for (const auto& i : tck)
+                    data.push_back (writer.format (i));
+                  data.push_back (writer.format (writer.delimiter()));
+                  if (writer.weights_name.size())
+                    weights += str (tck.weight) + '\n';
+                  ++written;
+                }
+                ++processed;
+              }
+
+              //! write the contents of the buffer to file
+              void commit () {
+                if (data.size()) {
+                  const int64_t offset = writer.end.fetch_add (data.size() * sizeof (vector_type));
+                  writer.output->write (&data[0], data.size() * sizeof (vector_type), offset);
+                  data.clear();
+                  if (writer.weights_name.size()) {
+                    std::lock_guard<std::mutex> lock (writer.mutex);
+                    writer.weights.push_back (std::make_pair (offset, std::move (weights)));
+                    weights.clear();
+                  }
+                }
+                writer.written += written;
+                writer.processed += processed;
+                written = processed = 0;
+              }
+
+            protected:
+              ParallelWriter& writer;
+              const size_t capacity;
+              std::vector<vector_type, Eigen::aligned_allocator<vector_type>> data;
+              std::string weights;
+              uint64_t written, processed;
+          };
+
+
+        protected:
+          std::unique_ptr<__ParallelOutput__> output;
+          std::atomic<int64_t> end;
+          std::atomic<uint64_t> written, processed;
+          std::string weights_name;
+          std::vector<std::pair<int64_t,std::string>> weights;
+          std::unique_ptr<Exception> failure;
+          std::mutex mutex;
+
+          vector_type delimiter () const { return { ValueType(NaN), ValueType(NaN), ValueType(NaN) }; }
+          vector_type barrier   () const { return { ValueType(Inf), ValueType(Inf), ValueType(Inf) }; }
+
+          vector_type format (const vector_type& p) const {
+            using namespace ByteOrder;
+            if (dtype.is_little_endian())
+              return { LE(p[0]), LE(p[1]), LE(p[2]) };
+            return { BE(p[0]), BE(p[1]), BE(p[2]) };
+          }
+      };
+
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -79,6 +79,7 @@ namespace MR {
                     voxelise_ends (in, out);
                   else
                     voxelise (in, out);
+                  out.finalise();
                   postprocess (in, out);
                 }
                 return true;
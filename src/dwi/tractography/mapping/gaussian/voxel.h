@@ -154,59 +154,47 @@ namespace MR {
 
 
 
-          class SetVoxel : public std::set<Voxel>, public Mapping::SetVoxelExtras
+          class SetVoxel : public Mapping::VoxelSet<Voxel>, public Mapping::SetVoxelExtras
           {
             public:
               typedef Voxel VoxType;
               inline void insert (const Eigen::Vector3i& v, const float l, const float f)
               {
                 const Voxel temp (v, l, f);
-                iterator existing = std::set<Voxel>::find (temp);
-                if (existing == std::set<Voxel>::end())
-                  std::set<Voxel>::insert (temp);
-                else
+                if (const Voxel* existing = find_or_add (temp))
                   (*existing).add (l, f);
               }
           };
-          class SetVoxelDEC : public std::set<VoxelDEC>, public Mapping::SetVoxelExtras
+          class SetVoxelDEC : public Mapping::VoxelSet<VoxelDEC>, public Mapping::SetVoxelExtras
           {
             public:
               typedef VoxelDEC VoxType;
               inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3f& d, const float l, const float f)
               {
                 const VoxelDEC temp (v, d, l, f);
-                iterator existing = std::set<VoxelDEC>::find (temp);
-                if (existing == std::set<VoxelDEC>::end())
-                  std::set<VoxelDEC>::insert (temp);
-                else
+                if (const VoxelDEC* existing = find_or_add (temp))
                   (*existing).add (d, l, f);
               }
           };
-          class SetDixel : public std::set<Dixel>, public Mapping::SetVoxelExtras
+          class SetDixel : public Mapping::VoxelSet<Dixel>, public Mapping::SetVoxelExtras
           {
             public:
               typedef Dixel VoxType;
               inline void insert (const Eigen::Vector3i& v, const size_t d, const float l, const float f)
               {
                 const Dixel temp (v, d, l, f);
-                iterator existing = std::set<Dixel>::find (temp);
-                if (existing == std::set<Dixel>::end())
-                  std::set<Dixel>::insert (temp);
-                else
+                if (const Dixel* existing = find_or_add (temp))
                   (*existing).add (l, f);
               }
           };
-          class SetVoxelTOD : public std::set<VoxelTOD>, public Mapping::SetVoxelExtras
+          class SetVoxelTOD : public Mapping::VoxelSet<VoxelTOD>, public Mapping::SetVoxelExtras
           {
             public:
               typedef VoxelTOD VoxType;
               inline void insert (const Eigen::Vector3i& v, const Eigen::VectorXf& t, const float l, const float f)
               {
                 const VoxelTOD temp (v, t, l, f);
-                iterator existing = std::set<VoxelTOD>::find (temp);
-                if (existing == std::set<VoxelTOD>::end())
-                  std::set<VoxelTOD>::insert (temp);
-                else
+                if (const VoxelTOD* existing = find_or_add (temp))
                   (*existing).add (t, l, f);
               }
           };
@@ -17,6 +17,9 @@
 #define __dwi_tractography_mapping_loader_h__
 
 
+#include <atomic>
+#include <mutex>
+
 #include "memory.h"
 #include "progressbar.h"
 #include "thread_queue.h"
@@ -65,6 +68,80 @@ namespace MR {
         };
 
 
+
+
+        //! Load streamlines concurrently from multiple threads
+        /*! For use as the multi-threaded source of a Thread::run_queue()
+         * pipeline:
+         * \code
+         * ParallelTrackLoader loader (reader, count);
+         * Thread::run_queue (Thread::multi (loader), Thread::batch (Streamline<>()), ...);
+         * \endcode
+         * Each thread reads blocks of consecutive streamlines directly from
+         * the memory-mapped track file, using the streamline offset index.
+         * Streamlines are therefore not delivered in order: downstream
+         * stages must rely on Streamline::index where this matters. */
+        class ParallelTrackLoader
+        {
+
+          public:
+            ParallelTrackLoader (Reader<>& file, const size_t to_load = 0, const std::string& msg = "mapping tracks to image") :
+              shared (new Shared (file, to_load, msg)),
+              next (0),
+              end (0) { }
+
+            bool operator() (Streamline<>& out)
+            {
+              if (next == end && !shared->next_block (next, end)) {
+                out.clear();
+                return false;
+              }
+              shared->reader.load (next++, out);
+              return true;
+            }
+
+          protected:
+            class Shared
+            {
+              public:
+                Shared (Reader<>& file, const size_t to_load, const std::string& msg) :
+                  reader (file),
+                  num_tracks (to_load ? std::min (to_load, file.num_streamlines()) : file.num_streamlines()),
+                  next (0),
+                  progress (msg.size() ? new ProgressBar (msg, num_tracks) : nullptr) { }
+
+                bool next_block (size_t& first, size_t& last)
+                {
+                  first = next.fetch_add (block_size);
+                  if (first >= num_tracks) {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    progress.reset();
+                    return false;
+                  }
+                  last = std::min (first + block_size, num_tracks);
+                  std::lock_guard<std::mutex> lock (mutex);
+                  if (progress)
+                    for (size_t n = first; n != last; ++n)
+                      ++(*progress);
+                  return true;
+                }
+
+                Reader<>& reader;
+
+              private:
+                static constexpr size_t block_size = 256;
+                const size_t num_tracks;
+                std::atomic<size_t> next;
+                std::mutex mutex;
+                std::unique_ptr<ProgressBar> progress;
+            };
+
+            std::shared_ptr<Shared> shared;
+            size_t next, end;
+
+        };
+
+
       }
     }
   }
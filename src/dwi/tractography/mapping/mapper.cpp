@@ -31,7 +31,7 @@ void TrackMapperBase::voxelise (const Streamline<>& tck, SetVoxel& voxels) const
   for (const auto& i : tck) {
     vox = round (scanner2voxel * i);
     if (check (vox, info))
-      voxels.std::set<Voxel>::insert (vox);
+      voxels.find_or_add (Voxel (vox));
   }
 }
 
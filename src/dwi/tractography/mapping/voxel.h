@@ -18,7 +18,8 @@
 
 
 
-#include <set>
+#include <algorithm>
+#include <vector>
 
 #include "image.h"
 
@@ -252,6 +253,117 @@ namespace MR {
 
 
 
+        // Hash functions used by VoxelSet to identify the same voxel / dixel
+        inline size_t hash (const Voxel& v)
+        {
+          return (size_t(v[0]) * 73856093) ^ (size_t(v[1]) * 19349663) ^ (size_t(v[2]) * 83492791);
+        }
+        inline size_t hash (const Dixel& v)
+        {
+          return hash (static_cast<const Voxel&> (v)) ^ (v.get_dir() * 2654435761);
+        }
+
+
+
+        // Flat container for the elements traversed by a single streamline
+        //   Elements are held contiguously in a vector, with an open-addressing hash table of
+        //   indices into that vector used to find existing entries; this avoids the allocation
+        //   of a tree node per element that std::set would incur. clear() retains all storage,
+        //   so an instance that is re-used across streamlines (as happens for the items of a
+        //   Thread::Queue) soon stops allocating altogether.
+        //   Elements are held in order of insertion until finalise() is called, after which
+        //   they are in the same order as std::set would provide.
+        template <class VoxType>
+          class VoxelSet
+          {
+            public:
+              typedef typename std::vector<VoxType>::const_iterator const_iterator;
+              typedef const_iterator iterator;
+              typedef VoxType value_type;
+
+              VoxelSet () : generation (1) { }
+
+              const_iterator begin() const { return voxels.begin(); }
+              const_iterator end()   const { return voxels.end(); }
+              size_t size()  const { return voxels.size(); }
+              bool   empty() const { return voxels.empty(); }
+
+              void clear()
+              {
+                voxels.clear();
+                // Invalidates all hash table entries without having to touch them
+                if (!++generation) {
+                  std::fill (table.begin(), table.end(), Slot());
+                  generation = 1;
+                }
+              }
+
+              // Sort the elements, and rebuild the hash table accordingly
+              void finalise()
+              {
+                std::sort (voxels.begin(), voxels.end());
+                if (table.size())
+                  rehash (table.size());
+              }
+
+              // Add v to the set and return nullptr if it is not yet present;
+              //   otherwise, return the existing element (left unmodified)
+              const VoxType* find_or_add (const VoxType& v)
+              {
+                if (2 * (voxels.size()+1) > table.size())
+                  rehash (std::max (size_t(64), 2 * table.size()));
+                const size_t mask = table.size() - 1;
+                for (size_t n = mix (hash (v)) & mask; ; n = (n+1) & mask) {
+                  Slot& slot (table[n]);
+                  if (slot.generation != generation) {
+                    slot = Slot (generation, voxels.size());
+                    voxels.push_back (v);
+                    return nullptr;
+                  }
+                  if (voxels[slot.index] == v)
+                    return &voxels[slot.index];
+                }
+              }
+
+            private:
+              class Slot
+              {
+                public:
+                  Slot () : generation (0), index (0) { }
+                  Slot (const uint32_t g, const uint32_t i) : generation (g), index (i) { }
+                  uint32_t generation, index;
+              };
+
+              std::vector<VoxType> voxels;
+              std::vector<Slot> table;
+              uint32_t generation;
+
+              static size_t mix (size_t h)
+              {
+                h ^= h >> 16;
+                h *= 0x45d9f3b;
+                return h ^ (h >> 16);
+              }
+
+              void rehash (const size_t new_size)
+              {
+                table.assign (new_size, Slot());
+                const size_t mask = new_size - 1;
+                for (size_t i = 0; i != voxels.size(); ++i) {
+                  size_t n = mix (hash (voxels[i])) & mask;
+                  while (table[n].generation == generation)
+                    n = (n+1) & mask;
+                  table[n] = Slot (generation, i);
+                }
+              }
+          };
+
+
+
+
+
+
+
         class SetVoxelExtras
         {
           public:
@@ -267,16 +379,13 @@ namespace MR {
 
         // Set classes that give sensible behaviour to the insert() function depending on the base voxel class
 
-        class SetVoxel : public std::set<Voxel>, public SetVoxelExtras
+        class SetVoxel : public VoxelSet<Voxel>, public SetVoxelExtras
         {
           public:
             typedef Voxel VoxType;
             inline void insert (const Voxel& v)
             {
-              iterator existing = std::set<Voxel>::find (v);
-              if (existing == std::set<Voxel>::end())
-                std::set<Voxel>::insert (v);
-              else
+              if (const Voxel* existing = find_or_add (v))
                 (*existing) += v.get_length();
             }
             inline void insert (const Eigen::Vector3i& v, const float l)
@@ -290,16 +399,13 @@ namespace MR {
 
 
 
-        class SetVoxelDEC : public std::set<VoxelDEC>, public SetVoxelExtras
+        class SetVoxelDEC : public VoxelSet<VoxelDEC>, public SetVoxelExtras
         {
           public:
             typedef VoxelDEC VoxType;
             inline void insert (const VoxelDEC& v)
             {
-              iterator existing = std::set<VoxelDEC>::find (v);
-              if (existing == std::set<VoxelDEC>::end())
-                std::set<VoxelDEC>::insert (v);
-              else
+              if (const VoxelDEC* existing = find_or_add (v))
                 existing->add (v.get_colour(), v.get_length());
             }
             inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3f& d)
@@ -317,16 +423,13 @@ namespace MR {
 
 
 
-        class SetVoxelDir : public std::set<VoxelDir>, public SetVoxelExtras
+        class SetVoxelDir : public VoxelSet<VoxelDir>, public SetVoxelExtras
         {
           public:
             typedef VoxelDir VoxType;
             inline void insert (const VoxelDir& v)
             {
-              iterator existing = std::set<VoxelDir>::find (v);
-              if (existing == std::set<VoxelDir>::end())
-                std::set<VoxelDir>::insert (v);
-              else
+              if (const VoxelDir* existing = find_or_add (v))
                 existing->add (v.get_dir(), v.get_length());
             }
             inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3f& d)
@@ -342,16 +445,13 @@ namespace MR {
         };
 
 
-        class SetDixel : public std::set<Dixel>, public SetVoxelExtras
+        class SetDixel : public VoxelSet<Dixel>, public SetVoxelExtras
         {
           public:
             typedef Dixel VoxType;
             inline void insert (const Dixel& v)
             {
-              iterator existing = std::set<Dixel>::find (v);
-              if (existing == std::set<Dixel>::end())
-                std::set<Dixel>::insert (v);
-              else
+              if (const Dixel* existing = find_or_add (v))
                 (*existing) += v.get_length();
             }
             inline void insert (const Eigen::Vector3i& v, const size_t d)
@@ -370,16 +470,13 @@ namespace MR {
 
 
 
-        class SetVoxelTOD : public std::set<VoxelTOD>, public SetVoxelExtras
+        class SetVoxelTOD : public VoxelSet<VoxelTOD>, public SetVoxelExtras
         {
           public:
             typedef VoxelTOD VoxType;
             inline void insert (const VoxelTOD& v)
             {
-              iterator existing = std::set<VoxelTOD>::find (v);
-              if (existing == std::set<VoxelTOD>::end())
-                std::set<VoxelTOD>::insert (v);
-              else
+              if (const VoxelTOD* existing = find_or_add (v))
                 (*existing) += v.get_tod();
             }
             inline void insert (const Eigen::Vector3i& v, const Eigen::VectorXf& t)
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ * 
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * For more details, see www.mrtrix.org
+ * 
+ */
+#include <atomic>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "raw.h"
+#include "thread.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "dwi/tractography/offset_index.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+
+
+
+      namespace {
+
+        const std::string index_magic ("mrtrix track index 2\n");
+
+        // amount of track data at each end of the file included in the
+        // checksum stored in the sidecar:
+        constexpr size_t checksum_bytes = 1 << 20;
+
+        template <typename ValueType>
+          inline ValueType x_coordinate (const uint8_t* data, size_t vertex, bool is_big_endian)
+          {
+            return is_big_endian ?
+              Raw::fetch_BE<ValueType> (data, 3*vertex) :
+              Raw::fetch_LE<ValueType> (data, 3*vertex);
+          }
+
+        // Find the positions of all non-finite vertices (delimiters & barrier)
+        //   within vertices [from, to), stopping at the first barrier
+        template <typename ValueType>
+          void find_delimiters (const uint8_t* data, size_t from, size_t to, bool is_big_endian, std::vector<uint64_t>& out)
+          {
+            for (size_t v = from; v != to; ++v) {
+              const ValueType x = x_coordinate<ValueType> (data, v, is_big_endian);
+              if (!std::isfinite (x)) {
+                out.push_back (v);
+                if (std::isinf (x))
+                  return;
+              }
+            }
+          }
+
+        // stat() signature of the track file, used to check the validity of the sidecar
+        bool file_signature (const std::string& path, uint64_t& size, int64_t& mtime)
+        {
+          struct stat sbuf;
+          if (stat (path.c_str(), &sbuf))
+            return false;
+          size = sbuf.st_size;
+          mtime = sbuf.st_mtime;
+          return true;
+        }
+
+        // 64-bit FNV-1a hash of the first and last blocks of the track data,
+        //   so that a file rewritten with the same size within the
+        //   resolution of its modification time is still detected
+        uint64_t data_checksum (const uint8_t* data, size_t num_bytes)
+        {
+          uint64_t hash = 0xcbf29ce484222325ULL;
+          auto add = [&] (size_t from, size_t to) {
+            for (size_t n = from; n < to; ++n) {
+              hash ^= data[n];
+              hash *= 0x100000001b3ULL;
+            }
+          };
+          if (num_bytes <= 2 * checksum_bytes) {
+            add (0, num_bytes);
+          } else {
+            add (0, checksum_bytes);
+            add (num_bytes - checksum_bytes, num_bytes);
+          }
+          return hash;
+        }
+
+      }
+
+
+
+
+      //CONF option: TrackIndexCache
+      //CONF default: 0 (false)
+      //CONF Whether to store the index of streamline locations computed
+      //CONF when accessing a track file by streamline index (or from
+      //CONF multiple threads) in a sidecar file, with the suffix ".idx"
+      //CONF appended to the track file name. This requires write access
+      //CONF to the directory holding the track file. The sidecar is
+      //CONF re-used on subsequent reads unless the size, modification
+      //CONF time or contents of the track file have changed since.
+
+      void OffsetIndex::build (const std::string& path, const uint8_t* data, size_t num_vertices, const DataType dtype)
+      {
+        offsets.clear();
+        total_vertices = num_vertices;
+
+        static const bool use_cache = File::Config::get_bool ("TrackIndexCache", false);
+        const std::string index_path = path + ".idx";
+        const uint64_t checksum = use_cache ? data_checksum (data, num_vertices * 3 * dtype.bytes()) : 0;
+        if (use_cache && load (index_path, path, checksum))
+          return;
+
+        // scan separate ranges of the data concurrently, one per thread:
+        const size_t num_ranges = std::max (Thread::number_of_threads(), size_t(1));
+        const size_t range_size = (num_vertices + num_ranges - 1) / num_ranges;
+        std::vector<std::vector<uint64_t>> delimiters (num_ranges);
+        std::atomic<size_t> next (0);
+
+        struct Scanner {
+          const uint8_t* data;
+          size_t num_vertices, range_size;
+          bool is_big_endian, is_double;
+          std::vector<std::vector<uint64_t>>& delimiters;
+          std::atomic<size_t>& next;
+          void execute () {
+            size_t n;
+            while ((n = next++) < delimiters.size()) {
+              const size_t from = std::min (n * range_size, num_vertices);
+              const size_t to = std::min (from + range_size, num_vertices);
+              if (is_double)
+                find_delimiters<double> (data, from, to, is_big_endian, delimiters[n]);
+              else
+                find_delimiters<float32> (data, from, to, is_big_endian, delimiters[n]);
+            }
+          }
+        } scanner = { data, num_vertices, range_size, dtype.is_big_endian(), dtype == DataType::Float64LE || dtype == DataType::Float64BE, delimiters, next };
+
+        if (Thread::number_of_threads() == 0)
+          scanner.execute();
+        else
+          Thread::run (Thread::multi (scanner), "track file index").wait();
+
+        offsets.push_back (0);
+        for (const auto& range : delimiters) {
+          for (const auto d : range) {
+            if (std::isinf (dtype == DataType::Float64LE || dtype == DataType::Float64BE ?
+                  x_coordinate<double> (data, d, dtype.is_big_endian()) :
+                  x_coordinate<float32> (data, d, dtype.is_big_endian()))) {
+              DEBUG ("found " + str(size()) + " streamlines in track file \"" + path + "\"");
+              if (use_cache)
+                save (index_path, path, checksum);
+              return;
+            }
+            offsets.push_back (d + 1);
+          }
+        }
+
+        // no barrier found: file may be incomplete - any trailing partial streamline is ignored
+        DEBUG ("found " + str(size()) + " streamlines in track file \"" + path + "\" (no end-of-data marker)");
+      }
+
+
+
+
+      bool OffsetIndex::load (const std::string& index_path, const std::string& path, const uint64_t checksum)
+      {
+        uint64_t file_size;
+        int64_t mtime;
+        if (!file_signature (path, file_size, mtime))
+          return false;
+
+        std::ifstream in (index_path, std::ios::in | std::ios::binary);
+        if (!in)
+          return false;
+
+        std::string magic (index_magic.size(), '\0');
+        in.read (&magic[0], magic.size());
+        uint64_t header[5];
+        in.read (reinterpret_cast<char*> (header), sizeof (header));
+        if (!in || magic != index_magic)
+          return false;
+        for (auto& h : header)
+          h = ByteOrder::LE (h);
+        if (header[0] != file_size || int64_t (header[1]) != mtime || header[2] != total_vertices || header[3] != checksum) {
+          DEBUG ("sidecar index \"" + index_path + "\" is out of date - ignored");
+          return false;
+        }
+        if (header[4] > total_vertices + 1)
+          return false;
+
+        offsets.resize (header[4]);
+        in.read (reinterpret_cast<char*> (offsets.data()), offsets.size() * sizeof (uint64_t));
+        if (!in) {
+          offsets.clear();
+          return false;
+        }
+        for (auto& o : offsets)
+          o = ByteOrder::LE (o);
+        for (size_t n = 1; n < offsets.size(); ++n) {
+          if (offsets[n] <= offsets[n-1] || offsets[n] > total_vertices) {
+            offsets.clear();
+            return false;
+          }
+        }
+
+        DEBUG ("loaded index of " + str(size()) + " streamlines from sidecar \"" + index_path + "\"");
+        return true;
+      }
+
+
+
+
+      void OffsetIndex::save (const std::string& index_path, const std::string& path, const uint64_t checksum) const
+      {
+        uint64_t file_size;
+        int64_t mtime;
+        if (!file_signature (path, file_size, mtime))
+          return;
+
+        // failure to write the sidecar is not an error: it is only a cache
+        std::ofstream out (index_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+          DEBUG ("unable to create sidecar index \"" + index_path + "\" - index will not be cached");
+          return;
+        }
+        out.write (index_magic.c_str(), index_magic.size());
+        const uint64_t header[5] = { ByteOrder::LE (file_size), ByteOrder::LE (uint64_t (mtime)), ByteOrder::LE (total_vertices), ByteOrder::LE (checksum), ByteOrder::LE (uint64_t (offsets.size())) };
+        out.write (reinterpret_cast<const char*> (header), sizeof (header));
+        for (const auto o : offsets) {
+          const uint64_t v = ByteOrder::LE (o);
+          out.write (reinterpret_cast<const char*> (&v), sizeof (v));
+        }
+        if (!out.good()) {
+          out.close();
+          std::remove (index_path.c_str());
+          DEBUG ("error writing sidecar index \"" + index_path + "\" - index will not be cached");
+        }
+      }
+
+
+
+    }
+  }
+}
+
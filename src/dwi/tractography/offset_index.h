@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ * 
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * For more details, see www.mrtrix.org
+ * 
+ */
+#ifndef __dwi_tractography_offset_index_h__
+#define __dwi_tractography_offset_index_h__
+
+
+#include <vector>
+
+#include "datatype.h"
+#include "types.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! the location of each streamline within the data of a track file
+      /*! Streamlines are stored as a sequence of vertices, each terminated
+       * by a delimiter (NaN) vertex, with the data ending at a barrier (Inf)
+       * vertex. Finding a given streamline therefore requires a scan through
+       * all preceding data; this class performs that scan once (using
+       * multiple threads), so that streamlines can subsequently be accessed
+       * directly by their index, and ranges of streamlines can be handed out
+       * to different threads.
+       *
+       * Since the scan requires reading the entire file, the index can also
+       * be stored in a sidecar file alongside the track file (with the
+       * suffix ".idx" appended), and re-used on subsequent reads as long as
+       * the track file has not been modified. This is disabled by default,
+       * and enabled using the TrackIndexCache config file entry. */
+      class OffsetIndex
+      {
+        public:
+          OffsetIndex () : total_vertices (0) { }
+
+          //! locate all streamlines within the track data
+          /*! \a data points to the first of the \a num_vertices vertices
+           * stored in \a path, in format \a dtype. If a valid sidecar index
+           * exists for \a path, it is loaded rather than re-computed. */
+          void build (const std::string& path, const uint8_t* data, size_t num_vertices, const DataType dtype);
+
+          //! the number of complete streamlines in the file
+          size_t size () const { return offsets.empty() ? 0 : offsets.size() - 1; }
+          bool empty () const { return size() == 0; }
+
+          //! the position of the first vertex of streamline \a n
+          uint64_t first (size_t n) const { assert (n < size()); return offsets[n]; }
+          //! the number of vertices in streamline \a n (excluding the delimiter)
+          size_t num_vertices (size_t n) const { assert (n < size()); return offsets[n+1] - offsets[n] - 1; }
+
+        protected:
+          std::vector<uint64_t> offsets;
+          uint64_t total_vertices;
+
+          bool load (const std::string& index_path, const std::string& path, const uint64_t checksum);
+          void save (const std::string& index_path, const std::string& path, const uint64_t checksum) const;
+      };
+
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -71,6 +71,7 @@ namespace MR
           track_count (0),
           attempts (0),
           seeds (0),
+          next_checkpoint (std::numeric_limits<size_t>::max()),
 #ifdef DYNAMIC_SEED_DEBUGGING
           seed_output ("seeds.tck", Tractography::Properties()),
           test_fixel (0),
@@ -94,6 +95,9 @@ namespace MR
         // For small / unreliable fixels, don't modify the seeding probability during execution
         perform_fixel_masking();
 
+        if (checkpoint.resuming())
+          load_checkpoint();
+
 #ifdef DYNAMIC_SEED_DEBUGGING
         // Pick a good fixel to use for testing / debugging
         do {
@@ -323,6 +327,91 @@ namespace MR
 
 
 
+      void Dynamic::defer_checkpoint (const size_t count, Tracking::Checkpoint::Entries&& tracking)
+      {
+        std::lock_guard<std::mutex> lock (checkpoint_mutex);
+        pending_checkpoints.push_back (std::make_pair (count, std::move (tracking)));
+        next_checkpoint = pending_checkpoints.front().first;
+      }
+
+
+
+      void Dynamic::save_checkpoint()
+      {
+        Tracking::Checkpoint::Entries tracking;
+        {
+          std::lock_guard<std::mutex> lock (checkpoint_mutex);
+          while (pending_checkpoints.size() && pending_checkpoints.front().first <= track_count) {
+            tracking = std::move (pending_checkpoints.front().second);
+            pending_checkpoints.pop_front();
+          }
+          next_checkpoint = pending_checkpoints.size() ? pending_checkpoints.front().first : std::numeric_limits<size_t>::max();
+        }
+        if (tracking.empty())
+          return;
+
+        const std::string& count = Tracking::Checkpoint::get (tracking, "count");
+        const std::string name = "dynamic_seeding_" + count;
+        std::vector<Fixel::State> state;
+        state.reserve (fixels.size());
+        for (auto& i : fixels)
+          state.push_back (i.get_state());
+        checkpoint.save_data (name, state.data(), state.size() * sizeof (Fixel::State));
+
+        Tracking::Checkpoint::Entries entries;
+        entries["count"] = count;
+        entries["num_fixels"] = str (fixels.size());
+        entries["track_count"] = str (track_count.load());
+        entries["attempts"] = str (attempts.load());
+        entries["seeds"] = str (seeds.load());
+        entries["TD_sum"] = str (TD_sum, 16);
+        checkpoint.save (name, entries);
+
+        // Committing the tracking checkpoint makes the new seeding state current
+        tracking["dynamic_seeding"] = name;
+        checkpoint.save ("tracking", tracking);
+        DEBUG ("tracking checkpoint saved at " + count + " streamlines");
+        if (saved_state.size())
+          checkpoint.remove (saved_state);
+        saved_state = name;
+      }
+
+
+
+      void Dynamic::load_checkpoint()
+      {
+        typedef Tracking::Checkpoint Checkpoint;
+        // The seeder lags slightly behind the output file; continue from the
+        //   number of streamlines actually written at the time of the checkpoint
+        const Checkpoint::Entries tracking = checkpoint.load ("tracking");
+        track_count = to<size_t> (Checkpoint::get (tracking, "count"));
+        const auto name = tracking.find ("dynamic_seeding");
+        if (name == tracking.end()) {
+          WARN ("no dynamic seeding state found in checkpoint; seeding probabilities will be re-initialised");
+          return;
+        }
+
+        const Checkpoint::Entries entries = checkpoint.load (name->second);
+        if (Checkpoint::get (entries, "count") != Checkpoint::get (tracking, "count"))
+          throw Exception ("dynamic seeding checkpoint is inconsistent with tracking checkpoint; cannot resume");
+        if (to<size_t> (Checkpoint::get (entries, "num_fixels")) != fixels.size())
+          throw Exception ("dynamic seeding checkpoint does not match current fixel segmentation");
+
+        std::vector<Fixel::State> state (fixels.size());
+        checkpoint.load_data (name->second, state.data(), state.size() * sizeof (Fixel::State));
+        for (size_t i = 0; i != fixels.size(); ++i)
+          fixels[i].set_state (state[i]);
+        saved_state = name->second;
+
+        attempts = to<uint64_t> (Checkpoint::get (entries, "attempts"));
+        seeds = to<uint64_t> (Checkpoint::get (entries, "seeds"));
+        TD_sum = to<double> (Checkpoint::get (entries, "TD_sum"));
+      }
+
+
+
+
+
       void Dynamic::perform_fixel_masking()
       {
         // IDEA Rather than a hard masking, could this be instead used to 'damp' how much the seeding
@@ -364,9 +453,18 @@ namespace MR
 
 
 
+        void WriteKernelDynamic::save_checkpoint ()
+        {
+          // committed by the seeder along with the seeding probabilities
+          seeder.defer_checkpoint (writer->count, checkpoint_entries());
+          next_checkpoint = writer->count + checkpoint.interval();
+        }
+
+
+
         bool WriteKernelDynamic::operator() (const Tracking::GeneratedTrack& in, Tractography::Streamline<>& out)
         {
-          out.index = writer.count;
+          out.index = writer->count;
           out.weight = 1.0;
           if (!WriteKernel::operator() (in)) {
             out.clear();
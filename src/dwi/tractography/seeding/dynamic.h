@@ -19,6 +19,9 @@
 #include <fstream>
 #include <queue>
 #include <atomic>
+#include <deque>
+#include <limits>
+#include <mutex>
 
 #include "transform.h"
 #include "thread_queue.h"
@@ -162,6 +165,33 @@ namespace MR
           size_t get_seed_count() const { return seed_count; }
 
 
+          // Dynamic state of the fixel, as saved & restored when checkpointing
+          class State
+          {
+            public:
+              double TD;
+              float old_prob, applied_prob;
+              uint64_t track_count_at_last_update, seed_count;
+          };
+
+          State get_state ()
+          {
+            while (updating.test_and_set (std::memory_order_acquire));
+            const State state { TD.load (std::memory_order_relaxed), old_prob, applied_prob, track_count_at_last_update, seed_count };
+            updating.clear (std::memory_order_release);
+            return state;
+          }
+
+          void set_state (const State& state)
+          {
+            TD.store (state.TD, std::memory_order_relaxed);
+            old_prob = state.old_prob;
+            applied_prob = state.applied_prob;
+            track_count_at_last_update = state.track_count_at_last_update;
+            seed_count = state.seed_count;
+          }
+
+
 
         private:
           Eigen::Vector3i voxel;
@@ -240,9 +270,20 @@ namespace MR
               return false;
 #endif
           }
-          return SIFT::ModelBase<Fixel_TD_seed>::operator() (i);
+          if (!SIFT::ModelBase<Fixel_TD_seed>::operator() (i))
+            return false;
+          if (track_count >= next_checkpoint)
+            save_checkpoint();
+          return true;
         }
 
+        //! save the state of tracking along with the seeding probabilities
+        /*! The entries describing the state of tracking once \a count
+         * streamlines have been written are committed to the checkpoint by
+         * the seeder thread, once it has processed the same number of
+         * streamlines. */
+        void defer_checkpoint (const size_t count, Tracking::Checkpoint::Entries&& tracking);
+
 
           private:
             using Fixel_map<Fixel>::accessor;
@@ -258,6 +299,20 @@ namespace MR
         // Want to know statistics on dynamic seeding sampling
         std::atomic<uint64_t> attempts, seeds;
 
+        // The seeding probabilities are saved along with the state of tracking if
+        //   checkpointing is enabled; this is performed by the seeder thread itself,
+        //   as this is the only thread that modifies the fixel TD values. Each
+        //   set of probabilities is saved under its own name, which is only
+        //   referenced from the tracking checkpoint once complete, so that
+        //   the two can never be inconsistent on resume.
+        const Tracking::Checkpoint checkpoint;
+        std::mutex checkpoint_mutex;
+        std::deque<std::pair<size_t,Tracking::Checkpoint::Entries>> pending_checkpoints;
+        std::atomic<size_t> next_checkpoint;
+        std::string saved_state;
+        void save_checkpoint();
+        void load_checkpoint();
+
 
 #ifdef DYNAMIC_SEED_DEBUGGING
         Tractography::Writer<float> seed_output;
@@ -281,11 +336,16 @@ namespace MR
       class WriteKernelDynamic : public Tracking::WriteKernel
         {
           public:
-            WriteKernelDynamic (const Tracking::SharedBase& shared, const std::string& output_file, const Properties& properties) :
-              Tracking::WriteKernel (shared, output_file, properties) { }
+            WriteKernelDynamic (const Tracking::SharedBase& shared, const std::string& output_file, const Properties& properties, Dynamic& seeder) :
+              Tracking::WriteKernel (shared, output_file, properties),
+              seeder (seeder) { }
           WriteKernelDynamic (const WriteKernelDynamic&) = delete;
           WriteKernelDynamic& operator= (const WriteKernelDynamic&) = delete;
           bool operator() (const Tracking::GeneratedTrack&, Streamline<>&);
+
+          protected:
+            Dynamic& seeder;
+            void save_checkpoint () override;
       };
 
 
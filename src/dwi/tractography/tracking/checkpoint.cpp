@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include "dwi/tractography/tracking/checkpoint.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "file/key_value.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+
+#define DEFAULT_CHECKPOINT_INTERVAL 1000000
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+      using namespace App;
+
+      const OptionGroup CheckpointOption = OptionGroup ("Options for checkpointing and resuming tractography")
+
+      + Option ("checkpoint",
+            "periodically save the state of tracking to the specified directory, "
+            "so that the run can be resumed using the -resume option if it is "
+            "interrupted. This is only supported for output in the .tck format.")
+          + Argument ("path").type_text()
+
+      + Option ("checkpoint_interval",
+            "set the number of streamlines written to the output file between "
+            "successive checkpoints (default: " + str(DEFAULT_CHECKPOINT_INTERVAL) + ").")
+          + Argument ("number").type_integer (1)
+
+      + Option ("resume",
+            "resume tracking from the last checkpoint saved in the directory "
+            "specified by the -checkpoint option. All other options, and the "
+            "output file, should be identical to those of the original run; "
+            "streamlines written after the last checkpoint are discarded, and "
+            "further streamlines are appended to the existing output file. "
+            "The -force option is not required to re-open the output files of "
+            "the original run.");
+
+
+
+      Checkpoint::Checkpoint () :
+          checkpoint_interval (get_option_value ("checkpoint_interval", DEFAULT_CHECKPOINT_INTERVAL)),
+          resume (get_options ("resume").size())
+      {
+        auto opt = get_options ("checkpoint");
+        if (!opt.size()) {
+          if (resume)
+            throw Exception ("-resume option requires the checkpoint directory to be specified using the -checkpoint option");
+          return;
+        }
+        dir = std::string (opt[0][0]);
+
+        if (resume) {
+          if (!Path::is_dir (dir))
+            throw Exception ("checkpoint directory \"" + dir + "\" not found");
+        } else if (!Path::exists (dir)) {
+          File::mkdir (dir);
+        } else if (!Path::is_dir (dir)) {
+          throw Exception ("checkpoint path \"" + dir + "\" exists but is not a directory");
+        }
+      }
+
+
+
+      void Checkpoint::prepare_resume ()
+      {
+        const Checkpoint checkpoint;
+        if (!checkpoint.resuming())
+          return;
+        // deterministic tracking instead resumes from the index of the next
+        //   streamline, using the original seed (see OrderedWriteKernel)
+        if (get_options ("deterministic").size())
+          return;
+        const char* from_env = getenv ("MRTRIX_RNG_SEED");
+        if (!from_env)
+          return;
+        const Entries entries = checkpoint.load ("tracking");
+        const std::string seed = str (uint32_t (to<uint64_t> (from_env) + to<uint64_t> (get (entries, "total_count"))));
+        INFO ("random number generator seed offset to " + seed + " for resumed run");
+#ifdef MRTRIX_WINDOWS
+        _putenv_s ("MRTRIX_RNG_SEED", seed.c_str());
+#else
+        setenv ("MRTRIX_RNG_SEED", seed.c_str(), 1);
+#endif
+      }
+
+
+
+      void Checkpoint::check_overwrite (const std::string& name)
+      {
+        if (!get_options ("resume").size())
+          throw Exception ("output file \"" + name + "\" already exists (use -force option to force overwrite)");
+      }
+
+
+
+      bool Checkpoint::has (const std::string& name) const
+      {
+        return Path::is_file (path (name, ".txt"));
+      }
+
+
+
+      void Checkpoint::save (const std::string& name, const Entries& entries) const
+      {
+        const std::string final_path = path (name, ".txt"), temp_path = final_path + ".tmp";
+        {
+          std::ofstream out (temp_path.c_str(), std::ios::out | std::ios::trunc);
+          out << "mrtrix tracking checkpoint\n";
+          for (const auto& i : entries)
+            out << i.first << ": " << i.second << "\n";
+          out << "END\n";
+          if (!out.good())
+            throw Exception ("error writing checkpoint file \"" + temp_path + "\": " + strerror (errno));
+        }
+        if (std::rename (temp_path.c_str(), final_path.c_str()))
+          throw Exception ("error writing checkpoint file \"" + final_path + "\": " + strerror (errno));
+      }
+
+
+
+      Checkpoint::Entries Checkpoint::load (const std::string& name) const
+      {
+        Entries entries;
+        File::KeyValue kv (path (name, ".txt"), "mrtrix tracking checkpoint");
+        while (kv.next())
+          entries[kv.key()] = kv.value();
+        return entries;
+      }
+
+
+
+      void Checkpoint::remove (const std::string& name) const
+      {
+        for (const auto suffix : { ".txt", ".dat" }) {
+          const std::string file = path (name, suffix);
+          if (Path::exists (file))
+            File::unlink (file);
+        }
+      }
+
+
+
+      void Checkpoint::save_data (const std::string& name, const void* data, size_t size) const
+      {
+        const std::string final_path = path (name, ".dat"), temp_path = final_path + ".tmp";
+        {
+          std::ofstream out (temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+          out.write (reinterpret_cast<const char*> (data), size);
+          if (!out.good())
+            throw Exception ("error writing checkpoint file \"" + temp_path + "\": " + strerror (errno));
+        }
+        if (std::rename (temp_path.c_str(), final_path.c_str()))
+          throw Exception ("error writing checkpoint file \"" + final_path + "\": " + strerror (errno));
+      }
+
+
+
+      void Checkpoint::load_data (const std::string& name, void* data, size_t size) const
+      {
+        const std::string file = path (name, ".dat");
+        std::ifstream in (file.c_str(), std::ios::in | std::ios::binary);
+        if (!in)
+          throw Exception ("failed to open checkpoint file \"" + file + "\": " + strerror (errno));
+        in.read (reinterpret_cast<char*> (data), size);
+        if (size_t (in.gcount()) != size || in.peek() != std::ifstream::traits_type::eof())
+          throw Exception ("checkpoint file \"" + file + "\" does not match current tracking parameters");
+      }
+
+
+
+      std::string Checkpoint::path (const std::string& name, const std::string& suffix) const
+      {
+        assert (dir.size());
+        return Path::join (dir, name + suffix);
+      }
+
+
+
+      }
+    }
+  }
+}
+
+
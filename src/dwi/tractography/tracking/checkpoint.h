@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#ifndef __dwi_tractography_tracking_checkpoint_h__
+#define __dwi_tractography_tracking_checkpoint_h__
+
+
+#include <map>
+#include <string>
+
+#include "app.h"
+#include "mrtrix.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+        extern const App::OptionGroup CheckpointOption;
+
+
+
+        //! save the state of tracking at regular intervals, so that it can be resumed
+        /*! This handles the -checkpoint, -checkpoint_interval & -resume
+         * options. Each component of tckgen that holds state to be preserved
+         * (the WriteKernel, and the dynamic seeding mechanism) saves its own
+         * entries under its own name in the checkpoint directory, and reloads
+         * them on construction when resuming. The "tracking" entries are
+         * always saved last, and refer to any other entries that must be
+         * consistent with them.
+         *
+         * Each set of entries is stored as a key/value text file, optionally
+         * accompanied by a binary data file. Files are written under a
+         * temporary name and then renamed, so that a job terminated at any
+         * point leaves the previous checkpoint intact. */
+        class Checkpoint
+        {
+          public:
+            typedef std::map<std::string,std::string> Entries;
+
+            //! set up according to the command-line options
+            Checkpoint ();
+
+            //! prepare the process for resuming from a checkpoint, if requested
+            /*! If the random number generators are explicitly seeded via the
+             * MRTRIX_RNG_SEED environment variable, the seed is offset by the
+             * number of streamlines already generated, so that the resumed
+             * run does not generate the same streamlines as the original run.
+             * This must therefore be invoked before any random number
+             * generator is created. */
+            static void prepare_resume ();
+
+            //! permit the output files of the original run to be re-opened when resuming
+            /*! To be installed as App::check_overwrite_files_func, so that
+             * the -force option is not required alongside -resume. */
+            static void check_overwrite (const std::string& name);
+
+            operator bool () const { return dir.size(); }
+            bool resuming () const { return resume; }
+            uint64_t interval () const { return checkpoint_interval; }
+
+            bool has (const std::string& name) const;
+            void save (const std::string& name, const Entries& entries) const;
+            Entries load (const std::string& name) const;
+            void remove (const std::string& name) const;
+
+            void save_data (const std::string& name, const void* data, size_t size) const;
+            void load_data (const std::string& name, void* data, size_t size) const;
+
+            //! get the value of a required entry, as loaded via load()
+            static const std::string& get (const Entries& entries, const std::string& key) {
+              const auto it = entries.find (key);
+              if (it == entries.end())
+                throw Exception ("checkpoint is missing entry \"" + key + "\"");
+              return it->second;
+            }
+
+          protected:
+            std::string dir;
+            uint64_t checkpoint_interval;
+            bool resume;
+
+            std::string path (const std::string& name, const std::string& suffix) const;
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
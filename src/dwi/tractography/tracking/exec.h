@@ -49,9 +49,14 @@ namespace MR
       {
 
 
-        // TODO Try having ACT as a template boolean; allow compiler to optimise out branch statements
-
-        template <class Method> class Exec {
+        //! the tracking kernel
+        /*! Whether ACT is in use, and whether any ROIs (mask, include or
+         * exclude regions) need to be checked, are provided as template
+         * parameters, so that the checks performed at every step of every
+         * streamline are resolved at compile time. run() selects the
+         * appropriate instantiation once, based on the tracking parameters;
+         * Exec should therefore only be invoked as Exec<Method>::run(). */
+        template <class Method, bool IsACT = false, bool HasROIs = false> class Exec {
 
           public:
 
@@ -61,22 +66,29 @@ namespace MR
               if (properties.find ("seed_dynamic") == properties.end()) {
 
                 typename Method::Shared shared (diff_path, properties);
-                WriteKernel writer (shared, destination, properties);
-                Exec<Method> tracker (shared);
-                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                if (shared.is_act()) {
+                  if (has_rois (shared))
+                    Exec<Method,true,true>::track (shared, destination, properties);
+                  else
+                    Exec<Method,true,false>::track (shared, destination, properties);
+                } else {
+                  if (has_rois (shared))
+                    Exec<Method,false,true>::track (shared, destination, properties);
+                  else
+                    Exec<Method,false,false>::track (shared, destination, properties);
+                }
 
               } else {
 
+                if (App::get_options ("deterministic").size())
+                  throw Exception ("-deterministic option cannot be used with dynamic seeding");
+
                 const std::string& fod_path (properties["seed_dynamic"]);
                 const std::string max_num_tracks = properties["max_num_tracks"];
                 if (max_num_tracks.empty())
                   throw Exception ("Dynamic seeding requires setting the desired number of tracks using the -number option");
                 const size_t num_tracks = to<size_t>(max_num_tracks);
 
-                typedef Mapping::SetDixel SetDixel;
-                typedef Mapping::TrackMapperBase TckMapper;
-                typedef Seeding::WriteKernelDynamic Writer;
-
                 DWI::Directions::FastLookupSet dirs (1281);
                 auto fod_data = Image<float>::open (fod_path);
                 Math::SH::check (fod_data);
@@ -84,22 +96,17 @@ namespace MR
                 properties.seeds.add (seeder); // List is responsible for deleting this from memory
 
                 typename Method::Shared shared (diff_path, properties);
-
-                Writer       writer  (shared, destination, properties);
-                Exec<Method> tracker (shared);
-
-                TckMapper mapper (fod_data, dirs);
-                mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (fod_data, properties, 0.25));
-                mapper.set_use_precise_mapping (true);
-
-                Thread::run_queue (
-                    Thread::multi (tracker), 
-                    Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE),
-                    writer, 
-                    Thread::batch (Streamline<>(), TRACKING_BATCH_SIZE),
-                    Thread::multi (mapper), 
-                    Thread::batch (SetDixel(), TRACKING_BATCH_SIZE),
-                    *seeder);
+                if (shared.is_act()) {
+                  if (has_rois (shared))
+                    Exec<Method,true,true>::track_dynamic (shared, destination, properties, fod_data, dirs, *seeder);
+                  else
+                    Exec<Method,true,false>::track_dynamic (shared, destination, properties, fod_data, dirs, *seeder);
+                } else {
+                  if (has_rois (shared))
+                    Exec<Method,false,true>::track_dynamic (shared, destination, properties, fod_data, dirs, *seeder);
+                  else
+                    Exec<Method,false,false>::track_dynamic (shared, destination, properties, fod_data, dirs, *seeder);
+                }
 
               }
 
@@ -116,8 +123,11 @@ namespace MR
 
             bool operator() (GeneratedTrack& item) {
               rng = &thread_local_RNG;
-              if (!gen_track (item))
+              if (!gen_track (item)) {
+                if (order)
+                  order->finish();
                 return false;
+              }
               if (track_rejected (item))
                 item.clear();
               S.downsampler (item);
@@ -127,11 +137,77 @@ namespace MR
 
           private:
 
+            template <class, bool, bool> friend class Exec;
+
             const typename Method::Shared& S;
             Math::RNG thread_local_RNG;
             Method method;
             bool track_excluded;
             std::vector<bool> track_included;
+            std::shared_ptr<OrderedWriteKernel::Order> order;
+
+
+            static bool has_rois (const typename Method::Shared& shared)
+            {
+              return (shared.properties.mask.size() || shared.properties.include.size() ||
+                  shared.properties.exclude.size() || shared.stop_on_all_include);
+            }
+
+
+
+            static void track (const typename Method::Shared& shared, const std::string& destination, DWI::Tractography::Properties& properties)
+            {
+              const bool deterministic = App::get_options ("deterministic").size();
+              // obtain the seed before any RNG is constructed, so that it matches MRTRIX_RNG_SEED if set
+              if (deterministic && properties.find ("rng_seed") == properties.end())
+                properties["rng_seed"] = str (Math::RNG::get_seed());
+              Exec tracker (shared);
+              if (deterministic) {
+                // streamlines are sent to the writer individually, so that
+                //   they can be written in order of generation
+                OrderedWriteKernel writer (shared, destination, properties);
+                tracker.order = writer.get_order();
+                Thread::run_queue (Thread::multi (tracker), GeneratedTrack(), writer);
+                writer.finalise();
+              } else if (ParallelWriteKernel::supported (destination, properties)) {
+                // each thread writes its own streamlines to file
+                ParallelWriteKernel writer (shared, destination, properties);
+                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), Thread::multi (writer));
+                writer.finalise();
+              } else {
+                WriteKernel writer (shared, destination, properties);
+                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                writer.finalise();
+              }
+            }
+
+
+
+            static void track_dynamic (const typename Method::Shared& shared, const std::string& destination, DWI::Tractography::Properties& properties,
+                Image<float>& fod_data, const DWI::Directions::FastLookupSet& dirs, Seeding::Dynamic& seeder)
+            {
+              typedef Mapping::SetDixel SetDixel;
+              typedef Mapping::TrackMapperBase TckMapper;
+              typedef Seeding::WriteKernelDynamic Writer;
+
+              Writer writer  (shared, destination, properties, seeder);
+              Exec   tracker (shared);
+
+              TckMapper mapper (fod_data, dirs);
+              mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (fod_data, properties, 0.25));
+              mapper.set_use_precise_mapping (true);
+
+              Thread::run_queue (
+                  Thread::multi (tracker),
+                  Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE),
+                  writer,
+                  Thread::batch (Streamline<>(), TRACKING_BATCH_SIZE),
+                  Thread::multi (mapper),
+                  Thread::batch (SetDixel(), TRACKING_BATCH_SIZE),
+                  seeder);
+              writer.finalise();
+            }
+
 
 
             term_t iterate ()
@@ -140,14 +216,17 @@ namespace MR
               const term_t method_term = (S.rk4 ? next_rk4() : method.next());
 
               if (method_term)
-                return (S.is_act() && method.act().sgm_depth) ? TERM_IN_SGM : method_term;
+                return (IsACT && method.act().sgm_depth) ? TERM_IN_SGM : method_term;
 
-              if (S.is_act()) {
+              if (IsACT) {
                 const term_t structural_term = method.act().check_structural (method.pos);
                 if (structural_term)
                   return structural_term;
               }
 
+              if (!HasROIs)
+                return CONTINUE;
+
               if (S.properties.mask.size() && !S.properties.mask.contains (method.pos))
                 return EXIT_MASK;
 
@@ -156,7 +235,7 @@ namespace MR
 
               // If backtracking is not enabled, add streamline to include regions as it is generated
               // If it is enabled, this check can only be performed after the streamline is completed
-              if (!(S.is_act() && S.act().backtrack()))
+              if (!(IsACT && S.act().backtrack()))
                 S.properties.include.contains (method.pos, track_included);
 
               if (S.stop_on_all_include && traversed_all_include_regions())
@@ -176,9 +255,12 @@ namespace MR
 
               bool unidirectional = S.unidirectional;
 
+              if (order && !next_ordered (tck))
+                return false;
+
               if (S.properties.seeds.is_finite()) {
 
-                if (!S.properties.seeds.get_seed (method.pos, method.dir))
+                if (!order && !S.properties.seeds.get_seed (method.pos, method.dir))
                   return false;
                 if (!method.check_seed() || !method.init()) {
                   track_excluded = true;
@@ -198,7 +280,7 @@ namespace MR
 
               }
 
-              if (S.is_act() && !unidirectional)
+              if (IsACT && !unidirectional)
                 unidirectional = method.act().seed_is_unidirectional (method.pos, method.dir);
 
               S.properties.include.contains (method.pos, track_included);
@@ -223,12 +305,32 @@ namespace MR
 
 
 
+            // Assign the next index to the streamline about to be generated, and
+            //   seed the RNG from it; for finite seeding mechanisms, the seed
+            //   point must also be obtained in order of streamline index
+            bool next_ordered (GeneratedTrack& tck)
+            {
+              std::unique_lock<std::mutex> lock (order->mutex);
+              if (!order->wait (lock))
+                return false;
+              const uint64_t index = order->next_index;
+              order->seed (thread_local_RNG, index);
+              if (S.properties.seeds.is_finite() && !S.properties.seeds.get_seed (method.pos, method.dir))
+                return false;
+              ++order->next_index;
+              tck.set_index (index);
+              return true;
+            }
+
+
+
+
             void gen_track_unidir (GeneratedTrack& tck)
             {
 
               term_t termination = CONTINUE;
 
-              if (S.is_act() && S.act().backtrack()) {
+              if (IsACT && S.act().backtrack()) {
 
                 size_t revert_step = 1;
                 size_t max_size_at_backtrack = tck.size();
@@ -297,7 +399,7 @@ namespace MR
                 }
               }
 
-              if (S.is_act() && (termination == ENTER_CGM) && S.act().crop_at_gmwmi())
+              if (IsACT && (termination == ENTER_CGM) && S.act().crop_at_gmwmi())
                 S.act().crop_at_gmwmi (tck);
 
 #ifdef DEBUG_TERMINATIONS
@@ -313,7 +415,7 @@ namespace MR
             void apply_priors (term_t& termination)
             {
 
-              if (S.is_act()) {
+              if (IsACT) {
 
                 switch (termination) {
 
@@ -378,7 +480,7 @@ namespace MR
                 return true;
               }
 
-              if (S.is_act()) {
+              if (IsACT) {
 
                 if (!satisfy_wm_requirement (tck)) {
                   S.add_rejection (ACT_FAILED_WM_REQUIREMENT);
@@ -39,14 +39,19 @@ namespace MR
         typedef std::vector<Eigen::Vector3f> BaseType;
 
       public:
-        GeneratedTrack() : seed_index (0) { }
+        GeneratedTrack() : seed_index (0), index (0) { }
         void clear() { BaseType::clear(); seed_index = 0; }
         size_t get_seed_index() const { return seed_index; }
         void reverse() { std::reverse (begin(), end()); seed_index = size()-1; }
         void set_seed_index (const size_t i) { seed_index = i; }
 
+        // Only used if streamlines need to be written in order of generation
+        uint64_t get_index() const { return index; }
+        void set_index (const uint64_t i) { index = i; }
+
       private:
         size_t seed_index;
+        uint64_t index;
 
     };
 
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+#ifndef __dwi_tractography_tracking_interpolator_h__
+#define __dwi_tractography_tracking_interpolator_h__
+
+
+#include <array>
+
+#include "image.h"
+#include "interp/base.h"
+
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        //! trilinear interpolation of all volumes of an image at once
+        /*! This yields the same values as Interp::Linear, but is tailored to
+         * the way the source image is sampled during tracking: the values of
+         * all volumes are always required, and consecutive samples are
+         * typically only a fraction of a voxel apart.
+         *
+         * The values of all volumes in the 8 voxels surrounding the current
+         * position are held in a cache, and are interpolated as a single
+         * matrix-vector product. The cache is only reloaded when the position
+         * moves into a different voxel cell, so that for consecutive samples
+         * within the same cell, only the interpolation weights need to be
+         * recomputed.
+         *
+         * The image must use direct IO, with the volumes contiguous in memory
+         * (as for the source image in Tracking::SharedBase). */
+        template <class ImageType>
+          class CachedLinearInterp : public Interp::Base<ImageType>
+        {
+          public:
+            typedef typename ImageType::value_type value_type;
+
+            CachedLinearInterp (const ImageType& parent, value_type value_when_out_of_bounds = Interp::Base<ImageType>::default_out_of_bounds_value()) :
+                Interp::Base<ImageType> (parent, value_when_out_of_bounds),
+                cache (parent.size(3), 8),
+                cell { -1, -1, -1 },
+                cache_valid (false),
+                eps (1.0e-6) { }
+
+            //! Set the current position to <b>voxel space</b> position \a pos
+            template <class VectorType>
+              bool voxel (const VectorType& pos) {
+                Eigen::Vector3 f = Interp::Base<ImageType>::intravoxel_offset (pos);
+                if (out_of_bounds)
+                  return false;
+
+                const ssize_t c[] = { ssize_t (std::floor (pos[0])), ssize_t (std::floor (pos[1])), ssize_t (std::floor (pos[2])) };
+                if (c[0] != cell[0] || c[1] != cell[1] || c[2] != cell[2]) {
+                  cell = { c[0], c[1], c[2] };
+                  cache_valid = false;
+                }
+
+                for (size_t i = 0; i < 3; ++i) {
+                  if (pos[i] < 0.0 || pos[i] > bounds[i]-0.5)
+                    f[i] = 0.0;
+                }
+
+                value_type x_weights[2] = { value_type(1 - f[0]), value_type(f[0]) };
+                value_type y_weights[2] = { value_type(1 - f[1]), value_type(f[1]) };
+                value_type z_weights[2] = { value_type(1 - f[2]), value_type(f[2]) };
+
+                size_t i (0);
+                for (ssize_t z = 0; z < 2; ++z) {
+                  for (ssize_t y = 0; y < 2; ++y) {
+                    value_type partial_weight = y_weights[y] * z_weights[z];
+                    for (ssize_t x = 0; x < 2; ++x) {
+                      factors[i] = x_weights[x] * partial_weight;
+                      if (factors[i] < eps)
+                        factors[i] = 0.0;
+                      ++i;
+                    }
+                  }
+                }
+
+                return true;
+              }
+
+            //! Set the current position to <b>image space</b> position \a pos
+            template <class VectorType>
+              FORCE_INLINE bool image (const VectorType& pos) {
+                return voxel (Transform::voxelsize.inverse() * pos.template cast<default_type>());
+              }
+
+            //! Set the current position to <b>scanner space</b> position \a pos
+            template <class VectorType>
+              FORCE_INLINE bool scanner (const VectorType& pos) {
+                return voxel (Transform::scanner2voxel * pos.template cast<default_type>());
+              }
+
+            //! Get the interpolated values of all volumes at the current position
+            template <class VectorType>
+              void get (VectorType& values) {
+                if (out_of_bounds) {
+                  values.fill (out_of_bounds_value);
+                  return;
+                }
+                if (!cache_valid)
+                  load();
+                values.noalias() = cache * factors;
+              }
+
+          protected:
+            using Interp::Base<ImageType>::out_of_bounds;
+            using Interp::Base<ImageType>::out_of_bounds_value;
+            using Interp::Base<ImageType>::bounds;
+
+            Eigen::Matrix<value_type,Eigen::Dynamic,8> cache;
+            Eigen::Matrix<value_type,8,1> factors;
+            std::array<ssize_t,3> cell;
+            bool cache_valid;
+            const value_type eps;
+
+            ssize_t clamp (ssize_t x, ssize_t dim) const {
+              if (x < 0) return 0;
+              if (x >= dim) return (dim-1);
+              return x;
+            }
+
+            void load () {
+              size_t i (0);
+              for (ssize_t z = 0; z < 2; ++z) {
+                ImageType::index(2) = clamp (cell[2] + z, ImageType::size (2));
+                for (ssize_t y = 0; y < 2; ++y) {
+                  ImageType::index(1) = clamp (cell[1] + y, ImageType::size (1));
+                  for (ssize_t x = 0; x < 2; ++x) {
+                    ImageType::index(0) = clamp (cell[0] + x, ImageType::size (0));
+                    cache.col (i++) = ImageType::row (3);
+                  }
+                }
+              }
+              cache_valid = true;
+            }
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
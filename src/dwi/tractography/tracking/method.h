@@ -81,6 +81,14 @@ namespace MR
                 return !std::isnan (values[0]);
               }
 
+            inline bool get_data (CachedLinearInterp<Image<float>>& source, const Eigen::Vector3f& position)
+            {
+              if (!source.scanner (position))
+                return false;
+              source.get (values);
+              return !std::isnan (values[0]);
+            }
+
             template <class InterpolatorType>
               inline bool get_data (InterpolatorType& source) {
                 return get_data (source, pos);
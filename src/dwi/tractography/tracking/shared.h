@@ -264,6 +264,12 @@ namespace MR
             void add_termination (const term_t i)   const { ++terminations[i]; }
             void add_rejection   (const reject_t i) const { ++rejections[i]; }
 
+            // Used to save & restore these statistics when checkpointing
+            size_t num_terminations (const term_t i)   const { return terminations[i]; }
+            size_t num_rejections   (const reject_t i) const { return rejections[i]; }
+            void add_terminations (const term_t i,   const size_t count) const { terminations[i] += count; }
+            void add_rejections   (const reject_t i, const size_t count) const { rejections[i] += count; }
+
 
 #ifdef DEBUG_TERMINATIONS
             void add_termination (const term_t i, const Eigen::Vector3f& p) const
@@ -14,6 +14,9 @@
  */
 #include "dwi/tractography/tracking/tractography.h"
 
+#include <cstdlib>
+#include <random>
+
 
 namespace MR
 {
@@ -102,7 +105,27 @@ namespace MR
 
       + Option ("downsample", "downsample the generated streamlines to reduce output file size "
                               "(default is (samples-1) for iFOD2, no downsampling for all other algorithms)")
-          + Argument ("factor").type_integer (2);
+          + Argument ("factor").type_integer (2)
+
+      + Option ("shard", "generate only one shard of the tractogram, so that it can be generated "
+                         "by multiple independent processes (e.g. on different nodes of a cluster), "
+                         "and the outputs subsequently combined using tckmerge. The shard is specified "
+                         "as i/N, with i between 1 and N; the numbers of streamlines requested using "
+                         "the -number and -maxnum options are divided between the N shards. If the "
+                         "MRTRIX_RNG_SEED environment variable is set, the seed used by each shard is "
+                         "derived from it; the results (and hence the merged output) are then reproducible "
+                         "only if each shard is also generated either using a single thread (-nthreads 0) "
+                         "or with the -deterministic option, since the order in which streamlines are "
+                         "written otherwise depends on the scheduling of threads.")
+          + Argument ("i/N").type_text()
+
+      + Option ("deterministic", "generate streamlines in a reproducible order, so that the output is identical "
+                                 "irrespective of the number of threads used. The random number generator is "
+                                 "seeded separately for each streamline from its index, and streamlines are "
+                                 "written in order of generation. The seed used is stored in the output header "
+                                 "(rng_seed); it can be provided using the MRTRIX_RNG_SEED environment variable "
+                                 "to reproduce the output of a previous run. This option cannot be used with "
+                                 "dynamic seeding.");
 
 
 
@@ -182,6 +205,66 @@ namespace MR
         opt = get_options ("downsample");
         if (opt.size()) properties["downsample_factor"] = str<unsigned int> (opt[0][0]);
 
+        opt = get_options ("shard");
+        if (opt.size()) {
+          const auto spec = split (opt[0][0], "/");
+          size_t index = 0, num_shards = 0;
+          if (spec.size() == 2) {
+            try {
+              index = to<size_t> (spec[0]);
+              num_shards = to<size_t> (spec[1]);
+            } catch (Exception&) { }
+          }
+          if (!num_shards || !index || index > num_shards)
+            throw Exception ("invalid shard specification \"" + std::string (opt[0][0]) + "\" (expected i/N, with i between 1 and N)");
+          properties["shard"] = str(index) + "/" + str(num_shards);
+        }
+
+      }
+
+
+
+      void load_shard_properties (Properties& properties)
+      {
+        const auto shard = properties.find ("shard");
+        if (shard == properties.end())
+          return;
+        const auto spec = split (shard->second, "/");
+        const uint64_t index = to<uint64_t> (spec[0]) - 1, num_shards = to<uint64_t> (spec[1]);
+
+        if (properties.seeds.is_finite())
+          throw Exception ("-shard option cannot be used with seeding mechanisms that provide a finite number of seeds");
+        if (properties["max_num_tracks"].empty() || !to<uint64_t> (properties["max_num_tracks"]))
+          throw Exception ("-shard option requires the total number of streamlines to be set using the -number option");
+
+        // shards with a lower index get the remainder, one streamline each
+        auto divide = [&] (const std::string& key) {
+          const uint64_t total = to<uint64_t> (properties[key]);
+          properties[key] = str (total / num_shards + (index < total % num_shards ? 1 : 0));
+        };
+        divide ("max_num_tracks");
+        if (properties["max_num_attempts"].size())
+          divide ("max_num_attempts");
+
+        // each shard needs a distinct seed; since one generator per thread is
+        //   seeded consecutively from it (see Math::RNG), as is a resumed run
+        //   (see Checkpoint::prepare_resume()), the seed of each shard is
+        //   derived by hashing the shard index with the original seed, rather
+        //   than by offsetting it, so that these ranges cannot overlap between shards
+        const char* from_env = getenv ("MRTRIX_RNG_SEED");
+        if (from_env) {
+          const uint64_t base = to<uint64_t> (from_env);
+          std::seed_seq seq ({ uint32_t (base), uint32_t (base >> 32), uint32_t (index), uint32_t (num_shards) });
+          uint32_t value;
+          seq.generate (&value, &value + 1);
+          const std::string seed = str (value);
+          INFO ("random number generator seed for shard " + shard->second + ": " + seed);
+#ifdef MRTRIX_WINDOWS
+          _putenv_s ("MRTRIX_RNG_SEED", seed.c_str());
+#else
+          setenv ("MRTRIX_RNG_SEED", seed.c_str(), 1);
+#endif
+        }
       }
 
 
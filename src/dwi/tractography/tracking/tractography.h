@@ -43,6 +43,10 @@ namespace MR
 
         void load_streamline_properties (Properties&);
 
+        // Divide the requested number of streamlines between shards (-shard option);
+        //   must be invoked once the seeding mechanism has been loaded
+        void load_shard_properties (Properties&);
+
       }
     }
   }
@@ -19,6 +19,7 @@
 
 #include "image.h"
 #include "interp/linear.h"
+#include "dwi/tractography/tracking/interpolator.h"
 
 
 
@@ -51,6 +52,14 @@ namespace MR
               typedef Interp::Linear<ImageType> type;
           };
 
+        // The source image is always loaded using direct IO, and all of its
+        //   volumes are interpolated at each sample
+        template <>
+          class Interpolator<Image<float>> {
+            public:
+              typedef CachedLinearInterp<Image<float>> type;
+          };
+
 
 
       }
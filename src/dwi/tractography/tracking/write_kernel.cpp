@@ -27,21 +27,226 @@ namespace MR
       {
 
 
+          WriteKernel::WriteKernel (const SharedBase& shared,
+              const std::string& output_file,
+              const DWI::Tractography::Properties& properties) :
+                S (shared),
+                output_file (output_file),
+                writer (open (properties)),
+                always_increment (S.properties.seeds.is_finite() || !S.max_num_tracks),
+                warn_on_max_attempts (S.implicit_max_num_attempts),
+                progress (printf ("       0 generated,        0 selected", 0, 0), always_increment ? S.max_num_attempts : S.max_num_tracks),
+                next_checkpoint (writer->count + checkpoint.interval())
+          {
+            const auto seed_output = properties.find ("seed_output");
+            if (checkpoint.resuming()) {
+
+              const Checkpoint::Entries entries = checkpoint.load ("tracking");
+              if (seed_output != properties.end()) {
+                File::resize (seed_output->second, to<int64_t> (Checkpoint::get (entries, "seeds_size")));
+                seeds.reset (new File::OFStream (seed_output->second, std::ios_base::out | std::ios_base::app));
+              }
+
+              const auto terminations = split (Checkpoint::get (entries, "terminations"), ",");
+              const auto rejections = split (Checkpoint::get (entries, "rejections"), ",");
+              if (terminations.size() != TERMINATION_REASON_COUNT || rejections.size() != REJECTION_REASON_COUNT)
+                throw Exception ("malformed tracking statistics in checkpoint");
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                S.add_terminations (term_t(i), to<size_t> (terminations[i]));
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                S.add_rejections (reject_t(i), to<size_t> (rejections[i]));
+
+              for (uint64_t i = always_increment ? writer->total_count : writer->count; i; --i)
+                ++progress;
+              INFO ("resuming tracking from checkpoint with " + str(writer->count) + " streamlines selected out of " + str(writer->total_count) + " generated");
+
+            } else if (seed_output != properties.end()) {
+              seeds.reset (new File::OFStream (seed_output->second, std::ios_base::out | std::ios_base::trunc));
+              (*seeds) << "#Track_index,Seed_index,Pos_x,Pos_y,Pos_z,\n";
+            }
+          }
+
+
+
           bool WriteKernel::operator() (const GeneratedTrack& tck)
           {
             if (complete())
               return false;
             if (tck.size() && seeds) {
               const auto& p = tck[tck.get_seed_index()];
-              (*seeds) << str(writer.count) << "," << str(tck.get_seed_index()) << "," << str(p[0]) << "," << str(p[1]) << "," << str(p[2]) << ",\n";
+              (*seeds) << str(writer->count) << "," << str(tck.get_seed_index()) << "," << str(p[0]) << "," << str(p[1]) << "," << str(p[2]) << ",\n";
+            }
+            (*writer) (tck);
+            progress.update ([&](){ return printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", writer->total_count, writer->count); }, always_increment ? true : tck.size());
+            if (checkpoint && writer->count >= next_checkpoint)
+              save_checkpoint();
+            return true;
+          }
+
+
+
+          Writer<>* WriteKernel::open (const DWI::Tractography::Properties& properties)
+          {
+            if (checkpoint && !Path::has_suffix (output_file, ".tck"))
+              throw Exception ("checkpointing is only supported for output in the .tck format");
+            if (!checkpoint.resuming())
+              return new Writer<> (output_file, properties);
+
+            const Checkpoint::Entries entries = checkpoint.load ("tracking");
+            if (Checkpoint::get (entries, "output") != output_file)
+              throw Exception ("checkpoint was saved for output file \"" + Checkpoint::get (entries, "output") + "\", not \"" + output_file + "\"");
+            Writer<>::ResumePoint resume;
+            resume.count = to<uint64_t> (Checkpoint::get (entries, "count"));
+            resume.total_count = to<uint64_t> (Checkpoint::get (entries, "total_count"));
+            resume.count_offset = to<int64_t> (Checkpoint::get (entries, "count_offset"));
+            resume.barrier_addr = to<int64_t> (Checkpoint::get (entries, "barrier_offset"));
+            resume.weights_size = to<int64_t> (Checkpoint::get (entries, "weights_size"));
+            return new Writer<> (output_file, resume);
+          }
+
+
+
+          Checkpoint::Entries WriteKernel::checkpoint_entries ()
+          {
+            writer->flush();
+            const Writer<>::ResumePoint resume = writer->resume_point();
+
+            Checkpoint::Entries entries;
+            entries["output"] = output_file;
+            entries["count"] = str (resume.count);
+            entries["total_count"] = str (resume.total_count);
+            entries["count_offset"] = str (resume.count_offset);
+            entries["barrier_offset"] = str (resume.barrier_addr);
+            entries["weights_size"] = str (resume.weights_size);
+            if (seeds) {
+              seeds->flush();
+              entries["seeds_size"] = str (int64_t (seeds->tellp()));
+            }
+            const auto rng_seed = S.properties.find ("rng_seed");
+            if (rng_seed != S.properties.end())
+              entries["rng_seed"] = rng_seed->second;
+
+            std::vector<std::string> terminations, rejections;
+            for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+              terminations.push_back (str (S.num_terminations (term_t(i))));
+            for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+              rejections.push_back (str (S.num_rejections (reject_t(i))));
+            entries["terminations"] = join (terminations, ",");
+            entries["rejections"] = join (rejections, ",");
+            return entries;
+          }
+
+
+
+          void WriteKernel::save_checkpoint ()
+          {
+            checkpoint.save ("tracking", checkpoint_entries());
+            next_checkpoint = writer->count + checkpoint.interval();
+            DEBUG ("tracking checkpoint saved at " + str(writer->count) + " streamlines");
+          }
+
+
+
+
+          OrderedWriteKernel::OrderedWriteKernel (const SharedBase& shared,
+              const std::string& output_file,
+              const DWI::Tractography::Properties& properties) :
+                WriteKernel (shared, output_file, properties),
+                buffer (TRACKING_REORDER_BUFFER_SIZE),
+                filled (TRACKING_REORDER_BUFFER_SIZE, false),
+                next_write (writer->total_count)
+          {
+            // when resuming, streamline generation carries on from the first
+            //   streamline not yet written, using the key of the original run
+            std::string key;
+            if (checkpoint.resuming()) {
+              key = Checkpoint::get (checkpoint.load ("tracking"), "rng_seed");
+            } else {
+              const auto rng_seed = properties.find ("rng_seed");
+              if (rng_seed == properties.end())
+                throw Exception ("random number generator seed missing for deterministic tracking");
+              key = rng_seed->second;
+            }
+            order.reset (new Order (to<uint64_t> (key), next_write));
+          }
+
+
+
+          bool OrderedWriteKernel::operator() (GeneratedTrack& tck)
+          {
+            assert (tck.get_index() >= next_write && tck.get_index() < next_write + buffer.size());
+            const size_t slot = tck.get_index() % buffer.size();
+            std::swap (buffer[slot], tck);
+            filled[slot] = true;
+            for (size_t i = next_write % buffer.size(); filled[i]; i = next_write % buffer.size()) {
+              filled[i] = false;
+              if (!WriteKernel::operator() (buffer[i]) || complete()) {
+                order->finish();
+                return false;
+              }
+              order->written (next_write++);
             }
-            writer (tck);
-            progress.update ([&](){ return printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", writer.total_count, writer.count); }, always_increment ? true : tck.size());
             return true;
           }
 
 
 
+          bool ParallelWriteKernel::operator() (const GeneratedTrack& tck)
+          {
+            if (complete())
+              return false;
+            // other threads may have reached the limits on the number of
+            //   attempts or streamlines since the check above
+            const uint64_t attempt = shared->total_count++;
+            if (S.max_num_attempts && attempt >= S.max_num_attempts)
+              return false;
+            if (tck.size()) {
+              const uint64_t selected = shared->count++;
+              if (S.max_num_tracks && selected >= S.max_num_tracks)
+                return false;
+            }
+
+            buffer (tck);
+            if (shared->always_increment || tck.size())
+              ++pending;
+            // avoid waiting on other threads just to update the progress bar
+            std::unique_lock<std::mutex> lock (shared->mutex, std::try_to_lock);
+            if (lock.owns_lock()) {
+              shared->update_progress (pending);
+              pending = 0;
+            }
+            return true;
+          }
+
+
+
+          void ParallelWriteKernel::Shared::update_progress (size_t increments)
+          {
+            // counts may overshoot the limits while other threads are terminating
+            auto text = [&]() {
+              uint64_t generated = total_count, selected = count;
+              if (S.max_num_attempts) generated = std::min<uint64_t> (generated, S.max_num_attempts);
+              if (S.max_num_tracks) selected = std::min<uint64_t> (selected, S.max_num_tracks);
+              return printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", generated, selected);
+            };
+            while (increments--)
+              progress.update (text);
+          }
+
+
+
+          ParallelWriteKernel::Shared::~Shared ()
+          {
+            const uint64_t generated = writer.num_processed(), selected = writer.num_written();
+            progress.set_text (printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", generated, selected));
+            if (warn_on_max_attempts && generated == S.max_num_attempts
+                && S.max_num_tracks && selected < S.max_num_tracks) {
+              WARN ("less than desired streamline number due to implicit maximum number of attempts; set -maxnum 0 to override");
+            }
+          }
+
+
+
       }
     }
   }
@@ -16,22 +16,33 @@
 #ifndef __dwi_tractography_tracking_write_kernel_h__
 #define __dwi_tractography_tracking_write_kernel_h__
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <cinttypes>
 
 #include "timer.h"
 #include "file/ofstream.h"
+#include "math/rng.h"
 
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_parallel.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
+#include "dwi/tractography/tracking/checkpoint.h"
 #include "dwi/tractography/tracking/generated_track.h"
 #include "dwi/tractography/tracking/shared.h"
 #include "dwi/tractography/tracking/types.h"
 
 
+// Maximum number of streamlines that may be held back by OrderedWriteKernel
+//   while waiting for earlier streamlines to be generated
+#define TRACKING_REORDER_BUFFER_SIZE 1024
+
 
 namespace MR
 {
@@ -43,25 +54,19 @@ namespace MR
       {
 
 
+      //! write streamlines to file from a single thread
+      /*! If the -checkpoint option is in use, the state of the output file(s)
+       * and the tracking statistics are saved at regular intervals; if the
+       * -resume option is also provided, the output files are re-opened and
+       * truncated at the point of the last checkpoint, and subsequent
+       * streamlines are appended to them. */
       class WriteKernel
       {
         public:
 
           WriteKernel (const SharedBase& shared,
               const std::string& output_file,
-              const DWI::Tractography::Properties& properties) :
-                S (shared),
-                writer (output_file, properties),
-                always_increment (S.properties.seeds.is_finite() || !S.max_num_tracks),
-                warn_on_max_attempts (S.implicit_max_num_attempts),
-                progress (printf ("       0 generated,        0 selected", 0, 0), always_increment ? S.max_num_attempts : S.max_num_tracks)
-          {
-            const auto seed_output = properties.find ("seed_output");
-            if (seed_output != properties.end()) {
-              seeds.reset (new File::OFStream (seed_output->second, std::ios_base::out | std::ios_base::trunc));
-              (*seeds) << "#Track_index,Seed_index,Pos_x,Pos_y,Pos_z,\n";
-            }
-          }
+              const DWI::Tractography::Properties& properties);
 
           WriteKernel (const WriteKernel&) = delete;
           WriteKernel& operator= (const WriteKernel&) = delete;
@@ -69,9 +74,9 @@ namespace MR
           ~WriteKernel ()
           {
             // Use set_text() rather than update() here to force update of the text before progress goes out of scope
-            progress.set_text (printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", writer.total_count, writer.count));
-            if (warn_on_max_attempts && writer.total_count == S.max_num_attempts
-                && S.max_num_tracks && writer.count < S.max_num_tracks) {
+            progress.set_text (printf ("%8" PRIu64 " generated, %8" PRIu64 " selected", writer->total_count, writer->count));
+            if (warn_on_max_attempts && writer->total_count == S.max_num_attempts
+                && S.max_num_tracks && writer->count < S.max_num_tracks) {
               WARN ("less than desired streamline number due to implicit maximum number of attempts; set -maxnum 0 to override");
             }
             if (seeds) {
@@ -84,15 +89,212 @@ namespace MR
 
           bool operator() (const GeneratedTrack&);
 
-          bool complete() const { return ((S.max_num_tracks && writer.count >= S.max_num_tracks) || (S.max_num_attempts && writer.total_count >= S.max_num_attempts)); }
+          bool complete() const { return ((S.max_num_tracks && writer->count >= S.max_num_tracks) || (S.max_num_attempts && writer->total_count >= S.max_num_attempts)); }
+
+          //! complete the output file once tracking has finished
+          void finalise () { writer->finalise(); }
 
 
         protected:
           const SharedBase& S;
-          Writer<> writer;
+          const std::string output_file;
+          const Checkpoint checkpoint;
+          std::unique_ptr<Writer<>> writer;
           const bool always_increment, warn_on_max_attempts;
           std::unique_ptr<File::OFStream> seeds;
           ProgressBar progress;
+          uint64_t next_checkpoint;
+
+          Writer<>* open (const DWI::Tractography::Properties&);
+
+          //! flush the output, and get the entries describing the current state of tracking
+          Checkpoint::Entries checkpoint_entries ();
+          //! save the current state of tracking, and set the point of the next checkpoint
+          /*! Derived classes holding a reference to other components with
+           * state to be preserved may override this, so that all state is
+           * committed to the checkpoint together. */
+          virtual void save_checkpoint ();
+      };
+
+
+
+
+
+      //! write streamlines to file in order of generation, for the -deterministic option
+      /*! Each streamline is assigned a sequential index as its generation
+       * begins, and the random number generator of the tracking thread is
+       * seeded from that index using a counter-based generator (see
+       * Order::seed()); streamlines that complete out of order are held in a
+       * reorder buffer until all preceding streamlines have been written.
+       * The output is therefore identical irrespective of the number of
+       * threads used.
+       *
+       * To bound the size of the reorder buffer, tracking threads must wait
+       * for the writer before starting a streamline whose index is more than
+       * TRACKING_REORDER_BUFFER_SIZE ahead of the next streamline to be
+       * written (see Order::wait()). This requires that each streamline is
+       * sent to the writer as soon as it is generated, i.e. streamlines must
+       * not be batched. */
+      class OrderedWriteKernel : public WriteKernel
+      {
+        public:
+
+          //! state shared between the tracking threads and the writer
+          class Order
+          {
+            public:
+              Order (const uint64_t key, const uint64_t first_index) :
+                  next_index (first_index),
+                  philox (key),
+                  next_write (first_index),
+                  finished (false) { }
+
+              //! wait until the streamline at next_index can be generated
+              /*! \a lock must be held on #mutex. Returns false if no further
+               * streamlines are to be generated. */
+              bool wait (std::unique_lock<std::mutex>& lock) {
+                cond.wait (lock, [&] { return finished || next_index < next_write + TRACKING_REORDER_BUFFER_SIZE; });
+                return !finished;
+              }
+
+              //! seed a random number generator for the streamline with the given index
+              void seed (Math::RNG& rng, const uint64_t index) const {
+                const auto values = philox (index);
+                std::seed_seq seq (values.begin(), values.end());
+                rng.seed (seq);
+              }
+
+              void written (const uint64_t index) {
+                std::lock_guard<std::mutex> lock (mutex);
+                next_write = index + 1;
+                cond.notify_all();
+              }
+
+              void finish () {
+                std::lock_guard<std::mutex> lock (mutex);
+                finished = true;
+                cond.notify_all();
+              }
+
+              std::mutex mutex;
+              uint64_t next_index;
+
+            private:
+              const Math::Philox philox;
+              uint64_t next_write;
+              bool finished;
+              std::condition_variable cond;
+          };
+
+
+          OrderedWriteKernel (const SharedBase& shared,
+              const std::string& output_file,
+              const DWI::Tractography::Properties& properties);
+
+          ~OrderedWriteKernel () { order->finish(); }
+
+          bool operator() (GeneratedTrack&);
+
+          std::shared_ptr<Order> get_order() const { return order; }
+
+
+        protected:
+          std::shared_ptr<Order> order;
+          std::vector<GeneratedTrack> buffer;
+          std::vector<bool> filled;
+          uint64_t next_write;
+      };
+
+
+
+
+      //! write streamlines to file from all tracking threads concurrently
+      /*! This is intended to be run using Thread::multi(), so that each
+       * thread formats and writes its own streamlines to file via a
+       * ParallelWriter, rather than funnelling all streamlines through a
+       * single writer thread as WriteKernel does. The streamline and attempt
+       * counts are shared between threads, so that tracking terminates as
+       * soon as the requested number of streamlines has been written.
+       *
+       * This cannot be used if the order of streamlines needs to be
+       * preserved, for output in the compact track format, if the seed
+       * locations are to be written to file, or if checkpointing is in use
+       * (see supported()). */
+      class ParallelWriteKernel
+      {
+        public:
+
+          ParallelWriteKernel (const SharedBase& shared,
+              const std::string& output_file,
+              const DWI::Tractography::Properties& properties) :
+                S (shared),
+                shared (new Shared (shared, output_file, properties)),
+                buffer (this->shared->writer),
+                pending (0) { }
+
+          ParallelWriteKernel (const ParallelWriteKernel& that) :
+                S (that.S),
+                shared (that.shared),
+                buffer (that.buffer),
+                pending (0) { }
+
+          // any failure to write the remaining data is reported by finalise()
+          ~ParallelWriteKernel ()
+          {
+            buffer.close();
+            std::lock_guard<std::mutex> lock (shared->mutex);
+            shared->update_progress (pending);
+          }
+
+          static bool supported (const std::string& output_file, const DWI::Tractography::Properties& properties) {
+            return Path::has_suffix (output_file, ".tck") && properties.find ("seed_output") == properties.end()
+                && !App::get_options ("checkpoint").size();
+          }
+
+          bool operator() (const GeneratedTrack&);
+
+          bool complete() const { return shared->complete(); }
+
+          //! complete the output file once all other copies have been destroyed
+          void finalise () {
+            buffer.commit();
+            shared->writer.finish();
+          }
+
+
+        protected:
+          class Shared
+          {
+            public:
+              Shared (const SharedBase& shared, const std::string& output_file, const DWI::Tractography::Properties& properties) :
+                  S (shared),
+                  writer (output_file, properties),
+                  count (0),
+                  total_count (0),
+                  always_increment (S.properties.seeds.is_finite() || !S.max_num_tracks),
+                  warn_on_max_attempts (S.implicit_max_num_attempts),
+                  progress (printf ("       0 generated,        0 selected", 0, 0), always_increment ? S.max_num_attempts : S.max_num_tracks) { }
+
+              ~Shared ();
+
+              bool complete() const {
+                return ((S.max_num_tracks && count >= S.max_num_tracks) || (S.max_num_attempts && total_count >= S.max_num_attempts));
+              }
+
+              void update_progress (size_t increments);
+
+              const SharedBase& S;
+              ParallelWriter<> writer;
+              std::atomic<uint64_t> count, total_count;
+              const bool always_increment, warn_on_max_attempts;
+              std::mutex mutex;
+              ProgressBar progress;
+          };
+
+          const SharedBase& S;
+          std::shared_ptr<Shared> shared;
+          ParallelWriter<>::Buffer buffer;
+          size_t pending;
       };
 
 
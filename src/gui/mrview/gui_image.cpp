@@ -431,14 +431,15 @@ namespace MR
             using MR::Image<cfloat>::buffer;
 
             WithType (const MR::Image<cfloat>& source) : MR::Image<cfloat> (source) {
-              __set_fetch_store_functions (fetch_func, store_func, buffer->datatype());
+              __set_fetch_store_functions (functions, buffer->datatype());
             } 
             FORCE_INLINE ValueType value () const {
               ssize_t nseg = data_offset / buffer->get_io()->segment_size();
-              return fetch_func (buffer->get_io()->segment (nseg), data_offset - nseg*buffer->get_io()->segment_size(), buffer->intensity_offset(), buffer->intensity_scale());
+              const ValueType val = functions.fetch (buffer->get_io()->segment (nseg), data_offset - nseg*buffer->get_io()->segment_size(), buffer->intensity_offset(), buffer->intensity_scale());
+              buffer->get_io()->release_segment (nseg);
+              return val;
             }
-            std::function<ValueType(const void*,size_t,default_type,default_type)> fetch_func;
-            std::function<void(ValueType,void*,size_t,default_type,default_type)> store_func;
+            FetchStoreFunctions<ValueType> functions;
           } V (image);
 
           const size_t N = ( format == gl::RED ? 1 : 3 );
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include "command.h"
+#include "image.h"
+#include "timer.h"
+#include "math/SH.h"
+#include "dwi/directions/set.h"
+#include "dwi/fmls.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::FMLS;
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+
+  DESCRIPTION
+  + "measure the throughput of FMLS segmentation of FODs, in voxels per second, "
+    "when the SH-to-amplitude transform is performed for each voxel individually, "
+    "and when it is performed for batches of voxels"
+
+  + "All voxels are read into memory prior to timing, and segmented within a "
+    "single thread. The fixels obtained using the two approaches are checked "
+    "against each other.";
+
+  ARGUMENTS
+  + Argument ("fod", "the input FOD image.").type_image_in();
+
+  OPTIONS
+  + Option ("mask", "only segment voxels within the specified mask.")
+    + Argument ("image").type_image_in()
+
+  + Option ("repeat", "the number of times to segment each voxel for each measurement (default: 1).")
+    + Argument ("number").type_integer (1);
+}
+
+
+
+void check (const FOD_lobes& a, const FOD_lobes& b)
+{
+  if (a.size() != b.size())
+    throw Exception ("mismatch in number of fixels in voxel [ " + str(a.vox.transpose()) + " ]");
+  for (size_t i = 0; i != a.size(); ++i) {
+    if (std::abs (a[i].get_integral() - b[i].get_integral()) > 1e-4 * std::abs (a[i].get_integral())
+        || a[i].get_peak_dir(0) != b[i].get_peak_dir(0))
+      throw Exception ("mismatch in fixel " + str(i) + " of voxel [ " + str(a.vox.transpose()) + " ]");
+  }
+}
+
+
+
+void run ()
+{
+  auto fod = Image<float>::open (argument[0]);
+  Math::SH::check (fod);
+  Image<float> mask;
+  auto opt = get_options ("mask");
+  if (opt.size())
+    mask = Image<float>::open (opt[0][0]);
+  const size_t repeat = get_option_value ("repeat", 1);
+
+  std::vector<SH_coefs> voxels;
+  {
+    FODQueueWriter writer (fod, mask);
+    SH_coefs in;
+    while (writer (in))
+      voxels.push_back (in);
+  }
+
+  const DWI::Directions::Set dirs (1281);
+  const Segmenter fmls (dirs, Math::SH::LforN (fod.size(3)));
+
+  std::vector<FOD_lobes> single (voxels.size());
+  Timer timer;
+  for (size_t r = 0; r != repeat; ++r) {
+    for (size_t i = 0; i != voxels.size(); ++i)
+      fmls (voxels[i], single[i]);
+  }
+  const double single_rate = repeat * voxels.size() / timer.elapsed();
+
+  std::vector<FOD_lobes> batched;
+  batched.reserve (voxels.size());
+  timer.start();
+  for (size_t r = 0; r != repeat; ++r) {
+    batched.clear();
+    std::vector<SH_coefs> in;
+    std::vector<FOD_lobes> out;
+    for (size_t i = 0; i < voxels.size(); i += FMLS_BATCH_SIZE) {
+      in.assign (voxels.begin() + i, voxels.begin() + std::min (i + FMLS_BATCH_SIZE, voxels.size()));
+      fmls (in, out);
+      batched.insert (batched.end(), out.begin(), out.end());
+    }
+  }
+  const double batched_rate = repeat * voxels.size() / timer.elapsed();
+
+  for (size_t i = 0; i != voxels.size(); ++i)
+    check (single[i], batched[i]);
+
+  std::cout << "# voxels " << voxels.size() << "\n";
+  std::cout << "# method voxels/s\n";
+  std::cout << "single " << single_rate << "\n";
+  std::cout << "batch " << batched_rate << "\n";
+}
+
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include <atomic>
+
+#include "command.h"
+#include "timer.h"
+#include "thread_queue.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+
+  DESCRIPTION
+  + "measure the throughput of Thread::Queue, in items per second, "
+    "when pushing items from a number of source threads through to a "
+    "number of sink threads"
+
+  + "The number of threads at each end is varied from 1 up to the number "
+    "specified using the -nthreads option (or the number of hardware "
+    "threads by default). The sum of the items received is checked "
+    "against the expected value.";
+
+  ARGUMENTS
+  + Argument ("count", "the number of items to push through the queue for each measurement.").type_integer (1);
+
+  OPTIONS
+  + Option ("batch", "send items in batches of the size specified.")
+    + Argument ("size").type_integer (1);
+}
+
+
+
+class Source {
+  public:
+    Source (std::atomic<size_t>& next, size_t count) : next (next), count (count) { }
+    bool operator() (size_t& item) {
+      item = next++;
+      return item < count;
+    }
+  private:
+    std::atomic<size_t>& next;
+    const size_t count;
+};
+
+
+class Sink {
+  public:
+    Sink (std::atomic<size_t>& total) : total (total), sum (0) { }
+    Sink (const Sink& that) : total (that.total), sum (0) { }
+    ~Sink () { total += sum; }
+    bool operator() (const size_t& item) {
+      sum += item;
+      return true;
+    }
+  private:
+    std::atomic<size_t>& total;
+    size_t sum;
+};
+
+
+
+void run ()
+{
+  const size_t count = int (argument[0]);
+  const size_t batch_size = get_option_value ("batch", 0);
+  const size_t max_threads = std::max (Thread::number_of_threads(), size_t (1));
+
+#ifdef MRTRIX_LOCKFREE_QUEUE
+  CONSOLE ("using lock-free queue implementation");
+#else
+  CONSOLE ("using mutex-based queue implementation");
+#endif
+
+  std::cout << "# sources sinks items/s\n";
+  for (size_t nsources = 1; nsources <= max_threads; nsources *= 2) {
+    for (size_t nsinks = 1; nsinks <= max_threads; nsinks *= 2) {
+      std::atomic<size_t> next (0), total (0);
+      Source source (next, count);
+
+      Timer timer;
+      {
+        // sinks must be destroyed (updating total) before the sum is checked:
+        Sink sink (total);
+        if (batch_size)
+          Thread::run_queue (Thread::multi (source, nsources), Thread::batch (size_t(), batch_size), Thread::multi (sink, nsinks));
+        else
+          Thread::run_queue (Thread::multi (source, nsources), size_t(), Thread::multi (sink, nsinks));
+      }
+      const double elapsed = timer.elapsed();
+
+      if (total != count * (count-1) / 2)
+        throw Exception ("mismatch in sum of items received with " + str(nsources) + " sources & " + str(nsinks) + " sinks");
+
+      std::cout << nsources << " " << nsinks << " " << count / elapsed << "\n";
+    }
+  }
+}
+
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2008-2016 the MRtrix3 contributors
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see www.mrtrix.org
+ *
+ */
+
+#include "command.h"
+#include "image.h"
+#include "timer.h"
+#include "interp/linear.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/tracking/interpolator.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+
+  DESCRIPTION
+  + "measure the rate at which the source image can be sampled during "
+    "tracking, in samples per second, using the generic linear interpolator "
+    "and the cached interpolator used by the tracking algorithms"
+
+  + "The image is sampled at each vertex of the streamlines provided, "
+    "optionally upsampled to mimic the smaller internal step size of the "
+    "tracking algorithms. The values produced by both interpolators are "
+    "checked against each other.";
+
+  ARGUMENTS
+  + Argument ("image", "the source image (e.g. FOD image) used for tracking.").type_image_in ()
+  + Argument ("tracks", "a track file generated from that image.").type_file_in ();
+
+  OPTIONS
+  + Option ("upsample", "insert this number of samples along each streamline segment (default: 10).")
+    + Argument ("factor").type_integer (1);
+}
+
+
+
+typedef Eigen::Vector3f point_type;
+
+template <class InterpType, class Functor>
+double time_samples (InterpType& interp, const std::vector<point_type>& points, Functor&& get)
+{
+  Timer timer;
+  for (const auto& p : points) {
+    if (interp.scanner (p))
+      get (interp);
+  }
+  return points.size() / timer.elapsed();
+}
+
+
+
+void run ()
+{
+  auto image = Image<float>::open (argument[0]).with_direct_io (3);
+  const size_t upsample = get_option_value ("upsample", 10);
+
+  std::vector<point_type> points;
+  {
+    DWI::Tractography::Properties properties;
+    DWI::Tractography::Reader<float> reader (argument[1], properties);
+    DWI::Tractography::Streamline<float> tck;
+    while (reader (tck)) {
+      for (size_t n = 1; n < tck.size(); ++n) {
+        for (size_t i = 0; i < upsample; ++i)
+          points.push_back (tck[n-1] + (float(i) / float(upsample)) * (tck[n] - tck[n-1]));
+      }
+    }
+  }
+  if (points.empty())
+    throw Exception ("no streamline vertices found in file \"" + std::string (argument[1]) + "\"");
+
+  Eigen::VectorXf linear_values (image.size(3)), cached_values (image.size(3));
+  Interp::Linear<Image<float>> linear (image);
+  DWI::Tractography::Tracking::CachedLinearInterp<Image<float>> cached (image);
+
+  float max_diff = 0.0;
+  for (const auto& p : points) {
+    if (linear.scanner (p) != cached.scanner (p))
+      throw Exception ("mismatch in bounds checking between interpolators");
+    if (!linear)
+      continue;
+    for (auto l = Loop (3) (linear); l; ++l)
+      linear_values[linear.index(3)] = linear.value();
+    cached.get (cached_values);
+    max_diff = std::max (max_diff, (linear_values - cached_values).cwiseAbs().maxCoeff());
+  }
+
+  const double linear_rate = time_samples (linear, points, [&] (Interp::Linear<Image<float>>& interp) {
+      for (auto l = Loop (3) (interp); l; ++l)
+        linear_values[interp.index(3)] = interp.value();
+      });
+  const double cached_rate = time_samples (cached, points, [&] (DWI::Tractography::Tracking::CachedLinearInterp<Image<float>>& interp) {
+      interp.get (cached_values);
+      });
+
+  std::cout << "# samples linear cached speedup max_diff\n";
+  std::cout << points.size() << " " << linear_rate << " " << cached_rate << " " << cached_rate / linear_rate << " " << max_diff << "\n";
+}
+
@@ -0,0 +1 @@
+#define MRTRIX_PROJECT_VERSION "397884e0"